@@ -0,0 +1,994 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include "batch.h"
+#include "telemetry.h"
+#include "instrument.h"
+#include "report.h"
+#include "plate.h"
+#include "xlsx.h"
+#include "gzip.h"
+#include "zstd.h"
+#include "mixing.h"
+#include "decimal.h"
+#include "formula.h"
+#include "catalog.h"
+#include "totals.h"
+#include "sorter.h"
+#include "partition.h"
+#include "parallel.h"
+
+
+// Constants: lines formatted per parallel task
+#define FORMAT_CHUNK 4096
+
+
+void BatchColumns::resize(size_t n)
+{
+    for (int r = 0; r != ROWS; ++r)
+    {
+        values[r].resize(n);
+        sig_figs[r].resize(n);
+    }
+    validity.resize(n);
+    diagnostics.resize(n);
+    reagent_codes.resize(n);
+    trailing_ends.resize(n);
+    for (BatchKey& key: keys)
+        key.codes.resize(n);
+}
+
+
+size_t BatchColumns::field_count() const
+{
+    size_t count = ROWS;
+    for (const BatchKey& key: keys)
+        for (int field: key.fields)
+            count = std::max(count, (size_t)field + 1);
+    return(count);
+}
+
+
+void BatchColumns::append_trailing(size_t i, size_t f, std::string& text, bool quoted) const
+{
+    const size_t field = (i ? trailing_ends[i - 1] : 0) + f;
+    if (field >= trailing_ends[i])
+        return;
+    const size_t start = field ? trailing_fields[field - 1] : 0;
+    if (quoted)
+        append_csv_field(text, trailing.data() + start, trailing_fields[field] - start);
+    else
+        text.append(trailing, start, trailing_fields[field] - start);
+}
+
+
+char* split_csv_field(char* line, size_t& length)
+{
+    if (*line != '"')
+    {
+        length = strcspn(line, ",");
+        char* next = line[length] ? line + length + 1 : nullptr;
+        line[length] = '\0';
+        return(next);
+    }
+
+    // The quotes are taken out and doubled quotes made single, moving the text back over them
+    char* out = line;
+    char* c = line + 1;
+    for (; *c; ++c)
+    {
+        if (*c == '"' && *++c != '"')
+            break;
+        *out++ = *c;
+    }
+    // Text between the closing quote and the comma, which RFC 4180 does not allow, is kept
+    while (*c && *c != ',')
+        *out++ = *c++;
+    char* next = *c ? c + 1 : nullptr;
+    *out = '\0';
+    length = out - line;
+    return(next);
+}
+
+
+std::vector<std::string> split_csv_line(const std::string& line)
+{
+    std::vector<char> text(line.begin(), line.end());
+    text.push_back('\0');
+    std::vector<std::string> fields;
+    size_t length;
+    for (char* field = text.data(); field; )
+    {
+        char* next = split_csv_field(field, length);
+        fields.emplace_back(field, length);
+        field = next;
+    }
+    return(fields);
+}
+
+
+void append_csv_field(std::string& text, const char* field, size_t length)
+{
+    if (strcspn(field, ",\"\r\n") >= length)
+    {
+        text.append(field, length);
+        return;
+    }
+    text += '"';
+    for (size_t c = 0; c != length; ++c)
+    {
+        if (field[c] == '"')
+            text += '"';
+        text += field[c];
+    }
+    text += '"';
+}
+
+
+void BatchColumns::clear_trailing()
+{
+    trailing.clear();
+    trailing_fields.clear();
+    trailing_ends.assign(size(), 0);
+}
+
+
+uint32_t TextDictionary::encode(const char* text)
+{
+    const char* start = text + strspn(text, " \t");
+    size_t length = strlen(start);
+    while (length && (start[length - 1] == ' ' || start[length - 1] == '\t' || start[length - 1] == '\r'))
+        --length;
+    auto inserted = codes.emplace(std::string(start, length), (uint32_t)keys.size());
+    if (inserted.second)
+        keys.push_back(&inserted.first->first);
+    return(inserted.first->second);
+}
+
+
+void encode_batch_keys(BatchColumns& columns, size_t i, const char* const* fields)
+{
+    std::string text;
+    for (BatchKey& key: columns.keys)
+    {
+        text.clear();
+        for (size_t f = 0; f != key.fields.size(); ++f)
+        {
+            const char* field = fields[key.fields[f]];
+            const size_t start = strspn(field, " \t");
+            size_t end = strlen(field);
+            while (end > start && strchr(" \t", field[end - 1]))
+                --end;
+            text.append(f ? "," : "").append(field + start, end - start);
+        }
+        key.codes[i] = key.dictionary.encode(text.c_str());
+    }
+}
+
+
+int find_batch_field(const std::string& header, const std::string& name)
+{
+    const std::vector<std::string> names = split_csv_line(header);
+    for (size_t field = 0; field != names.size(); ++field)
+    {
+        const size_t first = names[field].find_first_not_of(" \t"), last = names[field].find_last_not_of(" \t");
+        if (first != std::string::npos && names[field].compare(first, last - first + 1, name) == 0)
+            return((int)field);
+    }
+    return(-1);
+}
+
+
+void ReagentDictionary::resolve()
+{
+    INSTRUMENT_SCOPE("resolve_reagents");
+    const size_t first = resolved, n = keys.size();
+    INSTRUMENT_COUNT("reagent_keys", n - first);
+    molar_masses.resize(n);
+    sig_figs.resize(n);
+    lines.resize(n);
+    parallel_for((n - first + CATALOG_CHUNK - 1)/CATALOG_CHUNK, [&](size_t chunk) {
+        const size_t end = std::min(first + (chunk + 1)*CATALOG_CHUNK, n);
+        for (size_t k = first + chunk*CATALOG_CHUNK; k != end; ++k)
+        {
+            const long line = catalog ? catalog->find(*keys[k]) : -1;
+            if (line >= 0)
+            {
+                molar_masses[k] = catalog->molar_masses[line]/catalog->purities[line];
+                sig_figs[k] = catalog->sig_figs[line];
+                continue;
+            }
+
+            Composition composition;
+            std::string error;
+            const double molar_mass = parse_formula(*keys[k], composition, error) ? formula_molar_mass(composition) : 0;
+
+            // Figures of the molar mass to FORMULA_DECIMALS places, so results are not given more precisely than the atomic weights
+            char text[64];
+            snprintf(text, sizeof text, "%.*f", FORMULA_DECIMALS, molar_mass);
+            molar_masses[k] = (molar_mass > 0) ? molar_mass : 0;
+            sig_figs[k] = (molar_mass > 0) ? count_sig_figs(text) : 0;
+        }
+    });
+    resolved = n;
+}
+
+
+void parse_batch_field(BatchColumns& columns, int r, size_t i, const char* field, Validity& validity)
+{
+    double value = 0;
+    InputState state = parse_value(field, value);
+    columns.values[r][i] = (state == input_parsed) ? value : 0;
+    columns.sig_figs[r][i] = (state == input_parsed) ? count_sig_figs(field) : 0;
+    validity.valid |= (state == input_parsed) << r;
+    validity.invalid |= (state == input_invalid) << r;
+    if (r != 1)
+        return;
+
+    // With a catalog, numbers are looked up too, as IDs such as "100234" read as numbers. Only those that are IDs are encoded, so the dictionary does not grow with every distinct molar mass.
+    bool reagent = (state == input_invalid);
+    if (state == input_parsed && columns.reagents.catalog)
+    {
+        const char* start = field + strspn(field, " \t");
+        size_t length = strlen(start);
+        while (length && strchr(" \t\r", start[length - 1]))
+            --length;
+        reagent = columns.reagents.catalog->find(std::string(start, length)) >= 0;
+    }
+    columns.reagent_codes[i] = reagent ? columns.reagents.encode(field) : NO_REAGENT;
+}
+
+
+void decode_reagents(BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("decode_reagents");
+    ReagentDictionary& reagents = columns.reagents;
+    reagents.resolve();
+
+    // Each line gathers from the few entries of the dictionary by its code
+    const uint32_t* codes = columns.reagent_codes.data();
+    for (size_t i = 0, n = columns.size(); i != n; ++i)
+    {
+        if (codes[i] == NO_REAGENT)
+            continue;
+        const double molar_mass = reagents.molar_masses[codes[i]];
+        ++reagents.lines[codes[i]];
+        Validity& validity = columns.validity[i];
+        columns.values[1][i] = molar_mass;
+        columns.sig_figs[1][i] = reagents.sig_figs[codes[i]];
+        validity.valid = (molar_mass > 0) ? (validity.valid | RowEnum::molar_mass) : (validity.valid & ~RowEnum::molar_mass);
+        validity.invalid = (molar_mass > 0) ? (validity.invalid & ~RowEnum::molar_mass) : (validity.invalid | RowEnum::molar_mass);
+    }
+}
+
+
+// Reads a record into record with next_line, which works as fgets does, however long it is: a line, or several while a quoted field holds line breaks. The final line break is left out. Returns false at the end of the input.
+template <typename NextLine>
+static bool read_record(NextLine next_line, std::string& record)
+{
+    char piece[1024];
+    record.clear();
+    bool field_start = true, quoted = false, closed = false;
+    while (next_line(piece, (int)sizeof piece))
+    {
+        // A quote opens a field only at its start; inside one, a quote closes it unless another follows
+        for (const char* c = piece; *c; ++c)
+        {
+            if (*c == '"' && (quoted || field_start || closed))
+            {
+                closed = quoted;
+                quoted = !quoted;
+            }
+            else
+                closed = false;
+            field_start = !quoted && *c == ',';
+        }
+        record += piece;
+        if (!quoted && record.back() == '\n')
+            break;
+    }
+    if (record.empty())
+        return(false);
+    while (!record.empty() && (record.back() == '\n' || record.back() == '\r'))
+        record.pop_back();
+    return(true);
+}
+
+
+// Reads lines with next_line, which works as fgets does, for the read_batch overloads
+template <typename NextLine>
+static size_t read_lines(NextLine next_line, BatchColumns& columns, size_t max_lines)
+{
+    INSTRUMENT_SCOPE("read_batch");
+    columns.resize(max_lines);
+    columns.clear_trailing();
+    std::string record;
+    std::vector<const char*> fields(columns.field_count());
+    size_t n = 0;
+    while (n != max_lines && read_record(next_line, record))
+    {
+        Validity validity = {0, 0};
+        char* line = &record[0];
+
+        // Every field of the line is split off; those after the calculator rows are also kept, one by one, to be written back
+        size_t f = 0;
+        for (char* field = line; field; ++f)
+        {
+            size_t length;
+            char* next = split_csv_field(field, length);
+            if (f < fields.size())
+                fields[f] = field;
+            if (f >= ROWS)
+            {
+                columns.trailing.append(field, length);
+                columns.trailing_fields.push_back(columns.trailing.size());
+            }
+            field = next;
+        }
+        for (; f < fields.size(); ++f)
+            fields[f] = "";
+        columns.trailing_ends[n] = columns.trailing_fields.size();
+        for (int r = 0; r != ROWS; ++r)
+            parse_batch_field(columns, r, n, fields[r], validity);
+        encode_batch_keys(columns, n, fields.data());
+        columns.validity[n++] = validity;
+    }
+    columns.resize(n);
+    decode_reagents(columns);
+    INSTRUMENT_COUNT("batch_lines", n);
+    return(n);
+}
+
+
+size_t read_batch(FILE* in, BatchColumns& columns, size_t max_lines)
+{
+    return(read_lines([in](char* line, int size) { return(fgets(line, size, in)); }, columns, max_lines));
+}
+
+
+size_t read_batch(CompressedReader& in, BatchColumns& columns, size_t max_lines)
+{
+    return(read_lines([&in](char* line, int size) { return(in.gets(line, size)); }, columns, max_lines));
+}
+
+
+// Solves every line of columns for solve_batch, counting the paths taken in hits. Only the timed version reads the clock, so the loop run without --timing makes no call per line.
+template <bool timed>
+static void solve_lines(BatchColumns& columns, long target, unsigned char* seen_codes, unsigned long long* hits, unsigned long long* cycles)
+{
+    const unsigned char target_bit = 1 << target;
+    const size_t n = columns.size();
+    for (size_t i = 0; i != n; ++i)
+    {
+        const unsigned long long start = timed ? telemetry_clock() : 0;
+        Validity& validity = columns.validity[i];
+        validity.valid &= ~target_bit;
+        validity.invalid &= ~target_bit;
+        const Relation& relation = find_relation(target, validity.valid);
+        ++hits[relation.source];
+
+        double values[ROWS];
+        for (int r = 0; r != ROWS; ++r)
+            values[r] = columns.values[r][i];
+        double moles = 0;
+        double result = solve(target, relation.source, values, moles);
+
+        // A zero divisor leaves the line unsolved rather than writing inf or nan as a result
+        const bool finite = std::isfinite(result) && (!relation.writes_moles || std::isfinite(moles));
+        const bool solved = (relation.source != no_source) && finite;
+        const Diagnostic code = (relation.source == no_source || finite) ? diagnose(target, validity, relation) : diagnose_undefined(validity);
+        columns.diagnostics[i] = code;
+        seen_codes[code] = 1;
+
+        // Fewest significant figures among the rows used, as in Calculator::sig_figs
+        unsigned char figures = 0xff, moles_figures = 0xff;
+        for (int r = 0; r != ROWS; ++r)
+        {
+            unsigned char row_figures = columns.sig_figs[r][i] ? columns.sig_figs[r][i] : 0xff;
+            figures = std::min(figures, (relation.inputs & (1 << r)) ? row_figures : (unsigned char)0xff);
+            moles_figures = std::min(moles_figures, (relation.moles_inputs & (1 << r)) ? row_figures : (unsigned char)0xff);
+        }
+
+        columns.values[target][i] = solved ? result : 0;
+        columns.sig_figs[target][i] = (solved && figures != 0xff) ? figures : 0;
+        validity.valid |= solved ? target_bit : 0;
+        if (solved && relation.writes_moles)
+        {
+            columns.values[2][i] = moles;
+            columns.sig_figs[2][i] = (moles_figures != 0xff) ? moles_figures : 0;
+            validity.valid |= RowEnum::moles;
+            validity.invalid &= ~RowEnum::moles;
+        }
+        if (timed)
+            cycles[relation.source] += telemetry_clock() - start;
+    }
+}
+
+
+void solve_batch(BatchColumns& columns, long target, unsigned char* seen_codes)
+{
+    INSTRUMENT_SCOPE("solve_batch");
+    unsigned char ignored_codes[DIAGNOSTIC_CODES];
+    if (!seen_codes)
+        seen_codes = ignored_codes;
+
+    // Paths are counted locally and added to the thread's counters once per block
+    unsigned long long hits[no_source + 1] = {0}, cycles[no_source + 1] = {0};
+    if (telemetry_timing)
+        solve_lines<true>(columns, target, seen_codes, hits, cycles);
+    else
+        solve_lines<false>(columns, target, seen_codes, hits, cycles);
+
+    PathCounters& counters = thread_path_counters();
+    for (int source = from_mass; source != no_source + 1; ++source)
+        counters.add(solver_path(target, (MolesSource)source), hits[source], cycles[source]);
+    INSTRUMENT_COUNT("solver_dispatch", columns.size());
+}
+
+
+// Multiplies the volume of every line by ratio. Empty and invalid fields hold 0, so every line is scaled without a test.
+static void scale_volumes(BatchColumns& columns, double ratio)
+{
+    if (ratio == 1)
+        return;
+    double* volumes = columns.values[3].data();
+    for (size_t i = 0, n = columns.size(); i != n; ++i)
+        volumes[i] *= ratio;
+}
+
+
+void solve_batch_decimal(BatchColumns& columns, long target, unsigned char* seen_codes, double volume_ratio)
+{
+    // The volumes as typed are kept, so the ratio is applied to them in decimal rather than to a rounded product
+    const size_t n = columns.size();
+    std::vector<double> typed_volumes;
+    if (volume_ratio != 1)
+        typed_volumes.assign(columns.values[3].begin(), columns.values[3].begin() + n);
+    scale_volumes(columns, volume_ratio);
+    solve_batch(columns, target, seen_codes);
+    scale_volumes(columns, 1/volume_ratio);
+    INSTRUMENT_SCOPE("solve_batch_decimal");
+    const Decimal ratio = decimal_from_double(volume_ratio, DECIMAL_DOUBLE_DIGITS);
+
+    // Each solved line is worked out again from its inputs as decimals, with the relation solve_batch recorded in its diagnostic code
+    for (size_t i = 0; i != n; ++i)
+    {
+        const MolesSource source = (MolesSource)((columns.diagnostics[i] >> DIAGNOSTIC_SOURCE_SHIFT) & 3);
+        if (source == no_source)
+            continue;
+        // Only the rows typed in are recovered: not the target, nor moles solve_batch wrote as an intermediate
+        Decimal values[ROWS], moles;
+        const unsigned char inputs = columns.validity[i].valid & ~(1 << target) & ((source == from_moles) ? RowEnum::all : ~RowEnum::moles);
+        for (int r = 0; r != ROWS; ++r)
+        {
+            const int figures = columns.sig_figs[r][i] ? columns.sig_figs[r][i] : DECIMAL_DOUBLE_DIGITS;
+            const double typed = (r == 3 && volume_ratio != 1) ? typed_volumes[i] : columns.values[r][i];
+            values[r] = (inputs & (1 << r)) ? decimal_from_double(typed, figures) : Decimal{0, 0, false, true};
+        }
+        if (volume_ratio != 1 && (inputs & RowEnum::volume))
+            values[3] = decimal_multiply(values[3], ratio);
+        Decimal result = solve_decimal(target, source, values, moles);
+        if (target == 3 && volume_ratio != 1)
+            result = decimal_divide(result, ratio);
+        if (result.nan || !std::isfinite(decimal_to_double(result)))
+        {
+            columns.validity[i].valid &= ~(1 << target);
+            columns.diagnostics[i] = diagnose_undefined(columns.validity[i]);
+            if (seen_codes)
+                seen_codes[columns.diagnostics[i]] = 1;
+            continue;
+        }
+
+        const int figures = columns.sig_figs[target][i];
+        columns.values[target][i] = decimal_to_double(figures ? decimal_round(result, figures) : result);
+        if (source != from_moles && target != 2)
+        {
+            const int moles_figures = columns.sig_figs[2][i];
+            columns.values[2][i] = decimal_to_double(moles_figures ? decimal_round(moles, moles_figures) : moles);
+        }
+    }
+}
+
+
+void format_batch_value(char* text, size_t size, const BatchColumns& columns, int r, size_t i)
+{
+    if (!(columns.validity[i].valid & (1 << r)))
+        text[0] = '\0';
+    else if (columns.sig_figs[r][i])
+        format_sig_figs(text, size, columns.values[r][i], columns.sig_figs[r][i]);
+    else
+        snprintf(text, size, "%.15g", columns.values[r][i]);
+}
+
+
+void format_batch_line(const BatchColumns& columns, size_t i, std::string& text)
+{
+    char value[64];
+    for (int r = 0; r != ROWS; ++r)
+    {
+        format_batch_value(value, sizeof value, columns, r, i);
+        text += value;
+        text += ',';
+    }
+    for (size_t f = 0; f != columns.trailing_columns; ++f)
+    {
+        columns.append_trailing(i, f, text, true);
+        text += ',';
+    }
+    snprintf(value, sizeof value, "%u\n", (unsigned)columns.diagnostics[i]);
+    text += value;
+}
+
+
+void format_batch(const BatchColumns& columns, std::string& text, std::vector<size_t>* ends)
+{
+    INSTRUMENT_SCOPE("format_batch");
+    const size_t n = columns.size();
+    std::vector<std::string> chunks((n + FORMAT_CHUNK - 1)/FORMAT_CHUNK);
+    std::vector<size_t> chunk_ends(ends ? n : 0);
+    parallel_for(chunks.size(), [&](size_t chunk) {
+        const size_t end = std::min((chunk + 1)*FORMAT_CHUNK, n);
+        for (size_t i = chunk*FORMAT_CHUNK; i != end; ++i)
+        {
+            format_batch_line(columns, i, chunks[chunk]);
+            if (ends)
+                chunk_ends[i] = chunks[chunk].size();
+        }
+    });
+    for (size_t chunk = 0; chunk != chunks.size(); ++chunk)
+    {
+        if (ends)
+            for (size_t i = chunk*FORMAT_CHUNK; i != std::min((chunk + 1)*FORMAT_CHUNK, n); ++i)
+                ends->push_back(text.size() + chunk_ends[i]);
+        text += chunks[chunk];
+    }
+}
+
+
+void write_batch(FILE* out, const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("write_batch");
+    std::string text;
+    format_batch(columns, text);
+    fwrite(text.data(), 1, text.size(), out);
+}
+
+
+bool write_diagnostics(const char* path, const unsigned char* seen_codes, long target)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return(false);
+    for (unsigned code = 0; code != DIAGNOSTIC_CODES; ++code)
+        if (seen_codes[code])
+            fprintf(out, "%u\t%s\n", code, describe_diagnostic(code, target).c_str());
+    return(fclose(out) == 0);
+}
+
+
+bool write_unmatched(const char* path, const ReagentDictionary& reagents)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return(false);
+    fprintf(out, "key,lines\n");
+    for (size_t k = 0; k != reagents.resolved; ++k)
+        if (!(reagents.molar_masses[k] > 0))
+            fprintf(out, "%s,%llu\n", reagents.keys[k]->c_str(), (unsigned long long)reagents.lines[k]);
+    return(fclose(out) == 0);
+}
+
+
+// Returns true if path ends in extension
+static bool has_extension(const char* path, const char* extension)
+{
+    const size_t length = strlen(path), extension_length = strlen(extension);
+    return(length >= extension_length && strcmp(path + length - extension_length, extension) == 0);
+}
+
+
+// Finds the fields of key from columns, names of header columns separated by commas, and stores the names found in names. Prints an error and returns false if a name is not in header.
+static bool find_key_fields(const std::string& header, const char* columns, BatchKey& key, std::string& names)
+{
+    for (const char* name = columns; *name; name += strcspn(name, ",") + (name[strcspn(name, ",")] == ','))
+    {
+        const size_t start = strspn(name, " \t");
+        size_t end = strcspn(name, ",");
+        while (end > start && strchr(" \t", name[end - 1]))
+            --end;
+        names.append(names.empty() ? "" : ",").append(name + start, end - start);
+        key.fields.push_back(find_batch_field(header, std::string(name + start, end - start)));
+        if (key.fields.back() < 0)
+        {
+            fprintf(stderr, "No column named %.*s\n", (int)(end - start), name + start);
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+int batch_main(int argc, char** argv)
+{
+    const char* input_path = nullptr;
+    const char* output_path = nullptr;
+    const char* diagnostics_path = nullptr;
+    const char* telemetry_path = nullptr;
+    const char* report_path = nullptr;
+    const char* plates_path = nullptr;
+    const char* plate_value = nullptr;
+    int plate_wells = 96;
+    const char* catalog_path = nullptr;
+    const char* unmatched_path = nullptr;
+    const char* totals_path = nullptr;
+    const char* group_by = nullptr;
+    const char* sort_by = nullptr;
+    size_t sort_memory = SORT_MEMORY;
+    const char* partition_by = nullptr;
+    const char* mixture = nullptr;
+    double cosolvent_fraction = 0;
+    bool decimal = false;
+    bool usage = (argc < 3);
+    for (int a = 3; a < argc && !usage; ++a)
+    {
+        if (strcmp(argv[a], "--input") == 0 && a + 1 < argc)
+            input_path = argv[++a];
+        else if (strcmp(argv[a], "--output") == 0 && a + 1 < argc)
+            output_path = argv[++a];
+        else if (strcmp(argv[a], "--diagnostics") == 0 && a + 1 < argc)
+            diagnostics_path = argv[++a];
+        else if (strcmp(argv[a], "--telemetry") == 0 && a + 1 < argc)
+            telemetry_path = argv[++a];
+        else if (strcmp(argv[a], "--report") == 0 && a + 1 < argc)
+            report_path = argv[++a];
+        else if (strcmp(argv[a], "--plates") == 0 && a + 1 < argc)
+            plates_path = argv[++a];
+        else if (strcmp(argv[a], "--plate-wells") == 0 && a + 1 < argc)
+            plate_wells = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--plate-value") == 0 && a + 1 < argc)
+            plate_value = argv[++a];
+        else if (strcmp(argv[a], "--mixture") == 0 && a + 2 < argc)
+        {
+            mixture = argv[++a];
+            cosolvent_fraction = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--catalog") == 0 && a + 1 < argc)
+            catalog_path = argv[++a];
+        else if (strcmp(argv[a], "--unmatched") == 0 && a + 1 < argc)
+            unmatched_path = argv[++a];
+        else if (strcmp(argv[a], "--totals") == 0 && a + 1 < argc)
+            totals_path = argv[++a];
+        else if (strcmp(argv[a], "--group-by") == 0 && a + 1 < argc)
+            group_by = argv[++a];
+        else if (strcmp(argv[a], "--sort-by") == 0 && a + 1 < argc)
+            sort_by = argv[++a];
+        else if (strcmp(argv[a], "--sort-memory") == 0 && a + 1 < argc)
+            sort_memory = strtoul(argv[++a], nullptr, 10);
+        else if (strcmp(argv[a], "--partition-by") == 0 && a + 1 < argc)
+            partition_by = argv[++a];
+        else if (strcmp(argv[a], "--timing") == 0)
+            telemetry_timing = true;
+        else if (strcmp(argv[a], "--decimal") == 0)
+            decimal = true;
+        else
+            usage = true;
+    }
+    usage |= (!totals_path != !group_by);
+    usage |= (sort_memory == 0 || (sort_by && partition_by));
+    if (usage)
+    {
+        fprintf(stderr, "Usage: %s --batch <row> [--input <file>] [--output <file>] [--diagnostics <file>] [--telemetry <file>] [--timing] [--report <file>]"
+                " [--plates <file.svg|file.png> [--plate-wells <96|384|1536>] [--plate-value <row>]] [--mixture <name> <cosolvent fraction>]"
+                " [--catalog <file> [--unmatched <file>]] [--totals <file> --group-by <columns>]"
+                " [--sort-by <columns> [--sort-memory <MiB>] | --partition-by <columns>] [--decimal]\n", argv[0]);
+        return(2);
+    }
+    long target = find_row(argv[2]);
+    if (target == ROWS)
+    {
+        fprintf(stderr, "Unknown row: %s\n", argv[2]);
+        return(1);
+    }
+    PlateFormat plate;
+    if (!plate_format(plate_wells, plate))
+    {
+        fprintf(stderr, "Plates must have 96, 384 or 1536 wells\n");
+        return(1);
+    }
+    long plate_row = plate_value ? find_row(plate_value) : target;
+    if (plate_row == ROWS)
+    {
+        fprintf(stderr, "Unknown row: %s\n", plate_value);
+        return(1);
+    }
+    if (plates_path && !has_extension(plates_path, ".svg") && !has_extension(plates_path, ".png"))
+    {
+        fprintf(stderr, "Plate map file names must end in .svg or .png: %s\n", plates_path);
+        return(1);
+    }
+
+    MixingGrid mixing;
+    if (mixture && !mixing.load(mixture))
+    {
+        fprintf(stderr, "Unknown mixture: %s. Known mixtures are:\n", mixture);
+        list_mixtures();
+        return(1);
+    }
+    if (mixture && !(cosolvent_fraction >= 0 && cosolvent_fraction <= 1))
+    {
+        fprintf(stderr, "The cosolvent fraction must be from 0 to 1\n");
+        return(1);
+    }
+    const double volume_ratio = mixture ? mixing.volume_ratio(cosolvent_fraction) : 1;
+
+    Catalog catalog;
+    std::string catalog_error;
+    if (catalog_path && !catalog.read(catalog_path, catalog_error))
+    {
+        fprintf(stderr, "Cannot read catalog %s: %s\n", catalog_path, catalog_error.c_str());
+        return(1);
+    }
+
+    // Workbooks are read and written by name, and output files ending in .gz or .zst are compressed. Other files and the standard streams hold CSV, which is decompressed when it starts like a gzip or Zstandard file.
+    XlsxReader xlsx_in;
+    XlsxWriter xlsx_out;
+    std::unique_ptr<CompressedReader> compressed_in;
+    std::unique_ptr<GzipWriter> gzip_out;
+    std::unique_ptr<ZstdWriter> zstd_out;
+    const bool xlsx_input = input_path && has_extension(input_path, ".xlsx");
+    const bool xlsx_output = output_path && has_extension(output_path, ".xlsx");
+    if (sort_by && xlsx_output)
+    {
+        fprintf(stderr, "Sorted output is written as CSV; choose a file name not ending in .xlsx\n");
+        return(1);
+    }
+    if (partition_by && (!output_path || xlsx_output || has_extension(output_path, ".gz") || has_extension(output_path, ".zst")))
+    {
+        fprintf(stderr, "Partitioned output needs an --output file name for CSV files, not ending in .xlsx, .gz or .zst\n");
+        return(1);
+    }
+    FILE* in = (input_path && !xlsx_input) ? fopen(input_path, "rb") : stdin;
+    FILE* out = (output_path && !xlsx_output && !partition_by) ? fopen(output_path, "wb") : stdout;
+    if (xlsx_input ? !xlsx_in.open(input_path) : !in)
+    {
+        fprintf(stderr, "Cannot read %s\n", input_path);
+        return(1);
+    }
+    if (!xlsx_input && is_gzip(in))
+        compressed_in.reset(new GzipReader(in));
+    else if (!xlsx_input && is_zstd(in))
+        compressed_in.reset(new ZstdReader(in));
+    if (out && output_path && has_extension(output_path, ".gz"))
+        gzip_out.reset(new GzipWriter(out));
+    else if (out && output_path && has_extension(output_path, ".zst"))
+        zstd_out.reset(new ZstdWriter(out));
+
+    auto read_block = [&](BatchColumns& columns) {
+        return(xlsx_input ? xlsx_in.read(columns, BATCH_BLOCK) : compressed_in ? read_batch(*compressed_in, columns, BATCH_BLOCK) : read_batch(in, columns, BATCH_BLOCK));
+    };
+    auto write_text = [&](const std::string& text) {
+        if (gzip_out)
+            gzip_out->write(text);
+        else if (zstd_out)
+            zstd_out->write(text);
+        else
+            fwrite(text.data(), 1, text.size(), out);
+    };
+
+    std::string header;
+    if (xlsx_input)
+        xlsx_in.header(header);
+    else if (compressed_in)
+        read_record([&](char* line, int size) { return(compressed_in->gets(line, size)); }, header);
+    else
+        read_record([in](char* line, int size) { return(fgets(line, size, in)); }, header);
+
+    // Lines are written with as many fields after the calculator rows as the header has, however many they were read with
+    BatchColumns columns;
+    columns.trailing_columns = std::max<size_t>(split_csv_line(header).size(), ROWS) - ROWS;
+    if (!header.empty())
+        header += ",diagnostic";
+    columns.reagents.catalog = catalog_path ? &catalog : nullptr;
+
+    // Key columns are found by their names in the header
+    std::unique_ptr<BatchTotals> totals;
+    if (totals_path)
+    {
+        BatchKey key;
+        std::string names;
+        if (!find_key_fields(header, group_by, key, names))
+            return(1);
+        totals.reset(new BatchTotals(totals_path, names, columns.keys.size()));
+        columns.keys.push_back(key);
+    }
+    std::unique_ptr<BatchSorter> sorter;
+    if (sort_by)
+    {
+        BatchKey key;
+        std::string names;
+        if (!find_key_fields(header, sort_by, key, names))
+            return(1);
+        sorter.reset(new BatchSorter(columns.keys.size(), sort_memory));
+        columns.keys.push_back(key);
+    }
+    std::unique_ptr<PartitionWriter> partitions;
+    if (partition_by)
+    {
+        BatchKey key;
+        std::string names;
+        if (!find_key_fields(header, partition_by, key, names))
+            return(1);
+        partitions.reset(new PartitionWriter(output_path, header, columns.keys.size()));
+        columns.keys.push_back(key);
+    }
+    if (xlsx_output ? !xlsx_out.open(output_path, header) : !out)
+    {
+        fprintf(stderr, "Cannot write %s\n", output_path);
+        return(1);
+    }
+    if (!xlsx_output && !partitions && !header.empty())
+        write_text(header + "\n");
+
+    FILE* report_file = nullptr;
+    std::unique_ptr<BatchReport> report;
+    if (report_path)
+    {
+        report_file = fopen(report_path, "wb");
+        if (!report_file)
+        {
+            fprintf(stderr, "Cannot write %s\n", report_path);
+            return(1);
+        }
+        report.reset(new BatchReport(report_file, target));
+    }
+    std::unique_ptr<PlateMapWriter> plates;
+    if (plates_path)
+        plates.reset(new PlateMapWriter(plates_path, plate, plate_row));
+
+    std::vector<unsigned char> seen_codes(DIAGNOSTIC_CODES);
+    std::string text;
+
+    while (read_block(columns))
+    {
+        if (decimal)
+            solve_batch_decimal(columns, target, seen_codes.data(), volume_ratio);
+        else
+        {
+            scale_volumes(columns, volume_ratio);
+            solve_batch(columns, target, seen_codes.data());
+            scale_volumes(columns, 1/volume_ratio);
+        }
+        if (sorter)
+            sorter->add(columns);
+        else if (partitions)
+            partitions->add(columns);
+        else if (xlsx_output)
+            xlsx_out.write(columns);
+        else
+        {
+            text.clear();
+            format_batch(columns, text);
+            write_text(text);
+        }
+        if (report)
+            report->add(columns);
+        if (plates)
+            plates->add(columns);
+        if (totals)
+            totals->add(columns);
+    }
+
+    if (xlsx_input ? xlsx_in.failed() : ((compressed_in && compressed_in->failed()) || ferror(in) != 0))
+    {
+        fprintf(stderr, "Cannot read %s\n", input_path ? input_path : "standard input");
+        return(1);
+    }
+    if (partitions && !partitions->finish(columns))
+    {
+        fprintf(stderr, "Cannot write partition files %s\n", output_path);
+        return(1);
+    }
+    if (sorter && !sorter->finish(write_text))
+    {
+        fprintf(stderr, "Cannot sort the output: temporary files cannot be written\n");
+        return(1);
+    }
+    if (xlsx_output ? !xlsx_out.finish() : ((gzip_out && !gzip_out->finish()) || (zstd_out && !zstd_out->finish()) || (out != stdout && fclose(out) != 0)))
+    {
+        fprintf(stderr, "Cannot write %s\n", output_path);
+        return(1);
+    }
+    
+    if (report)
+    {
+        bool written = report->finish(seen_codes.data());
+        if (fclose(report_file) != 0 || !written)
+        {
+            fprintf(stderr, "Cannot write %s\n", report_path);
+            return(1);
+        }
+    }
+    if (plates && !plates->finish())
+    {
+        fprintf(stderr, "Cannot write plate maps %s\n", plates_path);
+        return(1);
+    }
+    
+    if (totals && !totals->finish(columns))
+    {
+        fprintf(stderr, "Cannot write %s\n", totals_path);
+        return(1);
+    }
+    if (unmatched_path && !write_unmatched(unmatched_path, columns.reagents))
+    {
+        fprintf(stderr, "Cannot write %s\n", unmatched_path);
+        return(1);
+    }
+    if (diagnostics_path && !write_diagnostics(diagnostics_path, seen_codes.data(), target))
+    {
+        fprintf(stderr, "Cannot write %s\n", diagnostics_path);
+        return(1);
+    }
+    if (telemetry_path && !write_telemetry(telemetry_path))
+    {
+        fprintf(stderr, "Cannot write %s\n", telemetry_path);
+        return(1);
+    }
+    return(0);
+}
+
+
+int benchmark_main(int argc, char** argv)
+{
+    const size_t lines = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 1000000;
+    const int repeats = (argc > 3) ? atoi(argv[3]) : 20;
+    if (!lines || repeats < 1)
+    {
+        fprintf(stderr, "Usage: %s --benchmark [lines] [repeats]\n", argv[0]);
+        return(2);
+    }
+
+    // Lines with random values and a random mix of empty rows, the same on every run
+    BatchColumns columns;
+    columns.resize(lines);
+    unsigned long long state = 88172645463325252ull;
+    for (size_t i = 0; i != lines; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        for (int r = 0; r != ROWS; ++r)
+        {
+            columns.values[r][i] = 0.001 + ((state >> (8*r)) & 0xff);
+            columns.sig_figs[r][i] = 3;
+        }
+        columns.validity[i] = Validity{(unsigned char)((state >> 40) & RowEnum::all), 0};
+    }
+
+    // Returns the best time per line of solve on every target. Solving replaces the target and leaves unsolved lines without it, so each repeat solves a fresh copy of the generated lines, made before the clock starts.
+    auto time_solve = [&](long target, void (*solve)(BatchColumns&, long, unsigned char*)) {
+        double best = 0;
+        BatchColumns copy;
+        for (int repeat = 0; repeat != repeats; ++repeat)
+        {
+            copy = columns;
+            auto start = std::chrono::steady_clock::now();
+            solve(copy, target, nullptr);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()/lines;
+            best = (repeat == 0 || ns < best) ? ns : best;
+        }
+        return(best);
+    };
+
+    printf("%-10s %12s %12s\n", "Target", "ns/line", "decimal");
+    for (long target = 0; target != ROWS; ++target)
+    {
+        const double binary = time_solve(target, solve_batch);
+        printf("%-10s %12.2f %12.2f\n", row_header[target], binary, time_solve(target, [](BatchColumns& columns, long target, unsigned char* seen_codes) { solve_batch_decimal(columns, target, seen_codes); }));
+    }
+    return(0);
+}
@@ -0,0 +1,154 @@
+// Batch mode: solving many lines of comma separated values at once from the command line.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "calculator.h"
+
+class CompressedReader;
+struct Catalog;
+
+// Constants: number of lines read, solved and written at a time
+#define BATCH_BLOCK 65536
+
+// Constants: reagent code of a line whose molar mass is a number or empty rather than a formula
+#define NO_REAGENT UINT32_MAX
+
+// Constants: decimal places of molar masses worked out from formulas, as tables of standard atomic weights give them
+#define FORMULA_DECIMALS 2
+
+
+// The distinct texts read in a column, each stored once however many lines repeat it. Entries are numbered in the order they are first read and kept from block to block.
+struct TextDictionary {
+    std::unordered_map<std::string, uint32_t> codes;
+    std::vector<const std::string*> keys;       // By code, the keys of codes
+
+    size_t size() const { return(keys.size()); }
+
+    // Returns the code of text, ignoring surrounding blanks, and adds it if it is new.
+    uint32_t encode(const char* text);
+};
+
+// The distinct formulas or catalog IDs typed as molar masses in a batch, each looked up once however many lines repeat it.
+struct ReagentDictionary: TextDictionary {
+    std::vector<double> molar_masses;           // By code, g/mol of the compound as weighed out, 0 if it is unknown
+    std::vector<unsigned char> sig_figs;
+    std::vector<uint64_t> lines;                // By code, lines read with the entry
+    size_t resolved = 0;                        // Entries whose molar mass has been worked out
+    const Catalog* catalog = nullptr;           // Searched before keys are read as formulas, if given
+
+    // Works out the molar mass of every entry added since the last call: from the catalog line with its ID, divided by the purity, or else from its formula. New entries are joined to the catalog in parallel.
+    void resolve();
+};
+
+// A key of batch lines made of the text of some of their fields, such as a project or a plate and well, for grouping them.
+struct BatchKey {
+    std::vector<int> fields;                    // Counted from 0; their text is joined by commas
+    TextDictionary dictionary;
+    std::vector<uint32_t> codes;                // By line, code of the key in dictionary
+};
+
+
+// A block of batch lines held as columns: one array per row of the calculator in base units, with the significant figures and validity of each line alongside. Empty and invalid fields hold 0.
+struct BatchColumns {
+    std::vector<double> values[ROWS];
+    std::vector<unsigned char> sig_figs[ROWS];
+    std::vector<Validity> validity;
+    std::vector<Diagnostic> diagnostics; // Set by solve_batch
+    std::vector<uint32_t> reagent_codes; // Code in reagents of a molar mass typed as a formula, or NO_REAGENT
+    ReagentDictionary reagents;
+    std::vector<BatchKey> keys;          // Read along with the values of each line
+    std::string trailing;                // Text of the fields after the calculator rows of every line, as read, end to end
+    std::vector<size_t> trailing_fields; // By field, where its text ends in trailing; it starts where the field before ends
+    std::vector<size_t> trailing_ends;   // By line, where its fields end in trailing_fields; they start where the line before ends
+    size_t trailing_columns = 0;         // Fields after the calculator rows in the header; every line is written with this many before its diagnostic code
+
+    // Returns the number of fields to split each line into: the calculator rows, and every key field.
+    size_t field_count() const;
+
+    // Appends field f after the calculator rows of line i to text, or nothing if the line has fewer fields. With quoted set, it is quoted as a CSV field if it needs to be.
+    void append_trailing(size_t i, size_t f, std::string& text, bool quoted = false) const;
+
+    // Empties the fields after the calculator rows of every line.
+    void clear_trailing();
+
+    size_t size() const { return(validity.size()); }
+    void resize(size_t n);
+};
+
+
+// Parses field as row r of line i of columns, the way read_batch does, and marks it valid or invalid in validity. A molar mass that is not a number, or a number that is the ID of a line of the catalog of columns.reagents, is encoded as a reagent, and left for decode_reagents.
+void parse_batch_field(BatchColumns& columns, int r, size_t i, const char* field, Validity& validity);
+
+// Encodes every key of line i of columns from fields, the text of its field_count() fields.
+void encode_batch_keys(BatchColumns& columns, size_t i, const char* const* fields);
+
+// Splits the first field off line, a line of comma separated values, in place. The field's text is left at line, with its length in length and without the quotes of a field quoted as RFC 4180 does. Returns the next field, or nullptr after the last one.
+char* split_csv_field(char* line, size_t& length);
+
+// Returns the fields of line, a line of comma separated values, unquoted.
+std::vector<std::string> split_csv_line(const std::string& line);
+
+// Appends length bytes of field to text as a CSV field, in quotes if it holds a comma, a quote or a line break, with its quotes doubled.
+void append_csv_field(std::string& text, const char* field, size_t length);
+
+// Returns the number, counted from 0, of the field named name in header, a line of comma separated names, or -1 if there is none. Names are compared ignoring blanks around them.
+int find_batch_field(const std::string& header, const std::string& name);
+
+// Resolves the reagents added to columns since the last call and fills in the molar mass, significant figures and validity of every line typed with a formula or catalog ID from them. Called by the readers at the end of each block.
+void decode_reagents(BatchColumns& columns);
+
+// Writes a line "<key>,<lines>" for every reagent that is neither in the catalog nor a formula, with the number of lines giving it, to path. Returns false if the file cannot be written.
+bool write_unmatched(const char* path, const ReagentDictionary& reagents);
+
+// Reads up to max_lines lines of "mass,molar mass,moles,volume,molarity" from in, a plain file or a gzip or Zstandard reader, into columns. The molar mass may be a formula such as "NaCl". Returns the number of lines read, which is less than max_lines only at the end of the input.
+size_t read_batch(FILE* in, BatchColumns& columns, size_t max_lines);
+size_t read_batch(CompressedReader& in, BatchColumns& columns, size_t max_lines);
+
+// Calculates target on every line of columns, the way the calculator window does when Calculate is clicked on that row. A typed target is replaced; lines that cannot be solved are left with target empty. The window's clearing of rows that no longer agree is not done, so inputs are never lost. The diagnostic code of each line is stored in columns, and every code seen is marked in seen_codes if given (DIAGNOSTIC_CODES entries).
+void solve_batch(BatchColumns& columns, long target, unsigned char* seen_codes = nullptr);
+
+// Calculates target on every line of columns as solve_batch does, then works each solved line out again in exact decimal arithmetic from the typed values, so results are rounded to their significant figures from the exact decimal result rather than from a binary approximation of it. Volumes are multiplied by volume_ratio, as --mixture does, for the calculation only, and in decimal on the solved lines.
+void solve_batch_decimal(BatchColumns& columns, long target, unsigned char* seen_codes = nullptr, double volume_ratio = 1);
+
+// Writes the value of row r on line i of columns into text as write_batch does: rounded to its significant figures, or empty if the field is not valid.
+void format_batch_value(char* text, size_t size, const BatchColumns& columns, int r, size_t i);
+
+// Appends line i of columns to text in the format of write_batch, with its newline. Trailing fields are quoted as RFC 4180 requires, so a quoted field may hold a newline.
+void format_batch_line(const BatchColumns& columns, size_t i, std::string& text);
+
+// Appends columns to text in the format of write_batch. Lines are formatted in parallel. If ends is given, the offset in text just past each line is appended to it.
+void format_batch(const BatchColumns& columns, std::string& text, std::vector<size_t>* ends = nullptr);
+
+// Writes columns to out in the format read by read_batch, followed by the diagnostic code of each line. Values are rounded to their significant figures, and invalid fields are written empty.
+void write_batch(FILE* out, const BatchColumns& columns);
+
+// Writes a line "<code>\t<text>" for every code marked in seen_codes to path. Returns false if the file cannot be written.
+bool write_diagnostics(const char* path, const unsigned char* seen_codes, long target);
+
+// Command line mode: "--batch <row> [options]" reads lines from standard input, calculates row on each and writes them to standard output with a diagnostic column. The first line is a header and is copied with the diagnostic column added.
+// Fields after the five of each line are copied before its diagnostic code, as many as the header has, so the code is always in the diagnostic column.
+// The molar mass of a line may be a formula, or a catalog ID, and is written back as the molar mass worked out from it.
+// --input <file>, --output <file>: read and write files instead. Names ending in .xlsx are Excel workbooks (the first worksheet is read); gzip and Zstandard input is recognised by its first byte, and output names ending in .gz or .zst are compressed.
+// --diagnostics <file>: explains the diagnostic codes that occurred.
+// --telemetry <file> [--timing]: counts the solver paths taken, and times them.
+// --report <file>: writes a printable PDF report of the results.
+// --plates <file> [--plate-wells <n>] [--plate-value <row>]: fills microplates of 96, 384 or 1536 wells with consecutive lines and draws each as an SVG or PNG map coloured by the value row, named with the plate number before the extension.
+// --mixture <name> <fraction>: volumes are of water and cosolvent (volume fraction fraction) before mixing; molarities are in the smaller volume they make together.
+// --catalog <file> [--unmatched <file>]: looks every molar mass up as a catalog ID first, so a number is a molar mass only if it is not an ID. IDs and formulas that match neither are listed in the unmatched file.
+// --totals <file> --group-by <columns>: totals mass, moles and volume for each value of the header columns given, separated by commas.
+// --sort-by <columns> [--sort-memory <MiB>]: writes lines in natural order of the columns, sorting on disk beyond the memory given (256 MiB by default).
+// --partition-by <columns>: writes one output file for each value of the columns, named like the output file with the value before the extension.
+// --decimal: calculates in exact decimal arithmetic.
+int batch_main(int argc, char** argv);
+
+// Command line mode: "--benchmark [lines] [repeats]" times solve_batch and solve_batch_decimal for every target on generated lines and prints the best time per line of each. Comparing builds with and without MOLARITY_INSTRUMENT shows what instrumentation costs.
+int benchmark_main(int argc, char** argv);
+
+
+#endif /* BATCH_H */
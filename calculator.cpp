@@ -0,0 +1,433 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include "calculator.h"
+
+
+const char* const row_header[ROWS] = {
+            "Mass","Molar mass","Moles","Volume", "Molarity"
+        };
+
+
+// Constants: built-in units, represented as a vector of lists. Each list in the vector corresponds to units for each measures from row_header, the first entry being the default unit. The first item of each pair is the C string for units used as labels, and the second is the factor used by the get_value and set_value functions of the Calculator class. These are compiled together with the user's units file into a UnitTable (see below).
+const static std::vector<std::vector<std::pair<const char*, double>>> units_vector
+{
+    { // Mass map
+
+        {
+            "milligrams", 0.001
+        },
+        {
+            "micrograms", 0.000001
+        },
+        {
+            "nanograms", 0.000000001
+        },
+        {
+            "grams", 1
+        },
+        {
+            "kilograms", 1000
+        }
+
+    },
+    { // molar_mass map
+
+        {
+            "/g/mol", 1
+        },
+        {
+            "/mg/mol", 0.001
+        },
+        {
+            "/g/mmol", 1000
+        }
+
+    },
+    { // moles map
+
+        {
+            "mol", 1
+        },
+        {
+            "mmol", 0.001
+        },
+        {
+            "umol", 0.000001
+        }
+
+    },
+    { // Volume map
+
+        {
+            "mL", 0.001
+        },
+        {
+            "uL", 0.000001
+        },
+        {
+            "nL", 0.000000001
+        },
+        {
+            "L", 1
+        }
+
+
+    },
+    { // Concentration map
+        {
+            "mM", 1e-3
+        },
+        {
+            "uM", 1e-6
+        },
+        {
+            "nM", 1e-9
+        },
+        {
+            "pM", 1e-12
+        },
+        {
+            "M", 1
+        },
+    }
+};
+
+
+// Fills best_unit from units. Must be called after the units are final.
+void UnitTable::compile_best_units()
+{
+    for (long p = 0; p != ROWS; ++p)
+    {
+        for (int e = 0; e != SCALE_EXP_COUNT; ++e)
+        {
+            double low = std::ldexp(1.0, e + SCALE_EXP_MIN); // Smallest value with this exponent
+            int best = -1, smallest = 0, next = -1;
+            for (unsigned id = 0; id != units[p].size(); ++id)
+            {
+                double factor = units[p][id].factor;
+                double decade = std::log10(factor);
+                if (std::fabs(decade - std::round(decade)) > 1e-9)
+                    continue;
+                if (factor < units[p][smallest].factor)
+                    smallest = id;
+                if (factor <= low && (best < 0 || factor > units[p][best].factor))
+                    best = id;
+                // A factor above low but below the next exponent's range takes over from it
+                if (factor > low && factor < 2*low && (next < 0 || factor < units[p][next].factor))
+                    next = id;
+            }
+            best_unit[p][e][0] = (best < 0) ? smallest : best;
+            best_unit[p][e][1] = (next < 0) ? best_unit[p][e][0] : next;
+            best_threshold[p][e] = (next < 0) ? HUGE_VAL : units[p][next].factor;
+        }
+    }
+}
+
+
+// Returns the ID of the unit with the given label in row p, or -1 if there is none.
+int find_unit(const UnitTable& table, long p, const char* label)
+{
+    const std::vector<Unit>& units = table[p];
+    for (unsigned id = 0; id != units.size(); ++id)
+        if (units[id].label == label)
+            return(id);
+    return(-1);
+}
+
+
+// Returns the row whose header is name, or ROWS if there is none.
+long find_row(const char* name)
+{
+    long p = 0;
+    while (p != ROWS && strcmp(name, row_header[p]) != 0)
+        ++p;
+    return(p);
+}
+
+
+// Compiles the built-in units_vector and the units file (if readable) into a new UnitTable. Malformed lines in the file are skipped.
+std::shared_ptr<const UnitTable> load_unit_table(const char* path)
+{
+    auto table = std::make_shared<UnitTable>();
+    for (long p = 0; p != ROWS; ++p)
+        for (auto& elem: units_vector[p])
+            (*table)[p].push_back(Unit{elem.first, elem.second});
+
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::vector<std::string> fields;
+        std::istringstream line_stream(line);
+        std::string field;
+        while (std::getline(line_stream, field, ';'))
+        {
+            auto first = field.find_first_not_of(" \t\r");
+            auto last = field.find_last_not_of(" \t\r");
+            fields.push_back(first == std::string::npos ? "" : field.substr(first, last - first + 1));
+        }
+        if (fields.size() != 3 || fields[1].empty())
+            continue;
+
+        long p = find_row(fields[0].c_str());
+        char* end = nullptr;
+        double factor = strtod(fields[2].c_str(), &end);
+        if (p == ROWS || *end != '\0' || !(factor > 0))
+            continue;
+
+        int id = find_unit(*table, p, fields[1].c_str());
+        if (id < 0)
+            (*table)[p].push_back(Unit{fields[1], factor});
+        else
+            (*table)[p][id].factor = factor;
+    }
+    table->compile_best_units();
+    return(table);
+}
+
+
+// The live unit table. It is only read through current_units() and replaced as a whole by reload_units(), so readers holding a snapshot are never affected by a reload.
+static std::shared_ptr<const UnitTable> live_units;
+
+std::shared_ptr<const UnitTable> current_units()
+{
+    return(std::atomic_load(&live_units));
+}
+
+void reload_units()
+{
+    std::atomic_store(&live_units, load_unit_table(UNITS_FILE));
+}
+
+
+// Returns the modification time of the units file, or 0 if it does not exist.
+time_t units_file_mtime()
+{
+    struct stat info;
+    if (stat(UNITS_FILE, &info) != 0)
+        return(0);
+    return(info.st_mtime);
+}
+
+
+// Returns the number of significant figures in a typed number, e.g. 3 for "0.0250", 2 for "1200" and 4 for "1200.". The exponent of "2.5e-3" does not count. Returns 0 if text has no digits.
+int count_sig_figs(const char* text)
+{
+    int figures = 0, trailing_zeros = 0;
+    bool started = false, point = false;
+    for (const char* c = text; *c && *c != 'e' && *c != 'E'; ++c)
+    {
+        if (*c == '.')
+            point = true;
+        else if (*c == '0')
+        {
+            if (started)
+            {
+                ++figures;
+                ++trailing_zeros;
+            }
+        }
+        else if (*c >= '1' && *c <= '9')
+        {
+            started = true;
+            ++figures;
+            trailing_zeros = 0;
+        }
+    }
+    if (!started)
+        return(text[strspn(text, " +-.")] == '0' ? 1 : 0); // A typed zero has one figure
+    return(point ? figures : figures - trailing_zeros);
+}
+
+
+// Writes value rounded to sig_figs significant figures into text. Trailing zeros are kept because they are significant, and whole numbers such as 1200 are not switched to exponent notation.
+void format_sig_figs(char* text, size_t size, double value, int sig_figs)
+{
+    int exponent = (value == 0 || !std::isfinite(value)) ? 0 : (int)std::floor(std::log10(std::fabs(value)));
+    if (exponent >= sig_figs && exponent < 15)
+    {
+        double scale = std::pow(10.0, exponent - sig_figs + 1);
+        snprintf(text, size, "%.0f", std::round(value/scale)*scale);
+    }
+    else
+        snprintf(text, size, "%#.*g", sig_figs, value);
+    
+    // A point ending the digits, as in "1.e-06", only matters after significant zeros, as in "120."
+    size_t length = strcspn(text, "e");
+    if (length > 1 && text[length - 1] == '.' && (text[length - 2] != '0' || value == 0))
+        memmove(text + length - 1, text + length, strlen(text + length) + 1);
+}
+
+
+// Converts n values of row p from unit ID `from` to unit ID `to` of table. in and out may point to the same array for an in-place conversion. The factor pair is folded into a single multiplier so the loop is a plain scaled copy the compiler vectorizes.
+void convert_units(const UnitTable& table, long p, int from, int to, const double* in, double* out, size_t n)
+{
+    const double factor = table[p][from].factor/table[p][to].factor;
+    for (size_t i = 0; i != n; ++i)
+        out[i] = in[i]*factor;
+}
+
+
+InputState parse_value(const char* text, double& value)
+{
+    const char* start = text + strspn(text, " \t");
+    if (*start == '\0')
+        return(input_empty);
+    char* end = nullptr;
+    value = strtod(start, &end);
+    if (end == start || end[strspn(end, " \t\r")] != '\0' || !std::isfinite(value) || strpbrk(start, "xX"))
+        return(input_invalid);
+    return(input_parsed);
+}
+
+
+bool read_line(FILE* in, std::string& line)
+{
+    char piece[1024];
+    line.clear();
+    while (fgets(piece, sizeof piece, in))
+    {
+        line += piece;
+        if (line.back() == '\n')
+            break;
+    }
+    if (line.empty())
+        return(false);
+    line.resize(strcspn(line.c_str(), "\r\n"));
+    return(true);
+}
+
+
+// Constants: rows each moles source is calculated from, and the other row each target needs besides the amount of substance
+static const unsigned char source_rows[no_source] = {
+    RowEnum::mass | RowEnum::molar_mass,
+    RowEnum::volume | RowEnum::molarity,
+    RowEnum::moles
+};
+static const unsigned char target_rows[ROWS] = {
+    RowEnum::molar_mass,    // mass = moles*molar_mass
+    RowEnum::mass,          // molar_mass = mass/moles
+    RowEnum::none,          // moles
+    RowEnum::molarity,      // volume = moles/molarity
+    RowEnum::volume         // molarity = moles/volume
+};
+
+
+// The relation table, indexed by target row and the rows holding a value. Built on first use.
+struct RelationTable {
+    Relation relations[ROWS][1 << ROWS];
+    unsigned char required[ROWS];
+
+    RelationTable()
+    {
+        for (long target = 0; target != ROWS; ++target)
+        {
+            const unsigned long target_bit = 1ul << target;
+            required[target] = 0;
+            for (unsigned long valid = 0; valid != (1ul << ROWS); ++valid)
+            {
+                Relation& relation = relations[target][valid];
+                relation = Relation{no_source, 0, 0, false, 0};
+                for (int source = from_mass; source != no_source; ++source)
+                {
+                    const unsigned char inputs = source_rows[source] | target_rows[target];
+                    if (inputs & target_bit)
+                        continue;
+                    if (!required[target])
+                        required[target] = inputs;
+                    if ((inputs & valid) != inputs)
+                        continue;
+                    
+                    relation.source = (MolesSource)source;
+                    relation.inputs = inputs;
+                    relation.moles_inputs = source_rows[source];
+                    relation.writes_moles = (source != from_moles) && (target_bit != RowEnum::moles);
+                    relation.clears = (source == from_mass && target_bit == RowEnum::moles) ? (RowEnum::volume | RowEnum::molarity) : 0;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+static const RelationTable& relation_table()
+{
+    static const RelationTable table;
+    return(table);
+}
+
+
+const Relation& find_relation(long target, unsigned long valid)
+{
+    return(relation_table().relations[target][valid & RowEnum::all]);
+}
+
+
+unsigned long required_rows(long target)
+{
+    return(relation_table().required[target]);
+}
+
+
+// Constants: how each moles source is described
+static const char* source_text[no_source] = {
+    "mass/molar mass",
+    "volume*molarity",
+    "moles"
+};
+
+// Appends the headers of the rows set in bin to text, separated by commas.
+static void append_rows(std::string& text, unsigned long bin)
+{
+    bool first = true;
+    for (int r = 0; r != ROWS; ++r)
+    {
+        if (!(bin & (1ul << r)))
+            continue;
+        text += first ? " " : ", ";
+        text += row_header[r];
+        first = false;
+    }
+}
+
+
+std::string describe_diagnostic(Diagnostic code, long target)
+{
+    const unsigned long missing = code & RowEnum::all;
+    const unsigned long invalid = (code >> DIAGNOSTIC_INVALID_SHIFT) & RowEnum::all;
+    const bool undefined = code & DIAGNOSTIC_UNDEFINED;
+    const int source = (code >> DIAGNOSTIC_SOURCE_SHIFT) & 3;
+
+    std::string text = row_header[target];
+    if (source != no_source)
+    {
+        text += " calculated with moles from ";
+        text += source_text[source];
+    }
+    else
+        text += " not calculated";
+    if (missing)
+    {
+        text += ";";
+        append_rows(text, missing);
+        text += " missing";
+    }
+    if (invalid)
+    {
+        text += ";";
+        append_rows(text, invalid);
+        text += " not a number";
+    }
+    if (undefined)
+        text += "; result not a finite number (division by zero)";
+    return(text);
+}
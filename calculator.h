@@ -0,0 +1,196 @@
+// Constants, units and calculations shared by the calculator window and the command line modes.
+
+#ifndef CALCULATOR_H
+#define CALCULATOR_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <ctime>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#define ROWS 5
+
+
+// Constants: row headers, defined in calculator.cpp
+extern const char* const row_header[ROWS];
+
+// Constants: row_header in enum, each header should convert to binary with "on" for corresponding header bit (read right to left). THE ORDER OF ITEMS IN row_header AND RowEnum SHOULD MATCH, ELSE THE CALCULTATIONS WILL BE MESSED UP
+enum RowEnum {
+    mass = 1,
+    molar_mass = 2,
+    moles = 4,
+    volume = 8,
+    molarity = 16,
+    all = 31,
+    none = 0
+};
+
+
+// Constants: user-defined units are read from this file in the working directory. Each line is "<row header>; <unit label>; <factor>", e.g. "Volume; fL; 1e-15". Lines starting with '#' are comments. A label that already exists for that row overrides the built-in factor.
+#define UNITS_FILE "units.cfg"
+#define UNITS_POLL_SECONDS 1.0
+
+
+// A unit label together with the factor converting it to the base unit of its row.
+struct Unit {
+    std::string label;
+    double factor;
+};
+
+// Constants: range of binary exponents covered by the best-unit lookup. Values outside it use the first or last entry.
+#define SCALE_EXP_MIN -160
+#define SCALE_EXP_COUNT 320
+
+// The compiled unit table: for each row, a dense list of units indexed by unit ID. The unit ID is what the Calculator keeps for each row, so get_value and set_value never search labels.
+struct UnitTable {
+    std::vector<Unit> units[ROWS];
+
+    // For each row and binary exponent of a base-unit value, the IDs of the units that put the value closest above 1: [0] for values below best_threshold, [1] for values at or above it. A power of ten can fall inside the range of an exponent, so the unit changes there. Only units with a power-of-ten factor are candidates, so a custom "equivalents" unit is never picked automatically.
+    unsigned char best_unit[ROWS][SCALE_EXP_COUNT][2];
+    double best_threshold[ROWS][SCALE_EXP_COUNT];   // Factor of best_unit[1], or infinity if no unit factor falls inside the exponent's range
+
+    std::vector<Unit>& operator[](long p) { return(units[p]); }
+    const std::vector<Unit>& operator[](long p) const { return(units[p]); }
+
+    // Returns the ID of the unit to display value (in base units) with in row p. The exponent lookup and one compare replace a search over the units. Zero and values that are not finite have no exponent, so they get the row's first unit.
+    int best_unit_for(long p, double value) const
+    {
+        if (value == 0 || !std::isfinite(value))
+            return(0);
+        const int exponent = std::ilogb(value);
+        if (exponent == FP_ILOGB0 || exponent == FP_ILOGBNAN)
+            return(0);
+        int e = exponent - SCALE_EXP_MIN;
+        e = std::min(std::max(e, 0), SCALE_EXP_COUNT - 1);
+        return(best_unit[p][e][value >= best_threshold[p][e]]);
+    }
+
+    // Fills best_unit from units. Must be called after the units are final.
+    void compile_best_units();
+};
+
+
+// Returns the ID of the unit with the given label in row p, or -1 if there is none.
+int find_unit(const UnitTable& table, long p, const char* label);
+
+// Returns the row whose header is name, or ROWS if there is none.
+long find_row(const char* name);
+
+// Compiles the built-in units and the units file (if readable) into a new UnitTable. Malformed lines in the file are skipped.
+std::shared_ptr<const UnitTable> load_unit_table(const char* path);
+
+// The live unit table is only read through current_units() and replaced as a whole by reload_units(), so readers holding a snapshot are never affected by a reload.
+std::shared_ptr<const UnitTable> current_units();
+void reload_units();
+
+// Returns the modification time of the units file, or 0 if it does not exist.
+time_t units_file_mtime();
+
+// Converts n values of row p from unit ID `from` to unit ID `to` of table. in and out may point to the same array for an in-place conversion.
+void convert_units(const UnitTable& table, long p, int from, int to, const double* in, double* out, size_t n);
+
+
+// Returns the number of significant figures in a typed number, e.g. 3 for "0.0250", 2 for "1200" and 4 for "1200.". The exponent of "2.5e-3" does not count. Returns 0 if text has no digits.
+int count_sig_figs(const char* text);
+
+// Writes value rounded to sig_figs significant figures into text. Trailing zeros are kept because they are significant, and whole numbers such as 1200 are not switched to exponent notation.
+void format_sig_figs(char* text, size_t size, double value, int sig_figs);
+
+
+// Constants: state of a typed value
+enum InputState {
+    input_empty,
+    input_parsed,
+    input_invalid
+};
+
+// Parses a typed value into value. Surrounding spaces are allowed; anything else after the number makes the input invalid, as do "nan", "inf", hexadecimal numbers and numbers too large for a double. Zero is a parsed value like any other.
+InputState parse_value(const char* text, double& value);
+
+// Reads a line of in of any length into line, without its line break. Returns false at the end of the file.
+bool read_line(FILE* in, std::string& line);
+
+// Validity of the inputs of one calculation, as RowEnum bits: a row set in valid holds a number, a row set in invalid holds text that is not a number, and a row in neither is empty.
+struct Validity {
+    unsigned char valid;
+    unsigned char invalid;
+};
+
+
+// Constants: where a relation takes the amount of substance from, in order of preference
+enum MolesSource {
+    from_mass = 0,      // mass/molar_mass
+    from_volume = 1,    // volume*molarity
+    from_moles = 2,     // the moles row itself
+    no_source = 3
+};
+
+// A way of calculating a target row. Every relation goes through the amount of substance: it is taken from source, and the target follows from it and at most one other row.
+struct Relation {
+    MolesSource source;
+    unsigned char inputs;        // Rows read, as RowEnum bits
+    unsigned char moles_inputs;  // Rows the amount of substance is calculated from
+    bool writes_moles;           // The amount of substance is an intermediate worth showing in the moles row
+    unsigned char clears;        // Rows the calculator window empties because they no longer agree with the result
+};
+
+// Returns the relation calculating target from the rows set in valid. The relation is looked up in a table indexed by target and valid, so choosing one never branches on the values. Its source is no_source if target cannot be calculated.
+const Relation& find_relation(long target, unsigned long valid);
+
+// Returns the rows of the preferred relation for target, which are the ones to ask for when nothing can be calculated.
+unsigned long required_rows(long target);
+
+// Calculates target from values (base units) with a relation taking the amount of substance from source, and stores that amount in moles. Every candidate amount and every target formula is evaluated and the wanted ones are selected, so the same straight-line code serves any relation and batch loops over it vectorize.
+inline double solve(long target, MolesSource source, const double values[ROWS], double& moles)
+{
+    const double candidates[no_source + 1] = {
+        values[0]/values[1],
+        values[3]*values[4],
+        values[2],
+        NAN
+    };
+    const double n = candidates[source];
+    const double results[ROWS] = {
+        n*values[1],
+        values[0]/n,
+        n,
+        n/values[4],
+        n/values[3]
+    };
+    moles = n;
+    return(results[target]);
+}
+
+
+// Constants: layout of a diagnostic code. Bits 0-4 are the RowEnum rows the preferred relation needed but were empty, bits 5-9 the rows holding text that is not a number, bits 10-11 the MolesSource of the relation used, no_source if nothing was calculated, and bit 12 is set when the relation gave no finite result, as when dividing by zero.
+#define DIAGNOSTIC_INVALID_SHIFT 5
+#define DIAGNOSTIC_SOURCE_SHIFT 10
+#define DIAGNOSTIC_UNDEFINED (1 << 12)
+#define DIAGNOSTIC_BITS 13
+#define DIAGNOSTIC_CODES (1 << DIAGNOSTIC_BITS)
+
+typedef unsigned short Diagnostic;
+
+// Returns the diagnostic code of calculating target from inputs with the given validity using relation. Missing rows are only reported when nothing was calculated, and rows holding text that is not a number are reported as that rather than as missing.
+inline Diagnostic diagnose(long target, const Validity& validity, const Relation& relation)
+{
+    const unsigned unsolved_mask = 0u - (unsigned)(relation.source == no_source);
+    const unsigned missing = required_rows(target) & ~validity.valid & ~validity.invalid & unsolved_mask;
+    return((Diagnostic)(missing | (validity.invalid << DIAGNOSTIC_INVALID_SHIFT) | (relation.source << DIAGNOSTIC_SOURCE_SHIFT)));
+}
+
+// Returns the diagnostic code of a calculation whose relation had every input but gave no finite result, which leaves target uncalculated.
+inline Diagnostic diagnose_undefined(const Validity& validity)
+{
+    return((Diagnostic)((validity.invalid << DIAGNOSTIC_INVALID_SHIFT) | (no_source << DIAGNOSTIC_SOURCE_SHIFT) | DIAGNOSTIC_UNDEFINED));
+}
+
+// Returns the text explaining a diagnostic code of calculating target, e.g. "Volume not calculated; Molarity missing".
+std::string describe_diagnostic(Diagnostic code, long target);
+
+
+#endif /* CALCULATOR_H */
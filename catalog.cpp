@@ -0,0 +1,143 @@
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <numeric>
+#include "catalog.h"
+#include "calculator.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Returns the FNV-1a hash of id. The top bits choose the partition, the bottom bits the first slot and the middle bits are kept as a tag to skip most comparisons.
+static uint64_t hash_id(const std::string& id)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c: id)
+        hash = (hash ^ c)*1099511628211ull;
+    return(hash);
+}
+
+
+// Returns field without the blanks around it
+static std::string trim(const char* field, size_t length)
+{
+    while (length && strchr(" \t", *field))
+    {
+        ++field;
+        --length;
+    }
+    while (length && strchr(" \t", field[length - 1]))
+        --length;
+    return(std::string(field, length));
+}
+
+
+bool Catalog::read(const char* path, std::string& error)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+    {
+        error = "cannot open the file";
+        return(false);
+    }
+    std::string text;
+    bool readable = read_line(in, text);
+    for (size_t number = 2; readable && read_line(in, text); ++number)
+    {
+        char* line = &text[0];
+        if (line[0] == '\0')
+            continue;
+        char* fields[3] = {nullptr, nullptr, nullptr};
+        char* field = line;
+        for (int f = 0; f != 3 && field; ++f)
+        {
+            fields[f] = field;
+            char* comma = strchr(field, ',');
+            field = comma ? comma + 1 : nullptr;
+            if (comma)
+                *comma = '\0';
+        }
+
+        // Purity is given as a percentage, with or without the sign
+        double molar_mass = 0, purity = 100;
+        const std::string purity_text = fields[2] ? trim(fields[2], strcspn(fields[2], "%")) : "";
+        const InputState purity_state = parse_value(purity_text.c_str(), purity);
+        if (!fields[1] || parse_value(fields[1], molar_mass) != input_parsed || !(molar_mass > 0) ||
+            purity_state == input_invalid || !(purity > 0 && purity <= 100))
+        {
+            error = "line " + std::to_string(number) + " has no valid molar mass and purity";
+            readable = false;
+            break;
+        }
+        // A purity of 100 % is taken as exact, not as one significant figure
+        const int figures = count_sig_figs(fields[1]);
+        ids.push_back(trim(fields[0], strlen(fields[0])));
+        molar_masses.push_back(molar_mass);
+        purities.push_back(purity/100);
+        sig_figs.push_back((unsigned char)((purity_state == input_parsed && purity != 100) ? std::min(figures, count_sig_figs(purity_text.c_str())) : figures));
+    }
+    if (ferror(in))
+    {
+        error = "cannot read the file";
+        readable = false;
+    }
+    fclose(in);
+    if (readable)
+        build();
+    return(readable);
+}
+
+
+void Catalog::build()
+{
+    INSTRUMENT_SCOPE("build_catalog");
+    const size_t n = ids.size(), partitions = (size_t)1 << CATALOG_PARTITION_BITS;
+    std::vector<uint64_t> hashes(n);
+    parallel_for((n + CATALOG_CHUNK - 1)/CATALOG_CHUNK, [&](size_t chunk) {
+        const size_t end = std::min((chunk + 1)*CATALOG_CHUNK, n);
+        for (size_t i = chunk*CATALOG_CHUNK; i != end; ++i)
+            hashes[i] = hash_id(ids[i]);
+    });
+
+    // Lines are grouped by partition in their order in the file, so the first of repeated IDs takes the slot
+    std::vector<size_t> starts(partitions + 1, 0);
+    for (uint64_t hash: hashes)
+        ++starts[(hash >> (64 - CATALOG_PARTITION_BITS)) + 1];
+    std::partial_sum(starts.begin(), starts.end(), starts.begin());
+    std::vector<size_t> next(starts.begin(), starts.end() - 1);
+    std::vector<uint32_t> lines(n);
+    for (size_t i = 0; i != n; ++i)
+        lines[next[hashes[i] >> (64 - CATALOG_PARTITION_BITS)]++] = (uint32_t)i;
+
+    parallel_for(partitions, [&](size_t p) {
+        size_t size = 16;
+        while (size < 2*(starts[p + 1] - starts[p]))
+            size *= 2;
+        std::vector<uint64_t>& table = tables[p];
+        table.assign(size, 0);
+        for (size_t l = starts[p]; l != starts[p + 1]; ++l)
+        {
+            const uint32_t line = lines[l];
+            const uint64_t tag = (hashes[line] >> 24) & 0xffffffffu;
+            size_t slot = hashes[line] & (size - 1);
+            while (table[slot] && !((table[slot] >> 32) == tag && ids[(uint32_t)table[slot] - 1] == ids[line]))
+                slot = (slot + 1) & (size - 1);
+            if (!table[slot])
+                table[slot] = tag << 32 | (line + 1);
+        }
+    });
+    INSTRUMENT_COUNT("catalog_lines", n);
+}
+
+
+long Catalog::find(const std::string& id) const
+{
+    const uint64_t hash = hash_id(id), tag = (hash >> 24) & 0xffffffffu;
+    const std::vector<uint64_t>& table = tables[hash >> (64 - CATALOG_PARTITION_BITS)];
+    if (table.empty())
+        return(-1);
+    for (size_t slot = hash & (table.size() - 1); table[slot]; slot = (slot + 1) & (table.size() - 1))
+        if ((table[slot] >> 32) == tag && ids[(uint32_t)table[slot] - 1] == id)
+            return((long)(uint32_t)table[slot] - 1);
+    return(-1);
+}
@@ -0,0 +1,41 @@
+// Compound catalog: molar masses and purities of stock compounds by catalog ID, joined to batch lines that give an ID in place of a molar mass.
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Constants: the hash table of a catalog is split into 2^CATALOG_PARTITION_BITS partitions by the top bits of the hash, built in parallel and each small enough to stay in cache while it is filled
+#define CATALOG_PARTITION_BITS 8
+
+// Constants: IDs hashed or looked up per parallel task
+#define CATALOG_CHUNK 16384
+
+
+// The lines of a catalog, with a partitioned hash table of their IDs.
+struct Catalog {
+    std::vector<std::string> ids;
+    std::vector<double> molar_masses;           // g/mol
+    std::vector<double> purities;               // Fractions, 1 if not given
+    std::vector<unsigned char> sig_figs;        // Fewest of molar mass and purity
+
+    size_t size() const { return(ids.size()); }
+
+    // Reads lines of "id,molar mass,purity" after a header line from path. Purity is a percentage and may be left empty for 100 %; further fields, such as density, are ignored. Returns false and sets error if the file cannot be read or a line has no valid molar mass or purity.
+    bool read(const char* path, std::string& error);
+
+    // Returns the line of id, or -1 if it is not in the catalog. The first of repeated IDs is found.
+    long find(const std::string& id) const;
+
+private:
+    // Per partition, open addressing slots of (hash tag << 32 | line + 1), 0 if empty
+    std::vector<uint64_t> tables[1 << CATALOG_PARTITION_BITS];
+
+    // Fills tables from ids, hashing and then building the partitions in parallel.
+    void build();
+};
+
+
+#endif /* CATALOG_H */
@@ -0,0 +1,405 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "compressed.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: bit positions in a line shape of the invalid rows, the diagnostic code and the significant figures of the first row; each row's figures take 8 bits
+#define SHAPE_INVALID_SHIFT 5
+#define SHAPE_DIAGNOSTIC_SHIFT 10
+#define SHAPE_FIGURES_SHIFT (SHAPE_DIAGNOSTIC_SHIFT + DIAGNOSTIC_BITS)
+
+// Constants: powers of ten by which column_decimal blocks are scaled
+static const double powers[COLUMN_DECIMALS + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12};
+
+
+// Writes numbers of a given number of bits to out, lowest bits first
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    uint64_t pending;
+    int count;
+
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out), pending(0), count(0) {}
+
+    void put(uint64_t value, int bits)
+    {
+        while (bits > 0)
+        {
+            const int take = std::min(bits, 64 - count);
+            const uint64_t part = (take == 64) ? value : value & ((1ull << take) - 1);
+            pending |= part << count;
+            value = (take == 64) ? 0 : value >> take;
+            bits -= take;
+            count += take;
+            for (; count >= 8; count -= 8)
+            {
+                out.push_back((unsigned char)pending);
+                pending >>= 8;
+            }
+        }
+    }
+
+    // Writes the bits left over in a last byte
+    void finish()
+    {
+        if (count)
+            out.push_back((unsigned char)pending);
+        pending = 0;
+        count = 0;
+    }
+};
+
+
+// Reads numbers written by BitWriter
+struct BitReader {
+    const unsigned char* data;
+    size_t position;            // In bits
+
+    explicit BitReader(const unsigned char* data) : data(data), position(0) {}
+
+    uint64_t get(int bits)
+    {
+        uint64_t value = 0;
+        for (int got = 0; got < bits; )
+        {
+            const int shift = position & 7, take = std::min(bits - got, 8 - shift);
+            value |= (uint64_t)((data[position >> 3] >> shift) & ((1u << take) - 1)) << got;
+            got += take;
+            position += take;
+        }
+        return(value);
+    }
+};
+
+
+// Returns the bits needed to write every number up to largest
+static int bits_for(uint64_t largest)
+{
+    int bits = 0;
+    for (; largest; largest >>= 1)
+        ++bits;
+    return(bits);
+}
+
+
+static uint64_t double_bits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return(bits);
+}
+
+
+static double bits_double(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof value);
+    return(value);
+}
+
+
+static void put_bytes(std::vector<unsigned char>& out, const void* bytes, size_t size)
+{
+    out.insert(out.end(), (const unsigned char*)bytes, (const unsigned char*)bytes + size);
+}
+
+
+// Encodes values as a dictionary of their distinct values into out. Returns false if there are more than COLUMN_DICTIONARY of them.
+static bool encode_dictionary(const double* values, size_t n, std::vector<unsigned char>& out)
+{
+    std::vector<uint64_t> distinct;
+    std::vector<uint32_t> indices(n);
+    for (size_t i = 0; i != n; ++i)
+    {
+        const uint64_t bits = double_bits(values[i]);
+        indices[i] = (uint32_t)(std::find(distinct.begin(), distinct.end(), bits) - distinct.begin());
+        if (indices[i] == distinct.size())
+        {
+            if (distinct.size() == COLUMN_DICTIONARY)
+                return(false);
+            distinct.push_back(bits);
+        }
+    }
+    out.push_back(column_dictionary);
+    out.push_back((unsigned char)(distinct.size() - 1));
+    put_bytes(out, distinct.data(), distinct.size()*sizeof(uint64_t));
+    const int width = bits_for(distinct.size() - 1);
+    BitWriter writer(out);
+    for (uint32_t index: indices)
+        writer.put(index, width);
+    writer.finish();
+    return(true);
+}
+
+
+// Encodes values as whole numbers of 10^-places into out, with the fewest places that give every value back exactly. Returns false if none up to COLUMN_DECIMALS do.
+static bool encode_decimal(const double* values, size_t n, std::vector<unsigned char>& out)
+{
+    std::vector<int64_t> numbers(n);
+    for (int places = 0; places <= COLUMN_DECIMALS; ++places)
+    {
+        size_t i = 0;
+        for (; i != n; ++i)
+        {
+            const double scaled = std::nearbyint(values[i]*powers[places]);
+            if (!(std::fabs(scaled) <= 9007199254740992.0))
+                break;
+            numbers[i] = (int64_t)scaled;
+            if (double_bits((double)numbers[i]/powers[places]) != double_bits(values[i]))
+                break;
+        }
+        if (i != n)
+            continue;
+
+        const int64_t smallest = *std::min_element(numbers.begin(), numbers.end());
+        const int width = bits_for((uint64_t)(*std::max_element(numbers.begin(), numbers.end()) - smallest));
+        out.push_back(column_decimal);
+        out.push_back((unsigned char)places);
+        out.push_back((unsigned char)width);
+        put_bytes(out, &smallest, sizeof smallest);
+        BitWriter writer(out);
+        for (int64_t number: numbers)
+            writer.put((uint64_t)(number - smallest), width);
+        writer.finish();
+        return(true);
+    }
+    return(false);
+}
+
+
+// Encodes values exclusive-ored with the value before into out. A value equal to the one before takes one bit; others keep only the bits between the leading and trailing zeros of the difference, reusing the previous window of bits when it fits.
+static void encode_xor(const double* values, size_t n, std::vector<unsigned char>& out)
+{
+    out.push_back(column_xor);
+    BitWriter writer(out);
+    uint64_t previous = 0;
+    int window_lead = 64, window_trail = 64;
+    for (size_t i = 0; i != n; ++i)
+    {
+        const uint64_t bits = double_bits(values[i]), difference = bits ^ previous;
+        previous = bits;
+        if (difference == 0)
+        {
+            writer.put(0, 1);
+            continue;
+        }
+        int lead = 0, trail = 0;
+        while (!(difference & (1ull << (63 - lead))))
+            ++lead;
+        while (!(difference & (1ull << trail)))
+            ++trail;
+        if (lead >= window_lead && trail >= window_trail)
+        {
+            writer.put(1, 2);
+            writer.put(difference >> window_trail, 64 - window_lead - window_trail);
+            continue;
+        }
+        const int length = 64 - lead - trail;
+        writer.put(3, 2);
+        writer.put(lead, 6);
+        writer.put(length - 1, 6);
+        writer.put(difference >> trail, length);
+        window_lead = lead;
+        window_trail = trail;
+    }
+    writer.finish();
+}
+
+
+// Encodes a block of n values into out, the smallest way
+static void encode_values(const double* values, size_t n, std::vector<unsigned char>& out)
+{
+    std::vector<unsigned char> candidates[3];
+    encode_decimal(values, n, candidates[0]);
+    encode_dictionary(values, n, candidates[1]);
+    encode_xor(values, n, candidates[2]);
+    out.clear();
+    out.push_back(column_raw);
+    put_bytes(out, values, n*sizeof(double));
+    for (std::vector<unsigned char>& candidate: candidates)
+        if (!candidate.empty() && candidate.size() < out.size())
+            out.swap(candidate);
+}
+
+
+// Decodes a block of n values encoded by encode_values
+static void decode_values(const unsigned char* data, size_t n, double* values)
+{
+    switch (data[0])
+    {
+        case column_raw:
+            memcpy(values, data + 1, n*sizeof(double));
+            break;
+
+        case column_dictionary:
+        {
+            const size_t count = (size_t)data[1] + 1;
+            std::vector<uint64_t> distinct(count);
+            memcpy(distinct.data(), data + 2, count*sizeof(uint64_t));
+            const int width = bits_for(count - 1);
+            BitReader reader(data + 2 + count*sizeof(uint64_t));
+            for (size_t i = 0; i != n; ++i)
+                values[i] = bits_double(distinct[reader.get(width)]);
+            break;
+        }
+
+        case column_decimal:
+        {
+            const double power = powers[data[1]];
+            const int width = data[2];
+            int64_t smallest;
+            memcpy(&smallest, data + 3, sizeof smallest);
+            BitReader reader(data + 3 + sizeof smallest);
+            for (size_t i = 0; i != n; ++i)
+                values[i] = (double)(smallest + (int64_t)reader.get(width))/power;
+            break;
+        }
+
+        case column_xor:
+        {
+            BitReader reader(data + 1);
+            uint64_t previous = 0;
+            int window_lead = 64, window_trail = 64;
+            for (size_t i = 0; i != n; ++i)
+            {
+                if (reader.get(1))
+                {
+                    if (reader.get(1))
+                    {
+                        window_lead = (int)reader.get(6);
+                        const int length = (int)reader.get(6) + 1;
+                        window_trail = 64 - window_lead - length;
+                    }
+                    previous ^= reader.get(64 - window_lead - window_trail) << window_trail;
+                }
+                values[i] = bits_double(previous);
+            }
+            break;
+        }
+    }
+}
+
+
+CompressedColumns::CompressedColumns():
+    lines(0)
+{
+    for (int c = 0; c <= ROWS; ++c)
+        offsets[c].assign(1, 0);
+}
+
+
+size_t CompressedColumns::bytes(int r) const
+{
+    return(data[r].size() + offsets[r].size()*sizeof(size_t) + ((r == ROWS) ? shapes.size()*sizeof(uint64_t) : 0));
+}
+
+
+void CompressedColumns::append(const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("compress_columns");
+    const size_t n = columns.size();
+    for (int r = 0; r != ROWS; ++r)
+        pending_values[r].insert(pending_values[r].end(), columns.values[r].begin(), columns.values[r].end());
+
+    // The figures, validity and diagnostic code of a line take one number among the few combinations that occur
+    for (size_t i = 0; i != n; ++i)
+    {
+        uint64_t shape = columns.validity[i].valid | (uint64_t)columns.validity[i].invalid << SHAPE_INVALID_SHIFT |
+                         (uint64_t)columns.diagnostics[i] << SHAPE_DIAGNOSTIC_SHIFT;
+        for (int r = 0; r != ROWS; ++r)
+            shape |= (uint64_t)columns.sig_figs[r][i] << (SHAPE_FIGURES_SHIFT + 8*r);
+        auto inserted = shape_codes.emplace(shape, (uint32_t)shapes.size());
+        if (inserted.second)
+            shapes.push_back(shape);
+        pending_shapes.push_back(inserted.first->second);
+    }
+    lines += n;
+    encode_blocks();
+}
+
+
+void CompressedColumns::encode_blocks()
+{
+    const size_t blocks = pending_shapes.size()/COLUMN_BLOCK;
+    if (blocks == 0)
+        return;
+
+    // Every block of every column is encoded as a task of its own
+    std::vector<std::vector<unsigned char>> encoded(blocks*(ROWS + 1));
+    parallel_for(encoded.size(), [&](size_t task) {
+        const int c = (int)(task % (ROWS + 1));
+        const size_t b = task/(ROWS + 1);
+        if (c != ROWS)
+        {
+            encode_values(pending_values[c].data() + b*COLUMN_BLOCK, COLUMN_BLOCK, encoded[task]);
+            return;
+        }
+        const uint32_t* codes = pending_shapes.data() + b*COLUMN_BLOCK;
+        const int width = bits_for(*std::max_element(codes, codes + COLUMN_BLOCK));
+        encoded[task].push_back((unsigned char)width);
+        BitWriter writer(encoded[task]);
+        for (size_t i = 0; i != COLUMN_BLOCK; ++i)
+            writer.put(codes[i], width);
+        writer.finish();
+    });
+    for (size_t task = 0; task != encoded.size(); ++task)
+    {
+        const int c = (int)(task % (ROWS + 1));
+        data[c].insert(data[c].end(), encoded[task].begin(), encoded[task].end());
+        offsets[c].push_back(data[c].size());
+    }
+    for (int r = 0; r != ROWS; ++r)
+        pending_values[r].erase(pending_values[r].begin(), pending_values[r].begin() + blocks*COLUMN_BLOCK);
+    pending_shapes.erase(pending_shapes.begin(), pending_shapes.begin() + blocks*COLUMN_BLOCK);
+}
+
+
+void CompressedColumns::read(size_t first, size_t count, BatchColumns& columns) const
+{
+    INSTRUMENT_SCOPE("decompress_columns");
+    count = (first < lines) ? std::min(count, lines - first) : 0;
+    columns.resize(count);
+    columns.clear_trailing();
+    columns.reagent_codes.assign(count, NO_REAGENT);
+    const size_t encoded_lines = (offsets[0].size() - 1)*COLUMN_BLOCK;
+    double values[COLUMN_BLOCK];
+    uint32_t codes[COLUMN_BLOCK];
+
+    // Each block the lines fall in is decoded once, or taken from the lines not yet encoded
+    for (size_t line = first; line != first + count; )
+    {
+        const size_t b = line/COLUMN_BLOCK, start = b*COLUMN_BLOCK, end = std::min(start + COLUMN_BLOCK, first + count);
+        for (int r = 0; r != ROWS; ++r)
+        {
+            const double* source = values;
+            if (start < encoded_lines)
+                decode_values(data[r].data() + offsets[r][b], COLUMN_BLOCK, values);
+            else
+                source = pending_values[r].data() + (start - encoded_lines);
+            std::copy(source + (line - start), source + (end - start), columns.values[r].begin() + (line - first));
+        }
+        const uint32_t* shape_source = codes;
+        if (start < encoded_lines)
+        {
+            const unsigned char* block = data[ROWS].data() + offsets[ROWS][b];
+            BitReader reader(block + 1);
+            for (size_t i = 0; i != COLUMN_BLOCK; ++i)
+                codes[i] = (uint32_t)reader.get(block[0]);
+        }
+        else
+            shape_source = pending_shapes.data() + (start - encoded_lines);
+        for (size_t l = line; l != end; ++l)
+        {
+            const uint64_t shape = shapes[shape_source[l - start]];
+            const size_t i = l - first;
+            columns.validity[i].valid = shape & RowEnum::all;
+            columns.validity[i].invalid = (shape >> SHAPE_INVALID_SHIFT) & RowEnum::all;
+            columns.diagnostics[i] = (Diagnostic)((shape >> SHAPE_DIAGNOSTIC_SHIFT) & (DIAGNOSTIC_CODES - 1));
+            for (int r = 0; r != ROWS; ++r)
+                columns.sig_figs[r][i] = (unsigned char)(shape >> (SHAPE_FIGURES_SHIFT + 8*r));
+        }
+        line = end;
+    }
+}
@@ -0,0 +1,60 @@
+// Compressed columns: batch lines held in memory in a fraction of the space, in blocks that are decoded when lines in them are read.
+
+#ifndef COMPRESSED_H
+#define COMPRESSED_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "batch.h"
+
+// Constants: lines per compressed block; reading any line decodes its whole block
+#define COLUMN_BLOCK 1024
+
+// Constants: most distinct values a block stores once each and refers to by number
+#define COLUMN_DICTIONARY 256
+
+// Constants: most decimal places tried when storing a block of values as whole numbers
+#define COLUMN_DECIMALS 12
+
+
+// The ways a block of values is encoded; the smallest is chosen for each block
+enum ColumnEncoding {
+    column_raw,             // The doubles as they are
+    column_dictionary,      // The distinct values, then the number of each value in as few bits as they need
+    column_decimal,         // Values that are whole numbers of 10^-places, as offsets from the smallest in as few bits as they need
+    column_xor              // Each value exclusive-ored with the one before, leading and trailing zero bits left out
+};
+
+
+// Batch lines stored compressed: the values of each row in blocks encoded as ColumnEncoding, and the significant figures, validity and diagnostic code of each line as one number in a dictionary of the combinations that occur, packed in as few bits as each block needs. Lines are decoded back exactly.
+class CompressedColumns {
+    size_t lines;
+    std::vector<unsigned char> data[ROWS + 1];      // Encoded blocks of each row, then of the line shapes
+    std::vector<size_t> offsets[ROWS + 1];          // Start of each block in data, and the end of the last
+    std::vector<uint64_t> shapes;                   // Distinct combinations of figures, validity and diagnostic code
+    std::unordered_map<uint64_t, uint32_t> shape_codes;
+
+    // Lines after the last full block, not yet encoded
+    std::vector<double> pending_values[ROWS];
+    std::vector<uint32_t> pending_shapes;
+
+    void encode_blocks();
+
+public:
+    CompressedColumns();
+
+    size_t size() const { return(lines); }
+
+    // Returns the bytes taken by the encoded blocks of row r, or of the line shapes and their dictionary if r is ROWS.
+    size_t bytes(int r) const;
+
+    // Appends the lines of columns. Full blocks are encoded in parallel.
+    void append(const BatchColumns& columns);
+
+    // Copies count lines from line first into columns, decoding only the blocks that hold them.
+    void read(size_t first, size_t count, BatchColumns& columns) const;
+};
+
+
+#endif /* COMPRESSED_H */
@@ -0,0 +1,301 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "decay.h"
+#include "calculator.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: fields of an input line
+#define DECAY_FIELDS 4
+
+// Constants: seconds in a Julian year, the unit of long half-lives
+#define YEAR_SECONDS (365.25*86400)
+
+// Constants: adding and subtracting 1.5*2^52 rounds a double below 2^51 to the nearest whole number, which is left in the low bits of the sum
+#define ROUND_MAGIC 6755399441055744.0
+
+// Constants: half-life units in seconds
+struct TimeUnit {
+    const char* label;
+    double seconds;
+};
+static const TimeUnit time_units[] = {
+    {"s", 1}, {"min", 60}, {"h", 3600}, {"d", 86400}, {"y", YEAR_SECONDS}
+};
+
+// Constants: half-lives of nuclides used in tracers and labelling (NNDC)
+struct Nuclide {
+    const char* name;
+    double half_life;
+    double unit;
+};
+static const Nuclide nuclides[] = {
+    {"H-3", 12.32, YEAR_SECONDS}, {"C-11", 20.364, 60}, {"C-14", 5700, YEAR_SECONDS}, {"N-13", 9.965, 60},
+    {"O-15", 122.24, 1}, {"F-18", 109.77, 60}, {"P-32", 14.268, 86400}, {"S-35", 87.37, 86400},
+    {"Cu-64", 12.701, 3600}, {"Ga-68", 67.71, 60}, {"Rb-82", 76.38, 1}, {"Zr-89", 78.41, 3600},
+    {"Y-90", 64.05, 3600}, {"Tc-99m", 6.0067, 3600}, {"In-111", 2.8047, 86400}, {"I-123", 13.2235, 3600},
+    {"I-124", 4.1760, 86400}, {"I-125", 59.392, 86400}, {"I-131", 8.0252, 86400}, {"Lu-177", 6.647, 86400},
+    {"At-211", 7.214, 3600}, {"Ac-225", 9.920, 86400}
+};
+
+
+bool parse_half_life(const char* text, double& seconds)
+{
+    while (isspace((unsigned char)*text))
+        ++text;
+    std::string name(text, strcspn(text, " \t\r\n"));
+    for (const Nuclide& nuclide: nuclides)
+    {
+        if (name == nuclide.name)
+        {
+            seconds = nuclide.half_life*nuclide.unit;
+            return(true);
+        }
+    }
+
+    char* end;
+    const double value = strtod(text, &end);
+    if (end == text)
+        return(false);
+    while (isspace((unsigned char)*end))
+        ++end;
+    std::string label(end, strcspn(end, " \t\r\n"));
+    double unit = label.empty() ? 1 : 0;
+    for (const TimeUnit& u: time_units)
+        if (label == u.label)
+            unit = u.seconds;
+    seconds = value*unit;
+    return(unit > 0 && value > 0);
+}
+
+
+// Returns the days from 1970-01-01 to a date of the proleptic Gregorian calendar
+static long days_from_civil(long year, long month, long day)
+{
+    year -= (month <= 2);
+    const long era = (year >= 0 ? year : year - 399)/400;
+    const long year_of_era = year - era*400;
+    const long day_of_year = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+    const long day_of_era = year_of_era*365 + year_of_era/4 - year_of_era/100 + day_of_year;
+    return(era*146097 + day_of_era - 719468);
+}
+
+
+bool parse_time(const char* text, double& seconds)
+{
+    long year, month, day, hour, minute;
+    double second = 0;
+    char separator;
+    int used = 0;
+    if (sscanf(text, " %ld-%ld-%ld%c%ld:%ld%n", &year, &month, &day, &separator, &hour, &minute, &used) == 6 &&
+        (separator == ' ' || separator == 'T'))
+    {
+        text += used;
+        if (*text == ':')
+        {
+            char* end;
+            second = strtod(text + 1, &end);
+            if (end == text + 1)
+                return(false);
+            text = end;
+        }
+        if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || !(second >= 0 && second < 61))
+            return(false);
+        seconds = days_from_civil(year, month, day)*86400.0 + hour*3600 + minute*60 + second;
+    }
+    else if (parse_value(text, seconds) == input_parsed)
+        return(true);
+    else
+        return(false);
+    while (isspace((unsigned char)*text))
+        ++text;
+    return(*text == '\0');
+}
+
+
+// Returns 2^y: the nearest whole power 2^k is built in the exponent bits, and 2^(y - k) = e^((y - k) ln 2) with |y - k| <= 1/2 comes from its Taylor series to degree 12, which is accurate to under 2e-16. Below 2^-1022 it returns 0, by a multiplication rather than a branch.
+static inline double exp2_kernel(double y)
+{
+    const double in_range = (y >= -1022.0);
+    y = std::min(std::max(y, -1022.0), 1023.0);
+    const double shifted = y + ROUND_MAGIC;
+    const double k = shifted - ROUND_MAGIC;
+    const double t = (y - k)*0.6931471805599453;
+    double p = 1.0/479001600;
+    p = p*t + 1.0/39916800;
+    p = p*t + 1.0/3628800;
+    p = p*t + 1.0/362880;
+    p = p*t + 1.0/40320;
+    p = p*t + 1.0/5040;
+    p = p*t + 1.0/720;
+    p = p*t + 1.0/120;
+    p = p*t + 1.0/24;
+    p = p*t + 1.0/6;
+    p = p*t + 0.5;
+    p = p*t + 1;
+    p = p*t + 1;
+
+    uint64_t bits;
+    memcpy(&bits, &shifted, sizeof bits);
+    bits = (bits + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof scale);
+    return(p*scale*in_range);
+}
+
+
+void decay_factors(const double* elapsed, const double* half_life, double* factors, size_t count)
+{
+    for (size_t i = 0; i != count; ++i)
+        factors[i] = exp2_kernel(-elapsed[i]/half_life[i]);
+}
+
+
+// One chunk of input lines, parsed into columns
+struct DecayChunk {
+    std::vector<std::string> lines;
+    std::vector<double> half_life, elapsed, activity, molarity, factor;
+    std::vector<unsigned char> activity_figures, molarity_figures, valid, fields;
+    std::string out;
+};
+
+
+// Writes value to text with the significant figures it was typed with, or nothing if it is not a number
+static void format_amount(char* text, size_t size, double value, int figures)
+{
+    if (std::isnan(value))
+        *text = '\0';
+    else
+        format_sig_figs(text, size, value, figures);
+}
+
+
+// Parses, corrects and formats the lines of a chunk
+static void correct_chunk(DecayChunk& chunk, double reference)
+{
+    const size_t n = chunk.lines.size();
+    chunk.half_life.assign(n, NAN);
+    chunk.elapsed.assign(n, NAN);
+    chunk.activity.assign(n, NAN);
+    chunk.molarity.assign(n, NAN);
+    chunk.factor.resize(n);
+    chunk.activity_figures.assign(n, 0);
+    chunk.molarity_figures.assign(n, 0);
+    chunk.valid.assign(n, 0);
+    chunk.fields.assign(n, 0);
+    for (size_t i = 0; i != n; ++i)
+    {
+        // The molarity field may be left off
+        char* fields[DECAY_FIELDS];
+        char* field = &chunk.lines[i][0];
+        int count = 0;
+        while (count != DECAY_FIELDS)
+        {
+            size_t length = strcspn(field, ",");
+            char end = field[length];
+            field[length] = '\0';
+            fields[count++] = field;
+            field += length;
+            if (end != ',')
+                break;
+            ++field;
+        }
+        chunk.fields[i] = (unsigned char)count;
+        if (count < DECAY_FIELDS - 1)
+            continue;
+        for (; count != DECAY_FIELDS; ++count)
+            fields[count] = field;
+
+        double measured;
+        if (!parse_half_life(fields[0], chunk.half_life[i]) || !parse_time(fields[1], measured))
+            continue;
+        chunk.elapsed[i] = reference - measured;
+        const InputState activity = parse_value(fields[2], chunk.activity[i]);
+        const InputState molarity = parse_value(fields[3], chunk.molarity[i]);
+        chunk.valid[i] = activity != input_invalid && molarity != input_invalid;
+        chunk.activity[i] = (activity == input_parsed) ? chunk.activity[i] : NAN;
+        chunk.molarity[i] = (molarity == input_parsed) ? chunk.molarity[i] : NAN;
+        chunk.activity_figures[i] = (activity == input_parsed) ? count_sig_figs(fields[2]) : 0;
+        chunk.molarity_figures[i] = (molarity == input_parsed) ? count_sig_figs(fields[3]) : 0;
+    }
+
+    decay_factors(chunk.elapsed.data(), chunk.half_life.data(), chunk.factor.data(), n);
+    for (size_t i = 0; i != n; ++i)
+    {
+        chunk.activity[i] *= chunk.factor[i];
+        chunk.molarity[i] *= chunk.factor[i];
+    }
+
+    // Fields were cut at their commas while parsing, so the line is rebuilt from them, with empty fields for those left off so the results line up with the header
+    char elapsed[32], factor[32], activity[32], molarity[32];
+    for (size_t i = 0; i != n; ++i)
+    {
+        std::string& line = chunk.lines[i];
+        std::replace(line.begin(), line.end(), '\0', ',');
+        chunk.out += line;
+        chunk.out.append(DECAY_FIELDS - chunk.fields[i], ',');
+        if (!chunk.valid[i])
+        {
+            chunk.out += ",,,,\n";
+            continue;
+        }
+        snprintf(elapsed, sizeof elapsed, "%.10g", chunk.elapsed[i]);
+        snprintf(factor, sizeof factor, "%.10g", chunk.factor[i]);
+        format_amount(activity, sizeof activity, chunk.activity[i], chunk.activity_figures[i]);
+        format_amount(molarity, sizeof molarity, chunk.molarity[i], chunk.molarity_figures[i]);
+        chunk.out += std::string(",") + elapsed + "," + factor + "," + activity + "," + molarity + "\n";
+    }
+}
+
+
+int decay_main(int argc, char** argv)
+{
+    const char* reference_text = nullptr;
+    bool usage = false;
+    for (int a = 2; a < argc && !usage; ++a)
+    {
+        if (strcmp(argv[a], "--reference") == 0 && a + 1 < argc)
+            reference_text = argv[++a];
+        else
+            usage = true;
+    }
+    double reference;
+    if (usage || !reference_text || !parse_time(reference_text, reference))
+    {
+        fprintf(stderr, "Usage: %s --decay --reference <YYYY-MM-DD HH:MM[:SS]>\n", argv[0]);
+        return(2);
+    }
+
+    char line[1024];
+    if (fgets(line, sizeof line, stdin))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        printf("%s,elapsed,decay_factor,corrected_activity,corrected_molarity\n", line);
+    }
+    std::vector<DecayChunk> chunks;
+    while (fgets(line, sizeof line, stdin))
+    {
+        if (chunks.empty() || chunks.back().lines.size() == DECAY_CHUNK)
+            chunks.emplace_back();
+        line[strcspn(line, "\r\n")] = '\0';
+        chunks.back().lines.push_back(line);
+    }
+
+    {
+        INSTRUMENT_SCOPE("decay_correct");
+        parallel_for(chunks.size(), [&](size_t c) {
+            correct_chunk(chunks[c], reference);
+        });
+    }
+    for (const DecayChunk& chunk: chunks)
+        fputs(chunk.out.c_str(), stdout);
+    return(0);
+}
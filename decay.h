@@ -0,0 +1,25 @@
+// Decay correction: activities and amounts of radiolabelled and unstable compounds at a reference time, from their half-lives.
+
+#ifndef DECAY_H
+#define DECAY_H
+
+#include <cstddef>
+
+// Constants: lines corrected per parallel task
+#define DECAY_CHUNK 4096
+
+
+// Parses a half-life, either a number with a unit ("109.77 min"; s, min, h, d or y, seconds if there is none) or a nuclide such as "F-18" or "Tc-99m", into seconds. Returns false if it is neither.
+bool parse_half_life(const char* text, double& seconds);
+
+// Parses a time "YYYY-MM-DD HH:MM[:SS]" (or with "T" between date and time) into seconds since 1970-01-01 00:00:00 in the same time zone, or a plain number as seconds. Returns false if it is neither.
+bool parse_time(const char* text, double& seconds);
+
+// Stores in factors[i] the fraction 2^(-elapsed[i]/half_life[i]) left after elapsed[i] seconds, for a half-life of half_life[i] seconds; elapsed times before the measurement give factors above 1. The loop has no calls or branches, so it vectorizes; factors are within an ulp or two of exp2, underflow to 0 below the smallest normal number, and are held at the largest power of 2 rather than overflowing to infinity.
+void decay_factors(const double* elapsed, const double* half_life, double* factors, size_t count);
+
+// Command line mode: "--decay --reference <time>" reads lines of "half life,measured time,activity,molarity" from standard input and writes each with the time from measurement to reference (s), the decay factor, and the activity (in the unit given) and molarity (M) decay-corrected to the reference time, to the significant figures they were given with. Either amount may be empty. The first line is a header. Lines are corrected in parallel chunks.
+int decay_main(int argc, char** argv);
+
+
+#endif /* DECAY_H */
@@ -0,0 +1,576 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "decimal.h"
+#include "instrument.h"
+
+
+// Constants: digits of the largest power of ten below 2^128, and of the largest integer every double holds exactly (2^53)
+#define UINT128_DIGITS 38
+#define DOUBLE_EXACT_DIGITS 15
+
+// Constants: range of powers of ten kept as doubles
+#define POWER_MIN -350
+#define POWER_MAX 308
+
+
+#ifdef __SIZEOF_INT128__
+// Sets product to a*b and returns true if it overflowed
+static bool multiply_overflows(uint128 a, uint128 b, uint128* product)
+{
+    return(__builtin_mul_overflow(a, b, product));
+}
+#else
+// Returns the 128-bit product of two 64-bit integers, from their 32-bit halves
+static uint128 multiply_wide(uint64_t a, uint64_t b)
+{
+    const uint64_t a0 = (uint32_t)a, a1 = a >> 32, b0 = (uint32_t)b, b1 = b >> 32;
+    const uint64_t low = a0*b0, middle1 = a1*b0, middle0 = a0*b1;
+    const uint64_t middle = (low >> 32) + (uint32_t)middle1 + (uint32_t)middle0;
+    uint128 product;
+    product.low = (middle << 32) | (uint32_t)low;
+    product.high = a1*b1 + (middle1 >> 32) + (middle0 >> 32) + (middle >> 32);
+    return(product);
+}
+
+uint128 uint128::operator+(const uint128& b) const
+{
+    uint128 sum;
+    sum.low = low + b.low;
+    sum.high = high + b.high + (sum.low < low);
+    return(sum);
+}
+
+uint128 uint128::operator*(const uint128& b) const
+{
+    uint128 product = multiply_wide(low, b.low);
+    product.high += high*b.low + low*b.high;
+    return(product);
+}
+
+uint128 uint128::operator<<(int bits) const
+{
+    uint128 shifted;
+    if (bits >= 64)
+        shifted.high = low << (bits - 64), shifted.low = 0;
+    else if (bits > 0)
+        shifted.high = (high << bits) | (low >> (64 - bits)), shifted.low = low << bits;
+    else
+        shifted = *this;
+    return(shifted);
+}
+
+uint128 uint128::operator>>(int bits) const
+{
+    uint128 shifted;
+    if (bits >= 64)
+        shifted.low = high >> (bits - 64);
+    else if (bits > 0)
+        shifted.high = high >> bits, shifted.low = (low >> bits) | (high << (64 - bits));
+    else
+        shifted = *this;
+    return(shifted);
+}
+
+// Divides a by b one bit at a time, unless both fit in 64 bits
+static void divide(const uint128& a, const uint128& b, uint128& quotient, uint128& remainder)
+{
+    if (!a.high && !b.high)
+    {
+        quotient = a.low/b.low;
+        remainder = a.low%b.low;
+        return;
+    }
+    quotient = remainder = 0;
+    for (int bit = 127; bit >= 0; --bit)
+    {
+        remainder = (remainder << 1) + ((a >> bit).low & 1);
+        if (remainder >= b)
+        {
+            remainder.high -= b.high + (remainder.low < b.low);
+            remainder.low -= b.low;
+            quotient = quotient + (uint128(1) << bit);
+        }
+    }
+}
+
+uint128 uint128::operator/(const uint128& b) const
+{
+    uint128 quotient, remainder;
+    divide(*this, b, quotient, remainder);
+    return(quotient);
+}
+
+uint128 uint128::operator%(const uint128& b) const
+{
+    uint128 quotient, remainder;
+    divide(*this, b, quotient, remainder);
+    return(remainder);
+}
+
+// Sets product to a*b and returns true if it overflowed
+static bool multiply_overflows(uint128 a, uint128 b, uint128* product)
+{
+    *product = a*b;
+    if (a.high && b.high)
+        return(true);
+    const uint128 high_part = multiply_wide(a.high ? a.high : b.high, a.high ? b.low : a.low);
+    return(high_part.high != 0 || multiply_wide(a.low, b.low).high + high_part.low < high_part.low);
+}
+#endif
+
+
+// Powers of ten as 128-bit integers and as the doubles nearest to them. Built on first use.
+struct PowerTable {
+    uint128 integers[UINT128_DIGITS + 1];
+    double doubles[POWER_MAX - POWER_MIN + 1];
+
+    PowerTable()
+    {
+        integers[0] = 1;
+        for (int p = 1; p <= UINT128_DIGITS; ++p)
+            integers[p] = integers[p - 1]*10;
+        char text[16];
+        for (int p = POWER_MIN; p <= POWER_MAX; ++p)
+        {
+            snprintf(text, sizeof text, "1e%d", p);
+            doubles[p - POWER_MIN] = strtod(text, nullptr);
+        }
+    }
+};
+
+static const PowerTable& powers()
+{
+    static const PowerTable table;
+    return(table);
+}
+
+
+// Returns the number of decimal digits of m, 1 for 0. The bit length gives the count to within one.
+static int count_digits(uint128 m)
+{
+    const uint64_t high = (uint64_t)(m >> 64), low = (uint64_t)m;
+    const int bits = high ? 128 - __builtin_clzll(high) : (low ? 64 - __builtin_clzll(low) : 1);
+    const int estimate = (bits*1233) >> 12;
+    return(std::max(estimate + (m >= powers().integers[estimate]), 1));
+}
+
+
+// Rounds m*10^exponent to digits digits, halves away from zero as results are rounded by hand in regulated work
+static void round_to(uint128& m, int& exponent, int digits)
+{
+    const int drop = count_digits(m) - digits;
+    if (drop <= 0)
+        return;
+    // Most coefficients fit in 64 bits, where division is a single instruction
+    const uint128 unit = powers().integers[drop];
+    uint128 q;
+    if ((uint64_t)(m >> 64) == 0)
+    {
+        const uint64_t small = (uint64_t)m, small_unit = (uint64_t)unit;
+        q = small/small_unit + (small%small_unit >= small_unit/2);
+    }
+    else
+        q = m/unit + (m%unit >= unit/2);
+    exponent += drop;
+    if (q == powers().integers[digits])
+    {
+        q /= 10;
+        ++exponent;
+    }
+    m = q;
+}
+
+
+static Decimal nan_decimal()
+{
+    return(Decimal{0, 0, false, true});
+}
+
+
+// Builds a decimal from a string of decimal digits, which may be longer than any coefficient. Digits past the 38 a coefficient can hold cannot change the rounding to fewer digits, so they are dropped.
+static Decimal from_digits(bool negative, const std::string& digits, int exponent)
+{
+    size_t first = digits.find_first_not_of('0');
+    if (first == std::string::npos)
+        return(Decimal{0, 0, negative, false});
+    const size_t end = std::min(digits.size(), first + UINT128_DIGITS);
+    uint128 m = 0;
+    for (size_t d = first; d != end; ++d)
+        m = m*10 + (digits[d] - '0');
+    exponent += (int)(digits.size() - end);
+    round_to(m, exponent, DECIMAL_DIGITS);
+    return(Decimal{m, exponent, negative, false});
+}
+
+
+// Appends the decimal digits of m to text
+static void append_digits(std::string& text, uint128 m)
+{
+    char digits[UINT128_DIGITS + 2];
+    char* d = digits + sizeof digits;
+    *--d = '\0';
+    do
+    {
+        *--d = (char)('0' + (int)(uint64_t)(m%10));
+        m /= 10;
+    } while (m);
+    text += d;
+}
+
+
+// Natural numbers of any size, for the operations whose operands are too big for 128 bits. Limbs hold nine decimal digits each, least significant first.
+struct BigNatural {
+    std::vector<uint32_t> limbs;
+
+    explicit BigNatural(uint128 m = 0)
+    {
+        while (m)
+        {
+            limbs.push_back((uint32_t)(uint64_t)(m%1000000000));
+            m /= 1000000000;
+        }
+    }
+
+    BigNatural operator*(const BigNatural& b) const
+    {
+        BigNatural product;
+        product.limbs.assign(limbs.size() + b.limbs.size(), 0);
+        for (size_t i = 0; i != limbs.size(); ++i)
+        {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < b.limbs.size() || carry; ++j)
+            {
+                uint64_t sum = product.limbs[i + j] + carry + (j < b.limbs.size() ? (uint64_t)limbs[i]*b.limbs[j] : 0);
+                product.limbs[i + j] = (uint32_t)(sum%1000000000);
+                carry = sum/1000000000;
+            }
+        }
+        product.trim();
+        return(product);
+    }
+
+    // Sets this to this*10 + digit
+    void shift_in(int digit)
+    {
+        uint64_t carry = digit;
+        for (uint32_t& limb: limbs)
+        {
+            uint64_t value = (uint64_t)limb*10 + carry;
+            limb = (uint32_t)(value%1000000000);
+            carry = value/1000000000;
+        }
+        if (carry)
+            limbs.push_back((uint32_t)carry);
+    }
+
+    bool operator<(const BigNatural& b) const
+    {
+        if (limbs.size() != b.limbs.size())
+            return(limbs.size() < b.limbs.size());
+        for (size_t i = limbs.size(); i-- != 0; )
+            if (limbs[i] != b.limbs[i])
+                return(limbs[i] < b.limbs[i]);
+        return(false);
+    }
+
+    // Subtracts b, which must not be greater
+    void subtract(const BigNatural& b)
+    {
+        int64_t borrow = 0;
+        for (size_t i = 0; i != limbs.size(); ++i)
+        {
+            int64_t value = (int64_t)limbs[i] - borrow - (i < b.limbs.size() ? b.limbs[i] : 0);
+            borrow = value < 0;
+            limbs[i] = (uint32_t)(value + (borrow ? 1000000000 : 0));
+        }
+        trim();
+    }
+
+    void trim()
+    {
+        while (!limbs.empty() && limbs.back() == 0)
+            limbs.pop_back();
+    }
+
+    std::string digits() const
+    {
+        if (limbs.empty())
+            return("0");
+        std::string text = std::to_string(limbs.back());
+        char limb[16];
+        for (size_t i = limbs.size() - 1; i-- != 0; )
+        {
+            snprintf(limb, sizeof limb, "%09u", (unsigned)limbs[i]);
+            text += limb;
+        }
+        return(text);
+    }
+};
+
+
+InputState parse_decimal(const char* text, Decimal& value)
+{
+    const char* c = text + strspn(text, " \t");
+    if (*c == '\0')
+        return(input_empty);
+    const bool negative = (*c == '-');
+    c += (*c == '-' || *c == '+');
+
+    std::string digits;
+    int exponent = 0;
+    bool point = false;
+    for (; isdigit((unsigned char)*c) || (*c == '.' && !point); ++c)
+    {
+        if (*c == '.')
+            point = true;
+        else
+        {
+            digits += *c;
+            exponent -= point;
+        }
+    }
+    if (digits.empty())
+        return(input_invalid);
+    if (*c == 'e' || *c == 'E')
+    {
+        char* end;
+        const long power = strtol(c + 1, &end, 10);
+        if (end == c + 1 || power > 100000 || power < -100000)
+            return(input_invalid);
+        exponent += (int)power;
+        c = end;
+    }
+    if (c[strspn(c, " \t\r")] != '\0')
+        return(input_invalid);
+    value = from_digits(negative, digits, exponent);
+    return(input_parsed);
+}
+
+
+Decimal decimal_from_double(double value, int digits)
+{
+    if (!std::isfinite(value))
+        return(nan_decimal());
+    if (value == 0)
+        return(Decimal{0, 0, std::signbit(value), false});
+
+    // Scaling by a power of ten and rounding errs by under a third of a unit in the last place for up to 15 digits, so the nearest integer is the decimal digits exactly
+    const double magnitude = std::fabs(value);
+    if (digits >= 1 && digits <= DOUBLE_EXACT_DIGITS)
+    {
+        // The binary exponent puts the leading decimal digit at leading or one above
+        uint64_t bits;
+        memcpy(&bits, &magnitude, sizeof bits);
+        const int binary_exponent = (int)(bits >> 52) - 1023;
+        int leading = (bits >> 52) ? (int)std::floor(binary_exponent*0.30102999566398120) : (int)std::floor(std::log10(magnitude));
+        for (int attempt = 0; attempt != 2; ++attempt)
+        {
+            const int scale = digits - 1 - leading;
+            if (std::abs(scale) > POWER_MAX)
+                break;
+            const double scaled = (scale >= 0) ? magnitude*powers().doubles[scale - POWER_MIN] : magnitude/powers().doubles[-scale - POWER_MIN];
+            const uint64_t m = (uint64_t)std::llround(scaled);
+            if (m >= (uint64_t)powers().integers[digits])
+                ++leading;
+            else if (m < (uint64_t)powers().integers[digits - 1])
+                --leading;
+            else
+                return(Decimal{m, -scale, value < 0, false});
+        }
+    }
+
+    char text[48];
+    snprintf(text, sizeof text, "%.*e", std::min(std::max(digits, 1), 17) - 1, value);
+    Decimal decimal;
+    parse_decimal(text, decimal);
+    return(decimal);
+}
+
+
+double decimal_to_double(const Decimal& value)
+{
+    if (value.nan)
+        return(NAN);
+
+    // A coefficient and power of ten that are both exact doubles give the nearest double in one operation
+    const double sign = value.negative ? -1 : 1;
+    if (value.coefficient < ((uint128)1 << 53) && value.exponent >= -22 && value.exponent <= 22)
+    {
+        const double m = (double)(uint64_t)value.coefficient;
+        const double power = powers().doubles[std::abs(value.exponent) - POWER_MIN];
+        return(sign*(value.exponent >= 0 ? m*power : m/power));
+    }
+    std::string text;
+    append_digits(text, value.coefficient);
+    text += "e" + std::to_string(value.exponent);
+    return(sign*strtod(text.c_str(), nullptr));
+}
+
+
+Decimal decimal_round(const Decimal& value, int digits)
+{
+    Decimal rounded = value;
+    if (!value.nan)
+        round_to(rounded.coefficient, rounded.exponent, digits);
+    return(rounded);
+}
+
+
+Decimal decimal_multiply(const Decimal& a, const Decimal& b)
+{
+    if (a.nan || b.nan)
+        return(nan_decimal());
+    uint128 product;
+    int exponent = a.exponent + b.exponent;
+    if (!multiply_overflows(a.coefficient, b.coefficient, &product))
+    {
+        round_to(product, exponent, DECIMAL_DIGITS);
+        return(Decimal{product, exponent, a.negative != b.negative, false});
+    }
+    INSTRUMENT_COUNT("decimal_fallback", 1);
+    return(from_digits(a.negative != b.negative, (BigNatural(a.coefficient)*BigNatural(b.coefficient)).digits(), exponent));
+}
+
+
+Decimal decimal_divide(const Decimal& a, const Decimal& b)
+{
+    if (a.nan || b.nan || b.coefficient == 0)
+        return(nan_decimal());
+    const bool negative = a.negative != b.negative;
+    if (a.coefficient == 0)
+        return(Decimal{0, 0, negative, false});
+
+    // The dividend is scaled so the quotient has more digits than are kept; the remainder cannot change the rounding
+    const int scale = DECIMAL_DIGITS + count_digits(b.coefficient) - count_digits(a.coefficient) + 1;
+    const int exponent = a.exponent - b.exponent - scale;
+    uint128 dividend;
+    if (scale >= 0 && scale <= UINT128_DIGITS && !multiply_overflows(a.coefficient, powers().integers[scale], &dividend))
+    {
+        uint128 quotient = dividend/b.coefficient;
+        int quotient_exponent = exponent;
+        round_to(quotient, quotient_exponent, DECIMAL_DIGITS);
+        return(Decimal{quotient, quotient_exponent, negative, false});
+    }
+
+    // Long division one digit at a time
+    INSTRUMENT_COUNT("decimal_fallback", 1);
+    const BigNatural divisor(b.coefficient);
+    std::string digits, quotient;
+    append_digits(digits, a.coefficient);
+    digits.append(std::max(scale, 0), '0');
+    BigNatural remainder;
+    for (char d: digits)
+    {
+        remainder.shift_in(d - '0');
+        char q = '0';
+        while (!(remainder < divisor))
+        {
+            remainder.subtract(divisor);
+            ++q;
+        }
+        quotient += q;
+    }
+    return(from_digits(negative, quotient, exponent - std::min(scale, 0)));
+}
+
+
+void format_decimal(char* text, size_t size, const Decimal& value, int sig_figs)
+{
+    if (value.nan)
+    {
+        snprintf(text, size, "nan");
+        return;
+    }
+
+    // The digits, padded with zeros to sig_figs digits or stripped of trailing zeros, and the power of ten of the first
+    std::string digits;
+    append_digits(digits, value.coefficient);
+    const int leading = (value.coefficient == 0) ? 0 : value.exponent + (int)digits.size() - 1;
+    int exponent;
+    const bool all = (sig_figs <= 0);
+    const Decimal rounded = all ? value : decimal_round(value, sig_figs);
+    digits.clear();
+    append_digits(digits, rounded.coefficient);
+    exponent = rounded.exponent + (int)digits.size() - 1;
+    if (rounded.coefficient == 0)
+        exponent = 0;
+    if (all)
+    {
+        while (digits.size() > 1 && digits.back() == '0')
+            digits.pop_back();
+        sig_figs = DECIMAL_DIGITS;
+    }
+    else
+        digits.resize(sig_figs, '0');
+
+    std::string out = value.negative ? "-" : "";
+    // As with printf, whole numbers are chosen by the value before rounding and exponent notation by the value after it
+    if (!all && leading >= sig_figs && leading < 15)
+        out += digits + std::string(std::max(exponent + 1 - (int)digits.size(), 0), '0');
+    else if (exponent < -4 || exponent >= sig_figs)
+    {
+        char power[16];
+        snprintf(power, sizeof power, "e%c%02d", exponent < 0 ? '-' : '+', std::abs(exponent));
+        // A single figure needs no point, as in "1e-06"
+        out += digits.substr(0, 1);
+        if (digits.size() > 1)
+            out += "." + digits.substr(1);
+        out += power;
+    }
+    else
+    {
+        if (exponent < 0)
+            out += "0." + std::string(-exponent - 1, '0') + digits;
+        else
+        {
+            digits.resize(std::max(digits.size(), (size_t)exponent + 1), '0');
+            out += digits.substr(0, exponent + 1) + "." + digits.substr(exponent + 1);
+        }
+        // A trailing point only matters after significant zeros, as in "120."
+        const size_t length = out.size();
+        if (out[length - 1] == '.' && (all || out[length - 2] != '0' || rounded.coefficient == 0))
+            out.resize(length - 1);
+    }
+    snprintf(text, size, "%s", out.c_str());
+}
+
+
+Decimal solve_decimal(long target, MolesSource source, const Decimal values[ROWS], Decimal& moles)
+{
+    switch (source)
+    {
+    case from_mass:
+        moles = decimal_divide(values[0], values[1]);
+        break;
+    case from_volume:
+        moles = decimal_multiply(values[3], values[4]);
+        break;
+    case from_moles:
+        moles = values[2];
+        break;
+    default:
+        moles = nan_decimal();
+        return(moles);
+    }
+
+    switch (target)
+    {
+    case 0:
+        return(decimal_multiply(moles, values[1]));
+    case 1:
+        return(decimal_divide(values[0], moles));
+    case 3:
+        return(decimal_divide(moles, values[4]));
+    case 4:
+        return(decimal_divide(moles, values[3]));
+    default:
+        return(moles);
+    }
+}
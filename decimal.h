@@ -0,0 +1,75 @@
+// Exact decimal arithmetic: typed values and unit factors held as decimal numbers, so results round the way they would on paper instead of carrying binary floating-point artifacts.
+
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include "calculator.h"
+
+// Constants: significant digits every decimal operation rounds its result to, halves away from zero. A product of two such numbers, or a dividend scaled for a quotient of this many digits, fits in 128 bits for the divisors typed in practice.
+#define DECIMAL_DIGITS 20
+
+// Constants: significant digits that tell every double apart, for values whose typed figures are not known
+#define DECIMAL_DOUBLE_DIGITS 17
+
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 uint128;
+#else
+// An unsigned 128-bit integer of two 64-bit halves, for targets without one such as 32-bit MinGW. It has the operations decimal.cpp uses, and wraps as unsigned integers do.
+struct uint128 {
+    uint64_t high, low;
+
+    uint128(uint64_t value = 0): high(0), low(value) {}
+
+    explicit operator uint64_t() const { return(low); }
+    explicit operator bool() const { return(high || low); }
+
+    uint128 operator+(const uint128& b) const;
+    uint128 operator*(const uint128& b) const;
+    uint128 operator/(const uint128& b) const;
+    uint128 operator%(const uint128& b) const;
+    uint128 operator<<(int bits) const;
+    uint128 operator>>(int bits) const;
+    uint128& operator/=(const uint128& b) { return(*this = *this/b); }
+
+    bool operator==(const uint128& b) const { return(high == b.high && low == b.low); }
+    bool operator!=(const uint128& b) const { return(!(*this == b)); }
+    bool operator<(const uint128& b) const { return(high != b.high ? high < b.high : low < b.low); }
+    bool operator>=(const uint128& b) const { return(!(*this < b)); }
+};
+#endif
+
+// A decimal number (-1)^negative*coefficient*10^exponent. Division by zero and text that is not a number give nan.
+struct Decimal {
+    uint128 coefficient;
+    int exponent;
+    bool negative;
+    bool nan;
+};
+
+// Parses text as parse_value does, but exactly. Values with more than DECIMAL_DIGITS digits are rounded.
+InputState parse_decimal(const char* text, Decimal& value);
+
+// Returns the decimal with digits significant digits nearest to value. Up to 15 digits this is exactly the decimal that was parsed into value, so typed values are recovered from the batch columns without their text.
+Decimal decimal_from_double(double value, int digits);
+
+// Returns the double nearest to value.
+double decimal_to_double(const Decimal& value);
+
+// Returns value rounded to digits significant digits, halves away from zero.
+Decimal decimal_round(const Decimal& value, int digits);
+
+// Returns a*b and a/b rounded to DECIMAL_DIGITS digits. Operands whose product or scaled dividend overflows 128 bits are worked out in arbitrary precision instead.
+Decimal decimal_multiply(const Decimal& a, const Decimal& b);
+Decimal decimal_divide(const Decimal& a, const Decimal& b);
+
+// Writes value into text the way format_sig_figs writes a double with sig_figs significant figures, or with all its digits as "%.20g" would if sig_figs is 0.
+void format_decimal(char* text, size_t size, const Decimal& value, int sig_figs);
+
+// Calculates target from values with a relation taking the amount of substance from source, as solve does, and stores that amount in moles. Only the operations of that relation are done.
+Decimal solve_decimal(long target, MolesSource source, const Decimal values[ROWS], Decimal& moles);
+
+
+#endif /* DECIMAL_H */
@@ -0,0 +1,593 @@
+#include <cstring>
+#include "deflate.h"
+#include "parallel.h"
+
+
+// Constants: base values and extra bits of the length codes 257-285 and the distance codes 0-29
+static const unsigned short length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Constants: order in which the lengths of the code length code are stored in a dynamic block header
+static const unsigned char code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Constants: shortest and longest match, and the size of the match hash table
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define HASH_BITS 15
+
+
+void Deflater::put_bits(unsigned long long value, int count, std::vector<unsigned char>& out)
+{
+    bit_buffer |= value << bit_count;
+    bit_count += count;
+    while (bit_count >= 8)
+    {
+        out.push_back((unsigned char)bit_buffer);
+        bit_buffer >>= 8;
+        bit_count -= 8;
+    }
+}
+
+
+// Huffman codes are defined most significant bit first, but packed into bytes starting at the least significant bit
+void Deflater::put_huffman(unsigned code, int length, std::vector<unsigned char>& out)
+{
+    unsigned reversed = 0;
+    for (int b = 0; b != length; ++b)
+        reversed |= ((code >> b) & 1) << (length - 1 - b);
+    put_bits(reversed, length, out);
+}
+
+
+// Writes a literal/length symbol with the fixed codes of RFC 1951 section 3.2.6
+void Deflater::put_literal(unsigned value, std::vector<unsigned char>& out)
+{
+    if (value < 144)
+        put_huffman(0x30 + value, 8, out);
+    else if (value < 256)
+        put_huffman(0x190 + value - 144, 9, out);
+    else if (value < 280)
+        put_huffman(value - 256, 7, out);
+    else
+        put_huffman(0xc0 + value - 280, 8, out);
+}
+
+
+void Deflater::put_match(unsigned length, unsigned distance, std::vector<unsigned char>& out)
+{
+    int l = 28;
+    while (length_base[l] > length)
+        --l;
+    put_literal(257 + l, out);
+    put_bits(length - length_base[l], length_extra[l], out);
+
+    int d = 29;
+    while (distance_base[d] > distance)
+        --d;
+    put_huffman(d, 5, out);
+    put_bits(distance - distance_base[d], distance_extra[d], out);
+}
+
+
+void Deflater::compress(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out)
+{
+    put_bits(final ? 1 : 0, 1, out);
+    put_bits(1, 2, out); // Fixed Huffman codes
+
+    // Greedy matching over hash chains of the three bytes at each position
+    std::vector<int> head(1 << HASH_BITS, -1);
+    std::vector<int> previous(size);
+    auto hash = [data](size_t i) {
+        return((((unsigned)data[i] << 10) ^ ((unsigned)data[i + 1] << 5) ^ data[i + 2]) & ((1 << HASH_BITS) - 1));
+    };
+    auto insert = [&](size_t i) {
+        if (i + MIN_MATCH <= size)
+        {
+            unsigned h = hash(i);
+            previous[i] = head[h];
+            head[h] = (int)i;
+        }
+    };
+
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t best_length = 0, best_distance = 0;
+        if (i + MIN_MATCH <= size)
+        {
+            const size_t longest = (size - i < MAX_MATCH) ? size - i : MAX_MATCH;
+            int candidate = head[hash(i)];
+            for (int chain = 0; candidate >= 0 && chain != DEFLATE_CHAIN && i - candidate <= DEFLATE_WINDOW; ++chain)
+            {
+                size_t length = 0;
+                while (length != longest && data[candidate + length] == data[i + length])
+                    ++length;
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = i - candidate;
+                    if (length == longest)
+                        break;
+                }
+                candidate = previous[candidate];
+            }
+        }
+
+        if (best_length >= MIN_MATCH)
+        {
+            put_match((unsigned)best_length, (unsigned)best_distance, out);
+            for (size_t end = i + best_length; i != end; ++i)
+                insert(i);
+        }
+        else
+        {
+            put_literal(data[i], out);
+            insert(i);
+            ++i;
+        }
+    }
+
+    put_literal(256, out); // End of block
+    if (final && bit_count)
+        put_bits(0, 8 - bit_count, out);
+}
+
+
+void Deflater::flush(std::vector<unsigned char>& out)
+{
+    put_bits(0, 3, out); // Stored block, not final
+    if (bit_count)
+        put_bits(0, 8 - bit_count, out);
+    static const unsigned char empty_length[4] = {0x00, 0x00, 0xff, 0xff}; // Length 0 and its complement
+    out.insert(out.end(), empty_length, empty_length + 4);
+}
+
+
+Inflater::Inflater(FILE* in, unsigned long long in_size)
+    : in(in), in_left(in_size), input_position(0), input_end(0), bit_buffer(0), bit_count(0), window(DEFLATE_WINDOW)
+{
+    restart();
+}
+
+
+void Inflater::restart()
+{
+    out_total = 0;
+    state = block_start;
+    last_block = false;
+    error = false;
+    stored_left = 0;
+    copy_length = copy_distance = 0;
+}
+
+
+bool Inflater::fetch_byte(unsigned char& byte)
+{
+    if (input_position == input_end)
+    {
+        size_t wanted = (in_left < sizeof input) ? (size_t)in_left : sizeof input;
+        input_end = wanted ? fread(input, 1, wanted, in) : 0;
+        input_position = 0;
+        in_left -= input_end;
+        if (!input_end)
+            return(false);
+    }
+    byte = input[input_position++];
+    return(true);
+}
+
+
+// Makes sure count bits are in the bit buffer; returns false if the input ends first
+bool Inflater::need_bits(int count)
+{
+    unsigned char byte;
+    while (bit_count < count)
+    {
+        if (!fetch_byte(byte))
+            return(false);
+        bit_buffer |= (unsigned long long)byte << bit_count;
+        bit_count += 8;
+    }
+    return(true);
+}
+
+
+unsigned Inflater::take_bits(int count)
+{
+    unsigned value = (unsigned)(bit_buffer & ((1ull << count) - 1));
+    bit_buffer >>= count;
+    bit_count -= count;
+    return(value);
+}
+
+
+// Builds the decoding tables of a code from the code length of each symbol. Returns false if the lengths describe too many codes.
+bool Inflater::build(Huffman& huffman, const unsigned char* lengths, int count)
+{
+    memset(huffman.counts, 0, sizeof huffman.counts);
+    memset(huffman.fast, 0, sizeof huffman.fast);
+    for (int symbol = 0; symbol != count; ++symbol)
+        ++huffman.counts[lengths[symbol]];
+    huffman.counts[0] = 0;
+
+    short offsets[16];
+    int left = 1;
+    offsets[1] = 0;
+    for (int length = 1; length != 16; ++length)
+    {
+        left = (left << 1) - huffman.counts[length];
+        if (left < 0)
+            return(false);
+        if (length != 15)
+            offsets[length + 1] = offsets[length] + huffman.counts[length];
+    }
+
+    // Codes are assigned in order of length, then symbol (RFC 1951 section 3.2.2)
+    unsigned next_code[16];
+    unsigned code = 0;
+    for (int length = 1; length != 16; ++length)
+    {
+        code = (code + huffman.counts[length - 1]) << 1;
+        next_code[length] = code;
+    }
+    for (int symbol = 0; symbol != count; ++symbol)
+    {
+        const int length = lengths[symbol];
+        if (!length)
+            continue;
+        huffman.symbols[offsets[length]++] = (short)symbol;
+        const unsigned assigned = next_code[length]++;
+        if (length > INFLATE_FAST_BITS)
+            continue;
+        unsigned reversed = 0;
+        for (int b = 0; b != length; ++b)
+            reversed |= ((assigned >> b) & 1) << (length - 1 - b);
+        for (unsigned entry = reversed; entry < (1u << INFLATE_FAST_BITS); entry += 1u << length)
+            huffman.fast[entry] = (unsigned short)((symbol << 4) | length);
+    }
+    return(true);
+}
+
+
+// Returns the next symbol of a code, or -1 if the input is damaged or ends
+int Inflater::decode(const Huffman& huffman)
+{
+    need_bits(INFLATE_FAST_BITS); // Near the end of the input fewer bits may be left, which the slow path handles
+    const unsigned entry = huffman.fast[bit_buffer & ((1u << INFLATE_FAST_BITS) - 1)];
+    if (entry && (int)(entry & 15) <= bit_count)
+    {
+        take_bits(entry & 15);
+        return(entry >> 4);
+    }
+
+    int code = 0, first = 0, index = 0;
+    for (int length = 1; length != 16; ++length)
+    {
+        if (!need_bits(1))
+            return(-1);
+        code |= (int)take_bits(1);
+        const int count = huffman.counts[length];
+        if (code - count < first)
+            return(huffman.symbols[index + (code - first)]);
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return(-1);
+}
+
+
+void Inflater::start_block()
+{
+    if (!need_bits(3))
+    {
+        error = true;
+        return;
+    }
+    last_block = take_bits(1);
+    const unsigned type = take_bits(2);
+    if (type == 0)
+    {
+        take_bits(bit_count % 8);
+        if (!need_bits(32))
+        {
+            error = true;
+            return;
+        }
+        const unsigned length = take_bits(16), complement = take_bits(16);
+        error = (length != (~complement & 0xffff));
+        stored_left = length;
+        state = stored_block;
+        return;
+    }
+
+    unsigned char lengths[320];
+    int literal_count = 288, distance_count = 30;
+    if (type == 1)
+    {
+        // Fixed codes of RFC 1951 section 3.2.6
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        memset(lengths + 288, 5, 30);
+    }
+    else if (type == 2)
+    {
+        if (!need_bits(14))
+        {
+            error = true;
+            return;
+        }
+        literal_count = take_bits(5) + 257;
+        distance_count = take_bits(5) + 1;
+        const int length_count = take_bits(4) + 4;
+        unsigned char code_lengths[19] = {0};
+        for (int i = 0; i != length_count; ++i)
+        {
+            if (!need_bits(3))
+            {
+                error = true;
+                return;
+            }
+            code_lengths[code_length_order[i]] = (unsigned char)take_bits(3);
+        }
+        Huffman length_code;
+        if (literal_count > 286 || distance_count > 30 || !build(length_code, code_lengths, 19))
+        {
+            error = true;
+            return;
+        }
+
+        // Literal/length and distance code lengths, run length coded with symbols 16-18
+        int i = 0;
+        while (i < literal_count + distance_count)
+        {
+            int symbol = decode(length_code);
+            int repeat = 0, value = 0;
+            if (symbol < 0)
+            {
+                error = true;
+                return;
+            }
+            if (symbol < 16)
+            {
+                lengths[i++] = (unsigned char)symbol;
+                continue;
+            }
+            if (symbol == 16)
+            {
+                if (i == 0 || !need_bits(2))
+                {
+                    error = true;
+                    return;
+                }
+                value = lengths[i - 1];
+                repeat = 3 + take_bits(2);
+            }
+            else
+            {
+                const int extra = (symbol == 17) ? 3 : 7;
+                if (!need_bits(extra))
+                {
+                    error = true;
+                    return;
+                }
+                repeat = ((symbol == 17) ? 3 : 11) + take_bits(extra);
+            }
+            if (i + repeat > literal_count + distance_count)
+            {
+                error = true;
+                return;
+            }
+            memset(lengths + i, value, repeat);
+            i += repeat;
+        }
+        memmove(lengths + 288, lengths + literal_count, distance_count);
+        memset(lengths + literal_count, 0, 288 - literal_count);
+    }
+    else
+    {
+        error = true;
+        return;
+    }
+
+    if (!build(literals, lengths, 288) || !build(distances, lengths + 288, distance_count))
+    {
+        error = true;
+        return;
+    }
+    state = huffman_block;
+}
+
+
+size_t Inflater::read(unsigned char* out, size_t size)
+{
+    const size_t window_mask = DEFLATE_WINDOW - 1;
+    size_t n = 0;
+    while (n != size && !error)
+    {
+        if (copy_length)
+        {
+            // A match may overlap the bytes it produces, so it is copied a byte at a time
+            while (copy_length && n != size)
+            {
+                const unsigned char byte = window[(out_total - copy_distance) & window_mask];
+                window[out_total++ & window_mask] = byte;
+                out[n++] = byte;
+                --copy_length;
+            }
+            continue;
+        }
+
+        if (state == stream_end)
+            break;
+        if (state == block_start)
+        {
+            if (last_block)
+                state = stream_end;
+            else
+                start_block();
+            continue;
+        }
+        if (state == stored_block)
+        {
+            unsigned char byte;
+            if (!stored_left)
+                state = block_start;
+            else if (bit_count)
+            {
+                out[n++] = window[out_total++ & window_mask] = (unsigned char)take_bits(8);
+                --stored_left;
+            }
+            else if (fetch_byte(byte))
+            {
+                out[n++] = window[out_total++ & window_mask] = byte;
+                --stored_left;
+            }
+            else
+                error = true;
+            continue;
+        }
+
+        const int symbol = decode(literals);
+        if (symbol < 0)
+            error = true;
+        else if (symbol < 256)
+            out[n++] = window[out_total++ & window_mask] = (unsigned char)symbol;
+        else if (symbol == 256)
+            state = block_start;
+        else
+        {
+            // The extra bits of the length come before the distance code
+            const int l = symbol - 257;
+            if (l >= 29 || !need_bits(length_extra[l]))
+            {
+                error = true;
+                continue;
+            }
+            copy_length = length_base[l] + take_bits(length_extra[l]);
+            const int d = decode(distances);
+            if (d < 0 || d >= 30 || !need_bits(distance_extra[d]))
+            {
+                error = true;
+                continue;
+            }
+            copy_distance = distance_base[d] + take_bits(distance_extra[d]);
+            error = (copy_distance > out_total);
+        }
+    }
+    return(n);
+}
+
+
+int Inflater::next_byte()
+{
+    take_bits(bit_count % 8);
+    if (bit_count)
+        return((int)take_bits(8));
+    unsigned char byte;
+    return(fetch_byte(byte) ? byte : -1);
+}
+
+
+unsigned long adler32(unsigned long adler, const unsigned char* data, size_t size)
+{
+    unsigned long a = adler & 0xffff, b = (adler >> 16) & 0xffff;
+    while (size)
+    {
+        // 5552 bytes is the most that can be summed before b may overflow 32 bits
+        size_t run = (size < 5552) ? size : 5552;
+        size -= run;
+        while (run--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return((b << 16) | a);
+}
+
+
+// Table driven, eight bytes at a time ("slicing by 8"): entries[k][n] is the CRC of byte n followed by k zero bytes
+unsigned long crc32(unsigned long crc, const unsigned char* data, size_t size)
+{
+    struct Table {
+        unsigned long entries[8][256];
+        Table()
+        {
+            for (unsigned long n = 0; n != 256; ++n)
+            {
+                unsigned long c = n;
+                for (int k = 0; k != 8; ++k)
+                    c = (c & 1) ? 0xedb88320ul ^ (c >> 1) : c >> 1;
+                entries[0][n] = c;
+            }
+            for (unsigned long n = 0; n != 256; ++n)
+                for (int k = 1; k != 8; ++k)
+                    entries[k][n] = entries[0][entries[k - 1][n] & 0xff] ^ (entries[k - 1][n] >> 8);
+        }
+    };
+    static const Table table;
+
+    crc = ~crc & 0xfffffffful;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        const unsigned long low = crc ^ ((unsigned long)data[0] | (unsigned long)data[1] << 8 | (unsigned long)data[2] << 16 | (unsigned long)data[3] << 24);
+        crc = table.entries[7][low & 0xff] ^ table.entries[6][(low >> 8) & 0xff] ^ table.entries[5][(low >> 16) & 0xff] ^ table.entries[4][low >> 24] ^
+              table.entries[3][data[4]] ^ table.entries[2][data[5]] ^ table.entries[1][data[6]] ^ table.entries[0][data[7]];
+    }
+    while (size--)
+        crc = table.entries[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return(~crc & 0xfffffffful);
+}
+
+
+void zlib_compress(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+{
+    out.push_back(0x78); // Deflate with a 32K window
+    out.push_back(0x01); // No dictionary, fastest level; makes the header a multiple of 31
+    Deflater deflater;
+    deflater.compress(data, size, true, out);
+    unsigned long adler = adler32(1, data, size);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((unsigned char)(adler >> shift));
+}
+
+
+void deflate_parallel(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out)
+{
+    const size_t count = (size + DEFLATE_PIECE - 1)/DEFLATE_PIECE;
+    if (!count)
+    {
+        if (final)
+            Deflater().compress(data, 0, true, out);
+        return;
+    }
+
+    std::vector<std::vector<unsigned char>> pieces(count);
+    parallel_for(count, [&](size_t p) {
+        const size_t first = p*DEFLATE_PIECE;
+        const bool last = final && p + 1 == count;
+        Deflater deflater;
+        deflater.compress(data + first, std::min<size_t>(DEFLATE_PIECE, size - first), last, pieces[p]);
+        if (!last)
+            deflater.flush(pieces[p]);
+    });
+    for (auto& piece: pieces)
+        out.insert(out.end(), piece.begin(), piece.end());
+}
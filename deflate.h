@@ -0,0 +1,103 @@
+// Deflate compression and decompression (RFC 1951) with the zlib wrapper (RFC 1950) and the checksums used by the file formats read and written in batch mode.
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// Constants: longest distance searched back for a match, and how many earlier positions are tried per byte
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_CHAIN 32
+
+// Constants: bytes compressed per parallel task by deflate_parallel, and bytes of compressed input read at a time by Inflater
+#define DEFLATE_PIECE 262144
+#define INFLATE_INPUT 65536
+
+// Constants: bits of a Huffman code looked up at once by Inflater; longer codes are decoded a bit at a time
+#define INFLATE_FAST_BITS 9
+
+
+// Compresses a stream given in pieces. Each call to compress emits whole blocks with the fixed Huffman codes, so output can be written as soon as it is produced. Matches are only searched within one piece, which keeps memory bounded by the piece size.
+class Deflater {
+    unsigned long long bit_buffer;
+    int bit_count;
+
+    void put_bits(unsigned long long value, int count, std::vector<unsigned char>& out);
+    void put_huffman(unsigned code, int length, std::vector<unsigned char>& out);
+    void put_literal(unsigned value, std::vector<unsigned char>& out);
+    void put_match(unsigned length, unsigned distance, std::vector<unsigned char>& out);
+
+public:
+    Deflater() : bit_buffer(0), bit_count(0) {}
+
+    // Appends the compressed form of size bytes of data to out. final must be set on the last piece, after which the stream is complete and byte aligned.
+    void compress(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out);
+
+    // Appends an empty stored block, which ends the output so far on a byte boundary. Output that ends this way can be followed by that of another Deflater.
+    void flush(std::vector<unsigned char>& out);
+};
+
+
+// Decompresses a deflate stream read from a file, as much as is asked for at a time, keeping only the 32K window of earlier output.
+class Inflater {
+    // Canonical Huffman code: the number of codes of each length, the symbols in code order, and a table of the codes of up to INFLATE_FAST_BITS bits holding (symbol << 4) | length, or 0 for longer codes
+    struct Huffman {
+        short counts[16];
+        short symbols[288];
+        unsigned short fast[1 << INFLATE_FAST_BITS];
+    };
+
+    FILE* in;
+    unsigned long long in_left;         // Bytes of the file that belong to the stream
+    unsigned char input[INFLATE_INPUT];
+    size_t input_position, input_end;
+    unsigned long long bit_buffer;
+    int bit_count;
+    std::vector<unsigned char> window;
+    unsigned long long out_total;
+    enum State {block_start, stored_block, huffman_block, stream_end} state;
+    bool last_block;
+    bool error;
+    size_t stored_left;
+    unsigned copy_length, copy_distance;
+    Huffman literals, distances;
+
+    bool fetch_byte(unsigned char& byte);
+    bool need_bits(int count);
+    unsigned take_bits(int count);
+    int decode(const Huffman& huffman);
+    bool build(Huffman& huffman, const unsigned char* lengths, int count);
+    void start_block();
+
+public:
+    // Starts decompressing from the current position of in, which must be open in binary mode, reading at most in_size bytes.
+    Inflater(FILE* in, unsigned long long in_size = ~0ull);
+
+    // Decompresses up to size bytes into out. Returns the number of bytes written, which is less than size only at the end of the stream or on an error.
+    size_t read(unsigned char* out, size_t size);
+
+    // Returns true if the stream was damaged or ended early.
+    bool failed() const { return(error); }
+
+    // Returns the next byte of the file outside a stream, before it starts or after it ends, as for the header and trailer of a gzip member, or -1 at the end of the file.
+    int next_byte();
+
+    // Starts decompressing another stream that follows the previous one.
+    void restart();
+};
+
+
+// Returns the checksums updated with size bytes of data. Start with adler32(1, ...) and crc32(0, ...).
+unsigned long adler32(unsigned long adler, const unsigned char* data, size_t size);
+unsigned long crc32(unsigned long crc, const unsigned char* data, size_t size);
+
+// Appends a complete zlib stream holding size bytes of data to out, as used by PDF and PNG.
+void zlib_compress(const unsigned char* data, size_t size, std::vector<unsigned char>& out);
+
+// Appends size bytes of data to out compressed as a continuation of a raw deflate stream. The data is split into pieces of DEFLATE_PIECE bytes that are compressed in parallel, each ending byte aligned; with final set the stream ends after this data.
+void deflate_parallel(const unsigned char* data, size_t size, bool final, std::vector<unsigned char>& out);
+
+
+#endif /* DEFLATE_H */
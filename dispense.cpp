@@ -0,0 +1,249 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include "dispense.h"
+#include "calculator.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: fields of an input line
+#define TRANSFER_FIELDS 7
+
+// Constants: heading of the dispenser transfer list
+static const char* list_header = "Source Plate Name,Source Well,Destination Plate Name,Destination Well,Transfer Volume\n";
+
+
+void plan_transfer(Transfer& t, double droplet)
+{
+    if (!t.valid)
+        return;
+    const double exact = t.molarity*t.volume/t.stock_molarity;
+    t.droplets = std::lround(exact/droplet);
+    const double transferred = t.droplets*droplet;
+    t.achieved_molarity = t.stock_molarity*transferred/t.volume;
+    t.error = (t.achieved_molarity - t.molarity)/t.molarity;
+    t.compensated_volume = t.stock_molarity*transferred/t.molarity;
+}
+
+
+// Appends a line of the transfer list, with the volume in nL
+static void list_transfer(std::string& list, const std::string& source_plate, const std::string& source_well,
+                          const std::string& destination_plate, const std::string& destination_well, double volume)
+{
+    char nanolitres[32];
+    snprintf(nanolitres, sizeof nanolitres, ",%.10g\n", volume*1e9);
+    list += source_plate + "," + source_well + "," + destination_plate + "," + destination_well + nanolitres;
+}
+
+
+void plan_plate(std::vector<Transfer>& transfers, const std::vector<size_t>& indices, double droplet,
+                const std::string& backfill_plate, const std::string& backfill_well, std::string& list)
+{
+    std::vector<size_t> order;
+    std::map<std::string, long> well_droplets;     // Ordered by well name, so backfill is listed in a fixed order
+    for (size_t i: indices)
+    {
+        Transfer& t = transfers[i];
+        plan_transfer(t, droplet);
+        if (!t.valid)
+            continue;
+        well_droplets[t.destination_well] += t.droplets;
+        if (t.droplets)
+            order.push_back(i);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const Transfer& x = transfers[a];
+        const Transfer& y = transfers[b];
+        return(x.source_plate != y.source_plate ? x.source_plate < y.source_plate : x.source_well < y.source_well);
+    });
+    for (size_t i: order)
+    {
+        const Transfer& t = transfers[i];
+        list_transfer(list, t.source_plate, t.source_well, t.destination_plate, t.destination_well, t.droplets*droplet);
+    }
+
+    if (backfill_plate.empty() || well_droplets.empty())
+        return;
+    long fullest = 0;
+    for (const auto& well: well_droplets)
+        fullest = std::max(fullest, well.second);
+    const std::string& destination_plate = transfers[indices[0]].destination_plate;
+    for (const auto& well: well_droplets)
+        if (well.second != fullest)
+            list_transfer(list, backfill_plate, backfill_well, destination_plate, well.first, (fullest - well.second)*droplet);
+}
+
+
+// Splits a line, without its newline, into its fields and parses the numbers. Returns false if it has too few fields.
+static bool parse_transfer(char* line, Transfer& t)
+{
+    char* fields[TRANSFER_FIELDS];
+    char* field = line;
+    for (int f = 0; f != TRANSFER_FIELDS; ++f)
+    {
+        size_t length = strcspn(field, ",\r\n");
+        char end = field[length];
+        field[length] = '\0';
+        fields[f] = field;
+        if (end != ',' && f != TRANSFER_FIELDS - 1)
+            return(false);
+        field += length + 1;
+    }
+
+    t.source_plate = fields[0];
+    t.source_well = fields[1];
+    t.destination_plate = fields[2];
+    t.destination_well = fields[3];
+    t.valid = parse_value(fields[4], t.stock_molarity) == input_parsed && parse_value(fields[5], t.molarity) == input_parsed &&
+              parse_value(fields[6], t.volume) == input_parsed && t.stock_molarity > 0 && t.molarity > 0 && t.volume > 0;
+    return(true);
+}
+
+
+// Returns the first TRANSFER_FIELDS fields of line as they were typed, with empty fields added if it has fewer, for lines that cannot be planned
+static std::string typed_fields(const std::string& line)
+{
+    std::string fields;
+    size_t start = 0;
+    for (int f = 0; f != TRANSFER_FIELDS; ++f)
+    {
+        const size_t end = (start < line.size()) ? std::min(line.find(',', start), line.size()) : start;
+        fields.append(f ? "," : "").append(line, start, end - start);
+        start = std::min(end + 1, line.size());
+    }
+    return(fields);
+}
+
+
+// Writes a lineage edge "source plate:well,destination plate:well" for every line of the transfer lists, backfill included, for --lineage build. Returns false if the file cannot be written.
+static bool write_lineage(const char* path, const std::vector<std::string>& lists)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return(false);
+    fputs("source,derived\n", out);
+    for (const std::string& list: lists)
+    {
+        for (size_t start = 0; start < list.size(); start = list.find('\n', start) + 1)
+        {
+            // Commas end the source plate, source well, destination plate and destination well
+            size_t commas[4];
+            for (int c = 0; c != 4; ++c)
+                commas[c] = list.find(',', c ? commas[c - 1] + 1 : start);
+            const char* text = list.c_str();
+            fprintf(out, "%.*s:%.*s,%.*s:%.*s\n", (int)(commas[0] - start), text + start, (int)(commas[1] - commas[0] - 1), text + commas[0] + 1,
+                    (int)(commas[2] - commas[1] - 1), text + commas[1] + 1, (int)(commas[3] - commas[2] - 1), text + commas[2] + 1);
+        }
+    }
+    return(fclose(out) == 0);
+}
+
+
+int dispense_main(int argc, char** argv)
+{
+    double droplet = DROPLET_NL*1e-9;
+    const char* transfers_path = nullptr;
+    const char* lineage_path = nullptr;
+    std::string backfill_plate, backfill_well;
+    bool usage = false;
+    for (int a = 2; a < argc && !usage; ++a)
+    {
+        if (strcmp(argv[a], "--droplet") == 0 && a + 1 < argc)
+            droplet = atof(argv[++a])*1e-9;
+        else if (strcmp(argv[a], "--transfers") == 0 && a + 1 < argc)
+            transfers_path = argv[++a];
+        else if (strcmp(argv[a], "--lineage") == 0 && a + 1 < argc)
+            lineage_path = argv[++a];
+        else if (strcmp(argv[a], "--backfill") == 0 && a + 2 < argc)
+        {
+            backfill_plate = argv[++a];
+            backfill_well = argv[++a];
+        }
+        else
+            usage = true;
+    }
+    if (usage || !(droplet > 0))
+    {
+        fprintf(stderr, "Usage: %s --dispense [--droplet <nL>] [--transfers <file>] [--backfill <plate> <well>] [--lineage <file>]\n", argv[0]);
+        return(2);
+    }
+
+    char line[1024];
+    if (fgets(line, sizeof line, stdin))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        printf("%s,droplets,transfer_volume,achieved_molarity,error,compensated_volume\n", line);
+    }
+
+    // Lines that cannot be split or planned are kept with their text as typed, so the output matches the input line for line
+    std::vector<Transfer> transfers;
+    std::vector<std::string> typed;
+    std::vector<std::string> plates;
+    std::unordered_map<std::string, std::vector<size_t>> plate_transfers;
+    while (fgets(line, sizeof line, stdin))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        const std::string text = line;
+        Transfer t = Transfer();
+        if (!parse_transfer(line, t) || !t.valid)
+        {
+            typed.resize(transfers.size() + 1);
+            typed.back() = typed_fields(text);
+        }
+        std::vector<size_t>& indices = plate_transfers[t.destination_plate];
+        if (indices.empty())
+            plates.push_back(t.destination_plate);
+        indices.push_back(transfers.size());
+        transfers.push_back(t);
+    }
+
+    std::vector<std::string> lists(plates.size());
+    {
+        INSTRUMENT_SCOPE("plan_plates");
+        parallel_for(plates.size(), [&](size_t p) {
+            plan_plate(transfers, plate_transfers.at(plates[p]), droplet, backfill_plate, backfill_well, lists[p]);
+        });
+    }
+
+    for (size_t i = 0; i != transfers.size(); ++i)
+    {
+        const Transfer& t = transfers[i];
+        if (i < typed.size() && !typed[i].empty())
+        {
+            printf("%s,,,,,\n", typed[i].c_str());
+            continue;
+        }
+        printf("%s,%s,%s,%s,%.15g,%.15g,%.15g,%ld,%.15g,%.15g,%.6g,%.15g\n", t.source_plate.c_str(), t.source_well.c_str(), t.destination_plate.c_str(), t.destination_well.c_str(),
+               t.stock_molarity, t.molarity, t.volume, t.droplets, t.droplets*droplet, t.achieved_molarity, t.error, t.compensated_volume);
+    }
+
+    if (transfers_path)
+    {
+        FILE* out = fopen(transfers_path, "w");
+        if (!out)
+        {
+            fprintf(stderr, "Cannot write %s\n", transfers_path);
+            return(1);
+        }
+        fputs(list_header, out);
+        for (const std::string& list: lists)
+            fputs(list.c_str(), out);
+        if (fclose(out) != 0)
+        {
+            fprintf(stderr, "Cannot write %s\n", transfers_path);
+            return(1);
+        }
+    }
+    if (lineage_path && !write_lineage(lineage_path, lists))
+    {
+        fprintf(stderr, "Cannot write %s\n", lineage_path);
+        return(1);
+    }
+    return(0);
+}
@@ -0,0 +1,38 @@
+// Acoustic dispensing: planning the droplet transfers that make up solutions in the wells of destination plates.
+
+#ifndef DISPENSE_H
+#define DISPENSE_H
+
+#include <string>
+#include <vector>
+
+// Constants: default droplet volume of the dispenser in nL
+#define DROPLET_NL 2.5
+
+
+// One requested transfer: stock from a source well making up a solution of the given molarity and final volume (L) in a destination well, and its plan.
+struct Transfer {
+    std::string source_plate, source_well, destination_plate, destination_well;
+    double stock_molarity;
+    double molarity;
+    double volume;
+    bool valid;                 // All fields parsed, with positive molarities and volume
+
+    long droplets;              // Nearest whole number of droplets to the exact volume
+    double achieved_molarity;   // In volume with the droplets transferred
+    double error;               // Relative error of achieved_molarity
+    double compensated_volume;  // Final volume that gives molarity exactly with the droplets transferred
+};
+
+// Plans t, rounding its stock volume to the nearest whole number of droplets of droplet litres, which leaves each well, and so each plate, with the least error the droplet size allows.
+void plan_transfer(Transfer& t, double droplet);
+
+// Plans the transfers to one destination plate, given by their indices in transfers, and appends the dispenser transfer list for the plate to list: compound transfers ordered by source plate and well, so each source plate is loaded once, then backfill from backfill_plate and backfill_well (if not empty) that brings every well to the same number of droplets as the fullest well, so all wells hold the same amount of solvent.
+void plan_plate(std::vector<Transfer>& transfers, const std::vector<size_t>& indices, double droplet,
+                const std::string& backfill_plate, const std::string& backfill_well, std::string& list);
+
+// Command line mode: "--dispense [--droplet <nL>] [--transfers <file>] [--backfill <plate> <well>] [--lineage <file>]" reads lines of "source plate,source well,destination plate,destination well,stock molarity,molarity,volume" (M, M, L) from standard input and writes each with its plan: droplets, transfer volume, achieved molarity, relative error and compensated volume. The first line is a header. Destination plates are planned in parallel, and the transfer list for the dispenser is written to the transfers file in nL. The lineage file records each transfer as an edge from source well to destination well, for --lineage build.
+int dispense_main(int argc, char** argv);
+
+
+#endif /* DISPENSE_H */
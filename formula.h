@@ -0,0 +1,24 @@
+// Chemical formulas: parsing into element counts and calculating molar masses from standard atomic weights.
+
+#ifndef FORMULA_H
+#define FORMULA_H
+
+#include <map>
+#include <string>
+
+// Constants: number of elements in the table of atomic weights, and the pseudo element counting charge
+#define ELEMENTS 118
+#define CHARGE_ELEMENT "+"
+
+
+// Atoms of each element in a formula unit, by symbol; charge is counted under CHARGE_ELEMENT
+typedef std::map<std::string, long> Composition;
+
+// Parses a formula such as "H2O", "Ca(OH)2", "K4[Fe(CN)6]", the hydrate "CuSO4.5H2O" (also with "*" or a middle dot) or the ion "SO4^2-" into composition. A leading coefficient is ignored. Returns false and sets error if the formula cannot be read.
+bool parse_formula(const std::string& formula, Composition& composition, std::string& error);
+
+// Returns the molar mass in g/mol of a parsed formula.
+double formula_molar_mass(const Composition& composition);
+
+
+#endif /* FORMULA_H */
@@ -0,0 +1,216 @@
+#include "gzip.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: signature and compression method of a gzip member, and its header flags
+#define GZIP_ID1 0x1f
+#define GZIP_ID2 0x8b
+#define GZIP_DEFLATE 8
+#define FLAG_HEADER_CRC 0x02
+#define FLAG_EXTRA 0x04
+#define FLAG_NAME 0x08
+#define FLAG_COMMENT 0x10
+
+
+bool is_gzip(FILE* in)
+{
+    int c = getc(in);
+    if (c != EOF)
+        ungetc(c, in);
+    return(c == GZIP_ID1);
+}
+
+
+CompressedReader::CompressedReader() : done(false), stop(false), error(false), position(0)
+{
+}
+
+
+void CompressedReader::start()
+{
+    worker = std::thread(&CompressedReader::run, this);
+}
+
+
+void CompressedReader::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+
+void CompressedReader::run()
+{
+    const bool decompressed = decompress();
+    std::lock_guard<std::mutex> lock(mutex);
+    error |= !decompressed;
+    done = true;
+    changed.notify_all();
+}
+
+
+bool CompressedReader::queue(std::vector<char>&& buffer)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return(stop || ready.size() < GZIP_QUEUE); });
+    if (stop)
+        return(false);
+    if (!buffer.empty())
+        ready.push_back(std::move(buffer));
+    changed.notify_all();
+    return(true);
+}
+
+
+char* CompressedReader::gets(char* line, int size)
+{
+    int n = 0;
+    while (n < size - 1)
+    {
+        if (position == current.size())
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return(done || !ready.empty()); });
+            if (ready.empty())
+                break;
+            current = std::move(ready.front());
+            ready.pop_front();
+            position = 0;
+            changed.notify_all();
+        }
+        const char c = current[position++];
+        line[n++] = c;
+        if (c == '\n')
+            break;
+    }
+    line[n] = '\0';
+    return(n ? line : nullptr);
+}
+
+
+GzipReader::GzipReader(FILE* in) : inflater(in)
+{
+    start();
+}
+
+
+GzipReader::~GzipReader()
+{
+    finish();
+}
+
+
+// Reads the header of a member up to its compressed data. Returns false at the end of the file, and also sets damaged if the header is damaged.
+bool GzipReader::read_header(bool& damaged)
+{
+    int header[10];
+    for (int& byte: header)
+        byte = inflater.next_byte();
+    if (header[0] < 0)
+        return(false);
+    if (header[0] != GZIP_ID1 || header[1] != GZIP_ID2 || header[2] != GZIP_DEFLATE || header[9] < 0)
+    {
+        damaged = true;
+        return(false);
+    }
+
+    const int flags = header[3];
+    if (flags & FLAG_EXTRA)
+    {
+        int length = inflater.next_byte();
+        length |= inflater.next_byte() << 8;
+        while (length-- > 0)
+            inflater.next_byte();
+    }
+    for (int flag: {FLAG_NAME, FLAG_COMMENT})
+    {
+        if (flags & flag)
+        {
+            int c;
+            while ((c = inflater.next_byte()) > 0)
+                ;
+        }
+    }
+    if (flags & FLAG_HEADER_CRC)
+    {
+        inflater.next_byte();
+        inflater.next_byte();
+    }
+    return(true);
+}
+
+
+// Runs on the worker thread: decompresses every member, checking its CRC and length, and queues the text
+bool GzipReader::decompress()
+{
+    bool failed = false;
+    while (!failed && read_header(failed))
+    {
+        unsigned long crc = 0;
+        unsigned long long size = 0;
+        size_t n;
+        do
+        {
+            std::vector<char> buffer(GZIP_BUFFER);
+            n = inflater.read((unsigned char*)buffer.data(), buffer.size());
+            buffer.resize(n);
+            crc = crc32(crc, (const unsigned char*)buffer.data(), n);
+            size += n;
+            if (!queue(std::move(buffer)))
+                return(true);
+        } while (n == GZIP_BUFFER);
+
+        unsigned long trailer[2] = {0, 0};
+        for (int b = 0; b != 8; ++b)
+            trailer[b/4] |= (unsigned long)(inflater.next_byte() & 0xff) << 8*(b%4);
+        failed = inflater.failed() || trailer[0] != crc || trailer[1] != (size & 0xfffffffful);
+        inflater.restart();
+    }
+    return(!failed);
+}
+
+
+GzipWriter::GzipWriter(FILE* out) : out(out), crc(0), size(0)
+{
+    // No name or time is stored, and the operating system is unknown
+    static const unsigned char header[10] = {GZIP_ID1, GZIP_ID2, GZIP_DEFLATE, 0, 0, 0, 0, 0, 0, 255};
+    fwrite(header, 1, sizeof header, out);
+}
+
+
+void GzipWriter::compress(bool final)
+{
+    INSTRUMENT_SCOPE("gzip_compress");
+    const unsigned char* data = (const unsigned char*)pending.data();
+    compressed.clear();
+    deflate_parallel(data, pending.size(), final, compressed);
+    fwrite(compressed.data(), 1, compressed.size(), out);
+    crc = crc32(crc, data, pending.size());
+    size += pending.size();
+    pending.clear();
+}
+
+
+void GzipWriter::write(const std::string& text)
+{
+    pending += text;
+    if (pending.size() >= GZIP_BLOCK)
+        compress(false);
+}
+
+
+bool GzipWriter::finish()
+{
+    compress(true);
+    unsigned char trailer[8];
+    for (int b = 0; b != 8; ++b)
+        trailer[b] = (unsigned char)(((b < 4) ? crc : size) >> 8*(b%4));
+    fwrite(trailer, 1, sizeof trailer, out);
+    return(!ferror(out));
+}
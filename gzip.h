@@ -0,0 +1,97 @@
+// Gzip files (RFC 1952) as batch input and output: decompression runs ahead of parsing on its own thread, and compression is split over all cores.
+
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "deflate.h"
+
+// Constants: bytes decompressed at a time, and how many decompressed buffers may wait to be parsed
+#define GZIP_BUFFER 1048576
+#define GZIP_QUEUE 4
+
+// Constants: bytes of text collected before they are compressed in parallel
+#define GZIP_BLOCK 4194304
+
+
+// Returns true if the first byte of in, which is left unread, starts the signature of a gzip file. Text never starts with it, so compressed input can be told from plain input, even on a pipe.
+bool is_gzip(FILE* in);
+
+
+// Reads the text of a compressed file line by line. A thread decompresses into a short queue of buffers while lines are taken from the front, so parsing and decompression overlap. Derived classes decompress one format.
+class CompressedReader {
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> ready;    // Decompressed buffers not yet taken
+    bool done, stop, error;
+    std::vector<char> current;
+    size_t position;
+
+    void run();
+
+protected:
+    // Runs on the worker thread: decompresses the whole file, passing the text to queue in order. Returns false if the file is damaged.
+    virtual bool decompress() = 0;
+
+    // Adds buffer to the queue, waiting while it is full. Returns false if the reader is being destroyed, when decompress should return at once.
+    bool queue(std::vector<char>&& buffer);
+
+    // Starts and stops the worker thread. Derived classes start it once constructed, and stop it in their destructors before their members go.
+    void start();
+    void finish();
+
+public:
+    CompressedReader();
+    virtual ~CompressedReader() {}
+
+    // Reads a line into line as fgets does.
+    char* gets(char* line, int size);
+
+    // Returns true if the file is damaged; valid after gets has returned nullptr.
+    bool failed() const { return(error); }
+};
+
+
+// Reads the text of a gzip file. Files of several members, as written by concatenating gzip files, are read as one.
+class GzipReader: public CompressedReader {
+    Inflater inflater;
+
+    bool read_header(bool& damaged);
+    bool decompress() override;
+
+public:
+    // Starts decompressing in, which must be open in binary mode.
+    GzipReader(FILE* in);
+    ~GzipReader();
+};
+
+
+// Writes text to a gzip file. Text is collected into blocks of GZIP_BLOCK bytes, each compressed in parallel pieces as in pigz.
+class GzipWriter {
+    FILE* out;
+    std::string pending;
+    std::vector<unsigned char> compressed;
+    unsigned long crc;
+    unsigned long long size;
+
+    void compress(bool final);
+
+public:
+    // Starts a gzip file on out, which must be open in binary mode.
+    GzipWriter(FILE* out);
+
+    void write(const std::string& text);
+
+    // Compresses what is left and writes the trailer. Returns false if writing failed.
+    bool finish();
+};
+
+
+#endif /* GZIP_H */
@@ -0,0 +1,152 @@
+#include "instrument.h"
+
+#ifdef MOLARITY_INSTRUMENT
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+// A recorded scope
+struct InstrumentEvent {
+    int probe;
+    unsigned long long start;
+    unsigned long long end;
+};
+
+// Everything recorded by one thread. Only the owning thread writes to it; it is read when the program ends.
+struct InstrumentBuffer {
+    int thread;
+    unsigned long long counts[INSTRUMENT_PROBES];
+    size_t next_event;                  // Total events recorded; the buffer holds the last INSTRUMENT_EVENTS of them
+    InstrumentEvent events[INSTRUMENT_EVENTS];
+};
+
+
+static std::mutex instrument_mutex;
+static const char* probe_names[INSTRUMENT_PROBES];
+static int probe_count = 0;
+static std::vector<std::unique_ptr<InstrumentBuffer>> buffers;
+
+// Clock readings taken at the first probe, to convert cycles to microseconds
+static unsigned long long clock_origin;
+static std::chrono::steady_clock::time_point time_origin;
+
+
+unsigned long long instrument_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return(__rdtsc());
+#else
+    return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+static void write_trace_at_exit()
+{
+    const char* path = getenv("MOLARITY_TRACE");
+    if (path)
+        instrument_write(path);
+}
+
+
+int instrument_probe(const char* name)
+{
+    std::lock_guard<std::mutex> lock(instrument_mutex);
+    if (probe_count == 0)
+    {
+        clock_origin = instrument_clock();
+        time_origin = std::chrono::steady_clock::now();
+        atexit(write_trace_at_exit);
+    }
+    for (int probe = 0; probe != probe_count; ++probe)
+        if (strcmp(probe_names[probe], name) == 0)
+            return(probe);
+    if (probe_count == INSTRUMENT_PROBES)
+    {
+        fprintf(stderr, "Too many instrumentation probes, %s is counted with %s\n", name, probe_names[0]);
+        return(0);
+    }
+    probe_names[probe_count] = name;
+    return(probe_count++);
+}
+
+
+static InstrumentBuffer& thread_buffer()
+{
+    thread_local InstrumentBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        std::unique_ptr<InstrumentBuffer> created(new InstrumentBuffer());
+        memset(created->counts, 0, sizeof created->counts);
+        created->next_event = 0;
+        std::lock_guard<std::mutex> lock(instrument_mutex);
+        created->thread = (int)buffers.size();
+        buffer = created.get();
+        buffers.push_back(std::move(created));
+    }
+    return(*buffer);
+}
+
+
+void instrument_event(int probe, unsigned long long start, unsigned long long end)
+{
+    InstrumentBuffer& buffer = thread_buffer();
+    buffer.events[buffer.next_event++ % INSTRUMENT_EVENTS] = InstrumentEvent{probe, start, end};
+    ++buffer.counts[probe];
+}
+
+
+void instrument_count(int probe, unsigned long long n)
+{
+    thread_buffer().counts[probe] += n;
+}
+
+
+bool instrument_write(const char* path)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return(false);
+
+    std::lock_guard<std::mutex> lock(instrument_mutex);
+    const double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - time_origin).count();
+    const unsigned long long elapsed_clock = instrument_clock() - clock_origin;
+    const double us_per_tick = elapsed_clock ? elapsed_us/elapsed_clock : 0;
+
+    fprintf(out, "{\"traceEvents\": [");
+    const char* separator = "\n";
+    for (auto& buffer: buffers)
+    {
+        size_t first = (buffer->next_event > INSTRUMENT_EVENTS) ? buffer->next_event - INSTRUMENT_EVENTS : 0;
+        for (size_t e = first; e != buffer->next_event; ++e)
+        {
+            const InstrumentEvent& event = buffer->events[e % INSTRUMENT_EVENTS];
+            fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    separator, probe_names[event.probe], buffer->thread,
+                    (event.start - clock_origin)*us_per_tick, (event.end - event.start)*us_per_tick);
+            separator = ",\n";
+        }
+        for (int probe = 0; probe != probe_count; ++probe)
+        {
+            if (!buffer->counts[probe])
+                continue;
+            fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"args\": {\"count\": %llu}}",
+                    separator, probe_names[probe], buffer->thread, elapsed_us, buffer->counts[probe]);
+            separator = ",\n";
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return(fclose(out) == 0);
+}
+
+#endif /* MOLARITY_INSTRUMENT */
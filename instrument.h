@@ -0,0 +1,56 @@
+// Instrumentation for development builds: traced scopes and counters on the hot paths. Without MOLARITY_INSTRUMENT defined (as in the Release configuration) every macro expands to nothing, so instrumented code compiles to exactly what it would be without the macros.
+//
+// INSTRUMENT_SCOPE("name") times the rest of the enclosing block and records it as a trace event.
+// INSTRUMENT_COUNT("name", n) adds n to a counter.
+//
+// Events and counts go to buffers owned by the calling thread. When the program ends they are written as a Chrome trace (chrome://tracing, Perfetto) to the file named by the MOLARITY_TRACE environment variable.
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#ifdef MOLARITY_INSTRUMENT
+
+// Constants: most probes (distinct scope or counter names), and trace events kept per thread. Older events are overwritten once a thread's buffer is full.
+#define INSTRUMENT_PROBES 64
+#define INSTRUMENT_EVENTS 65536
+
+// Returns the ID of the probe called name, registering it on first use. Called once per probe site.
+int instrument_probe(const char* name);
+
+// Returns a timestamp in CPU cycles where available, otherwise in nanoseconds.
+unsigned long long instrument_clock();
+
+// Records a scope of probe from start to end, or adds n to its counter.
+void instrument_event(int probe, unsigned long long start, unsigned long long end);
+void instrument_count(int probe, unsigned long long n);
+
+// Writes everything recorded by all threads to path as a Chrome trace. Called at exit when MOLARITY_TRACE is set.
+bool instrument_write(const char* path);
+
+// Times a scope
+class InstrumentScope {
+    int probe;
+    unsigned long long start;
+public:
+    explicit InstrumentScope(int p) : probe(p), start(instrument_clock()) {}
+    ~InstrumentScope() { instrument_event(probe, start, instrument_clock()); }
+};
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_(a, b)
+
+#define INSTRUMENT_SCOPE(name) \
+    static const int INSTRUMENT_CONCAT(instrument_probe_, __LINE__) = instrument_probe(name); \
+    InstrumentScope INSTRUMENT_CONCAT(instrument_scope_, __LINE__)(INSTRUMENT_CONCAT(instrument_probe_, __LINE__))
+
+#define INSTRUMENT_COUNT(name, n) \
+    do { static const int instrument_probe_id = instrument_probe(name); instrument_count(instrument_probe_id, (n)); } while (0)
+
+#else
+
+#define INSTRUMENT_SCOPE(name) do {} while (0)
+#define INSTRUMENT_COUNT(name, n) do {} while (0)
+
+#endif /* MOLARITY_INSTRUMENT */
+
+#endif /* INSTRUMENT_H */
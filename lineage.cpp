@@ -0,0 +1,396 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+#include "lineage.h"
+#include "calculator.h"
+#include "parallel.h"
+#include "instrument.h"
+
+#ifdef __MINGW32__
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Constants: first bytes of a lineage graph file, which ends the version
+static const char lineage_magic[8] = {'M', 'O', 'L', 'L', 'I', 'N', 'E', '2'};
+
+// Constants: header of a lineage graph file, followed by the arrays of LineageGraph in the order child_offsets, children, parent_offsets, parents, name_offsets, names. Each array starts on a multiple of 8 bytes, so it can be used where it is mapped.
+struct LineageHeader {
+    char magic[8];
+    uint64_t nodes, edges, name_bytes;
+};
+
+
+// Returns size rounded up to a multiple of 8
+static uint64_t padded(uint64_t size)
+{
+    return((size + 7)/8*8);
+}
+
+
+LineageGraph::LineageGraph():
+    data(nullptr), data_size(0), file(nullptr), mapping(nullptr), descriptor(-1)
+{
+}
+
+
+LineageGraph::~LineageGraph()
+{
+    close();
+}
+
+
+void LineageGraph::close()
+{
+#ifdef __MINGW32__
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+#else
+    if (data)
+        munmap((void*)data, data_size);
+    if (descriptor >= 0)
+        ::close(descriptor);
+#endif
+    data = nullptr;
+    mapping = file = nullptr;
+    descriptor = -1;
+    data_size = 0;
+    child_offsets = parent_offsets = name_offsets = LineageArray<uint64_t>();
+    children = parents = LineageArray<uint32_t>();
+    names = LineageArray<char>();
+}
+
+
+// Sets start and length to the name of node v in graph, kept within its names
+static void name_range(const LineageGraph& graph, size_t v, size_t& start, size_t& length)
+{
+    const size_t bytes = graph.names.size();
+    start = std::min<size_t>(graph.name_offsets[v], bytes);
+    length = std::min<size_t>(std::max<size_t>(graph.name_offsets[v + 1], start), bytes) - start;
+}
+
+
+std::string LineageGraph::name(uint32_t v) const
+{
+    size_t start, length;
+    name_range(*this, v, start, length);
+    return(std::string(names.data + start, length));
+}
+
+
+long LineageGraph::find(const std::string& name) const
+{
+    size_t low = 0, high = size();
+    while (low < high)
+    {
+        const size_t middle = low + (high - low)/2;
+        size_t start, length;
+        name_range(*this, middle, start, length);
+        int order = memcmp(names.data + start, name.data(), std::min(length, name.size()));
+        order = order ? order : (length < name.size()) ? -1 : (length > name.size());
+        if (order == 0)
+            return((long)middle);
+        if (order < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return(-1);
+}
+
+
+// Fills offsets and targets with the edges (from, to), grouped by from
+static void fill_rows(size_t nodes, const std::vector<uint64_t>& edges, bool reverse, std::vector<uint64_t>& offsets, std::vector<uint32_t>& targets)
+{
+    offsets.assign(nodes + 1, 0);
+    for (uint64_t edge: edges)
+        ++offsets[(reverse ? (uint32_t)edge : (uint32_t)(edge >> 32)) + 1];
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    targets.resize(edges.size());
+    std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+    for (uint64_t edge: edges)
+    {
+        const uint32_t from = reverse ? (uint32_t)edge : (uint32_t)(edge >> 32), to = reverse ? (uint32_t)(edge >> 32) : (uint32_t)edge;
+        targets[next[from]++] = to;
+    }
+}
+
+
+void LineageGraph::build(const std::vector<std::pair<std::string, std::string>>& edges)
+{
+    INSTRUMENT_SCOPE("build_lineage");
+
+    // Names are numbered as they come, then renumbered in sorted order so find can search them
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<const std::string*> sorted;
+    auto id = [&](const std::string& name) {
+        auto inserted = ids.emplace(name, (uint32_t)ids.size());
+        if (inserted.second)
+            sorted.push_back(&inserted.first->first);
+        return(inserted.first->second);
+    };
+    std::vector<uint64_t> keys;
+    keys.reserve(edges.size());
+    for (const auto& edge: edges)
+    {
+        const uint64_t from = id(edge.first);
+        keys.push_back(from << 32 | id(edge.second));
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const std::string* a, const std::string* b) { return(*a < *b); });
+    close();
+    std::vector<uint32_t> renumbered(sorted.size());
+    built_offsets[2].assign(1, 0);
+    built_names.clear();
+    for (size_t v = 0; v != sorted.size(); ++v)
+    {
+        renumbered[ids[*sorted[v]]] = (uint32_t)v;
+        built_names += *sorted[v];
+        built_offsets[2].push_back(built_names.size());
+    }
+    for (uint64_t& key: keys)
+        key = (uint64_t)renumbered[key >> 32] << 32 | renumbered[(uint32_t)key];
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    fill_rows(sorted.size(), keys, false, built_offsets[0], built_targets[0]);
+    fill_rows(sorted.size(), keys, true, built_offsets[1], built_targets[1]);
+    child_offsets = {built_offsets[0].data(), built_offsets[0].size()};
+    parent_offsets = {built_offsets[1].data(), built_offsets[1].size()};
+    name_offsets = {built_offsets[2].data(), built_offsets[2].size()};
+    children = {built_targets[0].data(), built_targets[0].size()};
+    parents = {built_targets[1].data(), built_targets[1].size()};
+    names = {built_names.data(), built_names.size()};
+}
+
+
+// Writes the elements of an array and zeros up to a multiple of 8 bytes, returning false on failure
+template <typename T>
+static bool write_array(FILE* out, const LineageArray<T>& array)
+{
+    static const char zeros[8] = {0};
+    const size_t padding = padded(array.size()*sizeof(T)) - array.size()*sizeof(T);
+    return(fwrite(array.data, sizeof(T), array.size(), out) == array.size() && fwrite(zeros, 1, padding, out) == padding);
+}
+
+
+bool LineageGraph::write(const char* path) const
+{
+    FILE* out = fopen(path, "wb");
+    if (!out)
+        return(false);
+    LineageHeader header;
+    memcpy(header.magic, lineage_magic, sizeof header.magic);
+    header.nodes = size();
+    header.edges = children.size();
+    header.name_bytes = names.size();
+    bool written = fwrite(&header, sizeof header, 1, out) == 1 &&
+                   write_array(out, child_offsets) && write_array(out, children) &&
+                   write_array(out, parent_offsets) && write_array(out, parents) &&
+                   write_array(out, name_offsets) && write_array(out, names);
+    return((fclose(out) == 0) && written);
+}
+
+
+// Points array at count elements at offset in data, and moves offset past them
+template <typename T>
+static void map_array(const unsigned char* data, uint64_t& offset, uint64_t count, LineageArray<T>& array)
+{
+    array = {(const T*)(data + offset), (size_t)count};
+    offset += padded(count*sizeof(T));
+}
+
+
+bool LineageGraph::read(const char* path)
+{
+    close();
+#ifdef __MINGW32__
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(LineageHeader))
+    {
+        data_size = (size_t)file_size.QuadPart;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    }
+    if (file == INVALID_HANDLE_VALUE)
+        file = nullptr;
+#else
+    descriptor = ::open(path, O_RDONLY);
+    struct stat status;
+    if (descriptor >= 0 && fstat(descriptor, &status) == 0 && status.st_size >= (off_t)sizeof(LineageHeader))
+    {
+        data_size = (size_t)status.st_size;
+        void* address = mmap(nullptr, data_size, PROT_READ, MAP_SHARED, descriptor, 0);
+        data = (address != MAP_FAILED) ? (const unsigned char*)address : nullptr;
+    }
+#endif
+
+    // The arrays the header counts must all be in the file; counts are checked one by one first so their sizes cannot overflow
+    LineageHeader header;
+    if (!data)
+    {
+        close();
+        return(false);
+    }
+    memcpy(&header, data, sizeof header);
+    const bool readable = memcmp(header.magic, lineage_magic, sizeof header.magic) == 0 &&
+                          header.nodes < UINT32_MAX && header.edges <= data_size/4 && header.name_bytes <= data_size &&
+                          sizeof header + 3*8*(header.nodes + 1) + 2*padded(4*header.edges) + padded(header.name_bytes) <= data_size;
+    if (!readable)
+    {
+        close();
+        return(false);
+    }
+    uint64_t offset = sizeof header;
+    map_array(data, offset, header.nodes + 1, child_offsets);
+    map_array(data, offset, header.edges, children);
+    map_array(data, offset, header.nodes + 1, parent_offsets);
+    map_array(data, offset, header.edges, parents);
+    map_array(data, offset, header.nodes + 1, name_offsets);
+    map_array(data, offset, header.name_bytes, names);
+    return(true);
+}
+
+
+void search_lineage(const LineageGraph& graph, const std::vector<uint32_t>& seeds, bool descendants,
+                    std::vector<uint32_t>& found, std::vector<uint32_t>& generations)
+{
+    INSTRUMENT_SCOPE("search_lineage");
+    const LineageArray<uint64_t>& offsets = descendants ? graph.child_offsets : graph.parent_offsets;
+    const LineageArray<uint32_t>& targets = descendants ? graph.children : graph.parents;
+    const size_t nodes = graph.size(), edges = targets.size();
+
+    // One bit per node, set by the first thread to reach it, so each node joins one frontier only
+    const size_t words = (graph.size() + 63)/64;
+    std::unique_ptr<std::atomic<uint64_t>[]> visited(new std::atomic<uint64_t>[words]());
+    auto visit = [&](uint32_t v) {
+        const uint64_t bit = 1ull << (v & 63);
+        std::atomic<uint64_t>& word = visited[v >> 6];
+        return(!(word.load(std::memory_order_relaxed) & bit) && !(word.fetch_or(bit, std::memory_order_relaxed) & bit));
+    };
+
+    found.clear();
+    generations.clear();
+    std::vector<uint32_t> frontier;
+    for (uint32_t seed: seeds)
+        if (visit(seed))
+            frontier.push_back(seed);
+    for (uint32_t generation = 0; !frontier.empty(); ++generation)
+    {
+        std::sort(frontier.begin(), frontier.end());
+        found.insert(found.end(), frontier.begin(), frontier.end());
+        generations.resize(found.size(), generation);
+
+        std::vector<std::vector<uint32_t>> next((frontier.size() + LINEAGE_CHUNK - 1)/LINEAGE_CHUNK);
+        parallel_for(next.size(), [&](size_t chunk) {
+            const size_t end = std::min((chunk + 1)*LINEAGE_CHUNK, frontier.size());
+            for (size_t f = chunk*LINEAGE_CHUNK; f != end; ++f)
+            {
+                // Rows and nodes of a damaged file that fall outside the arrays are skipped
+                const uint64_t last = std::min<uint64_t>(offsets[frontier[f] + 1], edges);
+                for (uint64_t e = offsets[frontier[f]]; e < last; ++e)
+                    if (targets[e] < nodes && visit(targets[e]))
+                        next[chunk].push_back(targets[e]);
+            }
+        });
+        frontier.clear();
+        for (const std::vector<uint32_t>& part: next)
+            frontier.insert(frontier.end(), part.begin(), part.end());
+    }
+}
+
+
+// Reads the edges in in, after its header line, into edges. Fields after the second are ignored. Returns false on a read error.
+static bool read_edges(FILE* in, std::vector<std::pair<std::string, std::string>>& edges)
+{
+    std::string text;
+    if (!read_line(in, text))
+        return(ferror(in) == 0);
+    while (read_line(in, text))
+    {
+        char* line = &text[0];
+        char* comma = strchr(line, ',');
+        if (!comma || comma == line || comma[1] == '\0')
+            continue;
+        *comma = '\0';
+        comma[1 + strcspn(comma + 1, ",")] = '\0';
+        edges.emplace_back(line, comma + 1);
+    }
+    return(ferror(in) == 0);
+}
+
+
+int lineage_main(int argc, char** argv)
+{
+    const bool build = (argc >= 4 && strcmp(argv[2], "build") == 0);
+    const bool query = (argc >= 5 && (strcmp(argv[3], "--descendants") == 0 || strcmp(argv[3], "--ancestors") == 0));
+    if (!build && !query)
+    {
+        fprintf(stderr, "Usage: %s --lineage build <graph> [edge files...]\n"
+                        "       %s --lineage <graph> --descendants|--ancestors <node>...\n", argv[0], argv[0]);
+        return(2);
+    }
+
+    LineageGraph graph;
+    if (build)
+    {
+        std::vector<std::pair<std::string, std::string>> edges;
+        for (int a = 4; a == 4 || a < argc; ++a)
+        {
+            const char* path = (a < argc) ? argv[a] : nullptr;
+            FILE* in = path ? fopen(path, "rb") : stdin;
+            const bool read = in && read_edges(in, edges);
+            if (in && in != stdin)
+                fclose(in);
+            if (!read)
+            {
+                fprintf(stderr, "Cannot read %s\n", path ? path : "standard input");
+                return(1);
+            }
+        }
+        graph.build(edges);
+        if (!graph.write(argv[3]))
+        {
+            fprintf(stderr, "Cannot write %s\n", argv[3]);
+            return(1);
+        }
+        return(0);
+    }
+
+    if (!graph.read(argv[2]))
+    {
+        fprintf(stderr, "Cannot read lineage graph %s\n", argv[2]);
+        return(1);
+    }
+    std::vector<uint32_t> seeds;
+    for (int a = 4; a < argc; ++a)
+    {
+        const long v = graph.find(argv[a]);
+        if (v < 0)
+        {
+            fprintf(stderr, "Not in the lineage graph: %s\n", argv[a]);
+            return(1);
+        }
+        seeds.push_back((uint32_t)v);
+    }
+    std::vector<uint32_t> found, generations;
+    search_lineage(graph, seeds, strcmp(argv[3], "--descendants") == 0, found, generations);
+    printf("node,generation\n");
+    for (size_t i = 0; i != found.size(); ++i)
+        printf("%s,%u\n", graph.name(found[i]).c_str(), generations[i]);
+    return(0);
+}
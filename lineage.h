@@ -0,0 +1,75 @@
+// Solution lineage: which stocks each preparation was made from, as a graph on disk, and searches for everything derived from, or going into, a given lot or well.
+
+#ifndef LINEAGE_H
+#define LINEAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Constants: frontier nodes expanded per parallel task of a search
+#define LINEAGE_CHUNK 4096
+
+
+// A read-only array of a lineage graph, held by the graph or in its mapped file
+template <typename T>
+struct LineageArray {
+    const T* data = nullptr;
+    size_t count = 0;
+
+    size_t size() const { return(count); }
+    const T& operator[](size_t i) const { return(data[i]); }
+};
+
+
+// A lineage graph in compressed sparse row form. Nodes are numbered in the order of their sorted names; the derived nodes (children) of node v are children[child_offsets[v]] up to children[child_offsets[v + 1]], and its sources (parents) likewise. A graph that is read maps its file and points the arrays into it, so a query only reads the pages it searches.
+class LineageGraph {
+    // Arrays of a graph that is built
+    std::vector<uint64_t> built_offsets[3];
+    std::vector<uint32_t> built_targets[2];
+    std::string built_names;
+
+    // Mapping of a graph that is read
+    const unsigned char* data;
+    size_t data_size;
+    void* file;                 // Handles of the file and its mapping, on Windows
+    void* mapping;
+    int descriptor;             // Elsewhere
+
+    void close();
+
+public:
+    LineageArray<uint64_t> child_offsets, parent_offsets, name_offsets;
+    LineageArray<uint32_t> children, parents;
+    LineageArray<char> names;   // All names, each starting at name_offsets[v]
+
+    LineageGraph();
+    ~LineageGraph();
+    LineageGraph(const LineageGraph&) = delete;
+    LineageGraph& operator=(const LineageGraph&) = delete;
+
+    size_t size() const { return(name_offsets.size() ? name_offsets.size() - 1 : 0); }
+
+    // Returns the name of node v. Offsets of a damaged file are kept within names.
+    std::string name(uint32_t v) const;
+
+    // Returns the node named name, or -1 if there is none. Names are sorted, so this is a binary search.
+    long find(const std::string& name) const;
+
+    // Builds the graph from edges given as pairs of names (source, derived). Repeated edges are kept once.
+    void build(const std::vector<std::pair<std::string, std::string>>& edges);
+
+    // Writes the graph to path, or maps it from path. Return false if the file cannot be written or is not a lineage graph. Reading only checks the header and the file size; searches skip offsets and nodes out of range, so a damaged file cannot send them outside it.
+    bool write(const char* path) const;
+    bool read(const char* path);
+};
+
+// Finds every node reachable from seeds through children (descendants) or parents (ancestors), breadth first, expanding each generation's frontier in parallel. Stores the nodes in found with their generations from the nearest seed in generations (seeds are generation 0), ordered by generation and then by name.
+void search_lineage(const LineageGraph& graph, const std::vector<uint32_t>& seeds, bool descendants,
+                    std::vector<uint32_t>& found, std::vector<uint32_t>& generations);
+
+// Command line mode: "--lineage build <graph> [edge files...]" reads lines of "source,derived" (a header first) from the edge files or standard input and writes the lineage graph; "--lineage <graph> --descendants|--ancestors <node>..." prints every node derived from, or going into, the given nodes, with its generation.
+int lineage_main(int argc, char** argv);
+
+
+#endif /* LINEAGE_H */
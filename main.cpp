@@ -4,13 +4,26 @@
 #include <FL/Fl_Double_Window.H>
 #include <FL/Fl_Input_Choice.H>
 #include <FL/Fl_Button.H>
+#include <FL/Fl_Check_Button.H>
 #include <string>
 #include <vector>
 #include <cstring>
+#include <cstdio>
 #include <stdlib.h>
-#include <map>
 #include <bitset>
+#include <cmath>
+#include <memory>
 #include <FL/fl_ask.H>
+#include "calculator.h"
+#include "batch.h"
+#include "dispense.h"
+#include "reaction.h"
+#include "decay.h"
+#include "decimal.h"
+#include "lineage.h"
+#include "worksheet.h"
+#include "telemetry.h"
+#include "instrument.h"
 
 // For window icon on windows
 #ifdef __MINGW32__
@@ -19,113 +32,10 @@
 #endif
 
 #define COLS 4
-#define ROWS 5
 #define WIDTH 500
 #define HEIGHT 200
 
 
-// Constants: row headers
-const static char* row_header[ROWS] = {
-            "Mass","Molar mass","Moles","Volume", "Molarity"
-        };
-
-// Constants: row_header in enum, each header should convert to binary with "on" for corresponding header bit (read right to left). THE ORDER OF ITEMS IN row_header AND RowEnum SHOULD MATCH, ELSE THE CALCULTATIONS WILL BE MESSED UP
-enum RowEnum {
-    mass = 1,
-    molar_mass = 2,
-    moles = 4,
-    volume = 8,
-    molarity = 16,
-    all = 31,
-    none = 0
-};
-
-// Constants: units, represented as a vector of maps. Each map in the vector corresponds to units for each measures from row_header. The map key is the C string for units used as labels, and value is the factor used by the get_value and set_value functions of the Calculator class.
-const static std::vector<std::map<const char*, double>> units_vector
-{
-    { // Mass map
-
-        {
-            "milligrams", 0.001
-        },
-        {
-            "micrograms", 0.000001
-        },
-        {
-            "nanograms", 0.000000001
-        },
-        {
-            "grams", 1
-        },
-        {
-            "kilograms", 1000
-        }
-
-    },
-    { // molar_mass map
-
-        {
-            "/g/mol", 1
-        },
-        {
-            "/mg/mol", 0.001
-        },
-        {
-            "/g/mmol", 1000
-        }
-
-    },
-    { // moles map
-
-        {
-            "mol", 1
-        },
-        {
-            "mmol", 0.001
-        },
-        {
-            "umol", 0.000001
-        }
-
-    },
-    { // Volume map
-
-        {
-            "mL", 0.001
-        },
-        {
-            "uL", 0.000001
-        },
-        {
-            "nL", 0.000000001
-        },
-        {
-            "L", 1
-        }
-
-
-    },
-    { // Concentration map
-        {
-            "mM", 1e-3
-        },
-        {
-            "uM", 1e-6
-        },
-        {
-            "nM", 1e-9
-        },
-        {
-            "pM", 1e-12
-        },
-        {
-            "M", 1
-        },
-    }
-};
-
-
-
 // Constants: Colour enum
 enum Colour {
     red = FL_RED,
@@ -150,6 +60,11 @@ enum FontType {
 void calculate_cb(Fl_Widget*, long int);
 void clear_cb(Fl_Widget*, void*);
 void help_cb(Fl_Widget*);
+void unit_cb(Fl_Widget*, long int);
+void units_poll_cb(void*);
+
+// Declarations of command line modes
+int convert_main(int argc, char** argv);
 
 
 // The Calculator container
@@ -162,26 +77,62 @@ class Calculator: public Fl_Group {
     
     Fl_Button* clear_button;
     Fl_Button* help_button;
+    Fl_Check_Button* auto_units_button;
+    
+    std::shared_ptr<const UnitTable> units; // Snapshot of the unit table that unit_ids refer to
+    int unit_ids[ROWS];                     // Selected unit ID for each row
+    time_t units_mtime;                     // Modification time of the units file when units was taken
+    
+    // Fills the unit choice of row r from the unit table, selecting the unit with ID unit_ids[r]. '/' is escaped so that labels such as "mg/dL" are not turned into submenus.
+    void fill_unit_choice(int r)
+    {
+        Fl_Input_Choice* choice = input_choice_ptrs[r];
+        choice->clear();
+        for (auto& unit: (*units)[r])
+        {
+            std::string menu_label;
+            for (char c: unit.label)
+            {
+                if (c == '/' || c == '\\')
+                    menu_label += '\\';
+                menu_label += c;
+            }
+            choice->add(menu_label.c_str());
+        }
+        choice->value((*units)[r][unit_ids[r]].label.c_str());
+    }
     
 public:
 
-    // The get_value function returns the value from number input field at row p as a double.
-    double get_value (long p) const
+    // The get_value function stores the value from number input field at row p, in base units, in value. It returns whether the field is empty, holds a number or holds something else.
+    InputState get_value (long p, double& value) const
+    {
+        INSTRUMENT_SCOPE("get_value");
+        double d_value = 0;
+        InputState state = parse_value((float_input_ptrs[p])->value(), d_value);
+        value = (*units)[p][unit_ids[p]].factor*d_value;
+        return(state);
+    }
+    
+    
+    // Reads all number input fields into values and returns which of them are valid.
+    Validity get_values(double values[ROWS]) const
     {
-        const char* value = (float_input_ptrs[p])->value();
-
-        double d_value = atof(value);
-        auto unit = (input_choice_ptrs[p])->value();
-        const std::map<const char*,double>* unit_map = &(units_vector[p]);
-        for (auto& elem: *unit_map)
-            if (strcmp(elem.first,unit) == 0)
-                return(elem.second*d_value);
+        Validity validity = {0, 0};
+        for (int r = 0; r != ROWS; ++r)
+        {
+            InputState state = get_value(r, values[r]);
+            validity.valid |= (state == input_parsed) << r;
+            validity.invalid |= (state == input_invalid) << r;
+        }
+        return(validity);
     }
     
     
-    // The set_value function sets the value of number field at row p.
-    void set_value(long p, double value,bool empty = 0)
+    // The set_value function sets the value of number field at row p. A positive sig_figs rounds the displayed value to that many significant figures.
+    void set_value(long p, double value, int sig_figs = 0, bool empty = 0)
     {
+        INSTRUMENT_SCOPE("set_value");
         if (empty)
         {
             (float_input_ptrs[p])->value("");
@@ -189,18 +140,43 @@ public:
         }
             
             
-        auto unit = (input_choice_ptrs[p])->value();
-        const std::map<const char*,double>* unit_map = &(units_vector[p]);
-        for (auto& elem: *unit_map)
-            if (strcmp(elem.first,unit) == 0)
-                value/=elem.second;
+        if (auto_units_button->value() && value != 0 && std::isfinite(value))
+        {
+            unit_ids[p] = units->best_unit_for(p, std::fabs(value));
+            (input_choice_ptrs[p])->value((*units)[p][unit_ids[p]].label.c_str());
+        }
+        value/=(*units)[p][unit_ids[p]].factor;
         
-        (float_input_ptrs[p])->value(std::to_string(value).c_str());
+        if (sig_figs > 0)
+        {
+            char text[64];
+            format_sig_figs(text, sizeof text, value, sig_figs);
+            (float_input_ptrs[p])->value(text);
+        }
+        else
+            (float_input_ptrs[p])->value(std::to_string(value).c_str());
+    }
+    
+    
+    // Returns the fewest significant figures typed in the rows set in bin, which is the precision of a product or quotient of those rows.
+    int sig_figs(unsigned long bin) const
+    {
+        int fewest = 0;
+        for (int r = 0; r != ROWS; ++r)
+        {
+            if (!(bin & (1ul << r)))
+                continue;
+            int figures = count_sig_figs((float_input_ptrs[r])->value());
+            if (figures && (!fewest || figures < fewest))
+                fewest = figures;
+        }
+        return(fewest);
     }
     
     
     void set_colour(unsigned long bin, Colour c, FontType ft )
     {
+        INSTRUMENT_SCOPE("set_colour");
         if (!bin)
             return;
         Fl_Widget* text_widget = nullptr;
@@ -226,6 +202,36 @@ public:
     }
     
     
+    // Selects the unit shown in the unit choice of row p, keeping the previous unit if the label is unknown.
+    void select_unit(long p)
+    {
+        int id = find_unit(*units, p, (input_choice_ptrs[p])->value());
+        if (id >= 0)
+            unit_ids[p] = id;
+    }
+    
+    
+    // Switches to the latest unit table if the units file changed since the current one was taken. Selected units are kept by label; a row whose unit was removed falls back to its default unit.
+    void refresh_units()
+    {
+        time_t mtime = units_file_mtime();
+        if (mtime == units_mtime)
+            return;
+        
+        reload_units();
+        std::shared_ptr<const UnitTable> new_units = current_units();
+        for (int r = 0; r != ROWS; ++r)
+        {
+            int id = find_unit(*new_units, r, (*units)[r][unit_ids[r]].label.c_str());
+            unit_ids[r] = (id < 0) ? 0 : id;
+        }
+        units = new_units;
+        units_mtime = mtime;
+        for (int r = 0; r != ROWS; ++r)
+            fill_unit_choice(r);
+    }
+    
+    
     // Clears all number input fields.
     void clear_inputs()
     {
@@ -235,6 +241,10 @@ public:
     
     // Constructor
     Calculator(int X, int Y, int W, int H, const char*L=0) : Fl_Group(X,Y,W,H,L) {  
+        units_mtime = units_file_mtime();
+        reload_units();
+        units = current_units();
+        
         int cellw = 100;
         int cellh = 25;
         int xx = X, yy = Y;
@@ -258,17 +268,11 @@ public:
                 } else if (c==2) {
                     // c == 2 is column for units
                     Fl_Input_Choice* choice = new Fl_Input_Choice(xx,yy,cellw,cellh);
-                    
-                    std::vector<const char*> choice_labels;
-                    std::map<const char*,double> units_map = units_vector[r];
-                    for (std::map<const char*,double>::iterator it = units_map.begin(); 
-                            it!= units_map.end();++it)
-                        choice_labels.push_back(it->first);
-                    for (auto& i: choice_labels)
-                        choice->add(i);
-                    choice->value(choice_labels[0]);
-                    choice->input()->readonly(1);
                     this->input_choice_ptrs[r] = choice;
+                    this->unit_ids[r] = 0;
+                    fill_unit_choice(r);
+                    choice->input()->readonly(1);
+                    choice->callback(unit_cb,r);
                 } else if (c==3) {
                     // c == 2 is column for calculation buttons
                     Fl_Button* calc_button = new Fl_Button(xx,yy,cellw,cellh,"Calculate");
@@ -295,6 +299,12 @@ public:
         Fl_Button *help_button = new Fl_Button((WIDTH/2),yy,(WIDTH/4),cellh,"Help");
         help_button->callback(help_cb);
         this->help_button = help_button;
+        
+        
+        // Automatic choice of the unit of calculated values
+        Fl_Check_Button *auto_units_button = new Fl_Check_Button((WIDTH/4)*3,yy,(WIDTH/4)-20,cellh,"Auto units");
+        auto_units_button->tooltip("Show calculated values in the unit that keeps them readable");
+        this->auto_units_button = auto_units_button;
 
         end();
     }
@@ -313,6 +323,7 @@ public:
         }
         delete help_button;
         delete clear_button;
+        delete auto_units_button;
     }
     
 
@@ -374,9 +385,24 @@ public:
 
 
 
-int main()
+int main(int argc, char** argv)
 {
-    
+    if (argc > 1 && strcmp(argv[1], "--convert") == 0)
+        return(convert_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return(batch_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+        return(benchmark_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--dispense") == 0)
+        return(dispense_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--reaction") == 0)
+        return(reaction_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--decay") == 0)
+        return(decay_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--lineage") == 0)
+        return(lineage_main(argc, argv));
+    if (argc > 1 && strcmp(argv[1], "--worksheet") == 0)
+        return(worksheet_main(argc, argv));
     
     Fl_Double_Window win(WIDTH,HEIGHT,"Molarity Calculator");
     Calculator calc(10,10,WIDTH-20,HEIGHT-20);
@@ -385,8 +411,16 @@ int main()
     win.icon((char*)LoadIcon(fl_display,MAKEINTRESOURCE(101)));
     #endif
     win.show();
+    Fl::add_timeout(UNITS_POLL_SECONDS, units_poll_cb, &calc);
+    
+    // Solver paths used during the session are written out if asked for
+    const char* telemetry_path = getenv("MOLARITY_TELEMETRY");
+    telemetry_timing = (getenv("MOLARITY_TIMING") != nullptr);
     
-    return (Fl::run());
+    int ret = Fl::run();
+    if (telemetry_path)
+        write_telemetry(telemetry_path);
+    return (ret);
 }
 
 // Definition of callbacks
@@ -405,7 +439,22 @@ void help_cb(Fl_Widget* w)
         "> Fields used for calculation are shown in green.\n"
         "> Calculated field is shown in blue.\n"
         "> Use return key to cycle between input fields.\n"
-        "> Ctrl+return to calculate current field.");
+        "> Ctrl+return to calculate current field.\n"
+        "> Results are rounded to the significant figures of the fields used.\n"
+        "> Tick Auto units to show calculated values in a readable unit.");
+}
+
+void unit_cb(Fl_Widget* w, long int p)
+{
+    Calculator* parent_calculator = (Calculator*)(w->parent());
+    parent_calculator->select_unit(p);
+}
+
+// Picks up edits to the units file while the calculator is running.
+void units_poll_cb(void* calc)
+{
+    ((Calculator*)calc)->refresh_units();
+    Fl::repeat_timeout(UNITS_POLL_SECONDS, units_poll_cb, calc);
 }
 
 
@@ -415,176 +464,125 @@ void calculate_cb(Fl_Widget* w, long int p)
     Fl_Button* button = (Fl_Button*) w;
     Calculator* parent_calculator = (Calculator*)(button->parent());
 
-    double mass = parent_calculator->get_value(0),
-    molar_mass = parent_calculator->get_value(1),
-    moles = parent_calculator->get_value(2),
-    volume = parent_calculator->get_value(3),
-    molarity = parent_calculator->get_value(4),
-    current = parent_calculator->get_value(p);
-    
-    
-    
-//    parent_calculator->set_colour(p,Colour::green);
-    
-    // First check if requested field has value
-    
-
-    
-    
+    double values[ROWS];
+    Validity validity = parent_calculator->get_values(values);
+    const unsigned long current_enum = 1ul << p;
     
     parent_calculator->set_colour(RowEnum::all,Colour::black,FontType::normal);
-    unsigned long good_font_condition = 0;
-    unsigned long bad_font_condition = 0;
     
-    mass ? (good_font_condition |= RowEnum::mass) : (bad_font_condition |= RowEnum::mass);
-    molar_mass ? (good_font_condition |= RowEnum::molar_mass) : (bad_font_condition |= RowEnum::molar_mass);
-    moles ? (good_font_condition |= RowEnum::moles) : (bad_font_condition |= RowEnum::moles);
-    volume ? (good_font_condition |= RowEnum::volume) : (bad_font_condition |= RowEnum::volume);
-    molarity ? (good_font_condition |= RowEnum::molarity) : (bad_font_condition |= RowEnum::molarity);
+    // The requested field is calculated afresh, so whatever it holds is discarded
+    if ((validity.valid | validity.invalid) & current_enum)
+        parent_calculator->set_value(p, 0, 0, 1); // Set to empty
+    validity.valid &= ~current_enum;
+    validity.invalid &= ~current_enum;
     
+    // Fields that are not numbers are always shown in red
+    unsigned long good_font_condition = 0;
+    unsigned long bad_font_condition = validity.invalid;
     
-    // Calculate RowEnum value from p
-    unsigned current_enum = 1;
-    for (unsigned i = 1,j = 0; j!=p; i=current_enum, ++j)
-        current_enum = i + i;
-    
-
-    if (current)
+    INSTRUMENT_SCOPE("solver_dispatch");
+    const Relation& relation = find_relation(p, validity.valid);
+    if (relation.source == no_source)
     {
-        parent_calculator->set_value(p, 0, 1); // Set to empty
-        good_font_condition ^= current_enum;
-//        parent_calculator->set_colour(current_enum,Colour::black,FontType::normal); // Set to normal
+        thread_path_counters().add(solver_path(p, no_source), 1, 0);
+        bad_font_condition |= required_rows(p) & ~validity.valid;
     }
-    
-    // Calculations
-    switch (p)
+    else
     {
-        // Calculate mass from other values
-        case 0:
-            
-            if (molar_mass)
-            {
-                
-                if (volume && molarity)
-                {
-                    parent_calculator->set_value(p,volume*molarity*molar_mass);
-                    parent_calculator->set_value(2,volume*molarity);
-                    good_font_condition &= RowEnum::molar_mass | RowEnum::volume | RowEnum::molarity;
-                    bad_font_condition = 0;
-                }
-                    
-                else if (moles)
-                {
-                    parent_calculator->set_value(p,moles*molar_mass);
-                    good_font_condition &= RowEnum::molar_mass | RowEnum::moles;
-                }
-                
-            }
-            else 
-            {
-                bad_font_condition &= RowEnum::molar_mass | RowEnum::volume | RowEnum::molarity ;
-            }
-            break;
-            
-        // Calculate molar mass
-        case 1:
-            if (mass)
-            {
-                if (volume && molarity)
-                {
-                    parent_calculator->set_value(p,mass/(volume*molarity));
-                    parent_calculator->set_value(2,volume*molarity);
-                    good_font_condition &= RowEnum::mass | RowEnum::volume | RowEnum::molarity;
-                    bad_font_condition = 0;
-                }
-                else if (moles)
-                {
-                    parent_calculator->set_value(p,mass/moles);
-                    good_font_condition &= RowEnum::moles | RowEnum::mass;
-                }
-            }
-            else 
-            {
-                bad_font_condition &= RowEnum::mass | RowEnum::volume | RowEnum::molarity;
-            }
-            break;
-        
-        // Calculate Moles
-        case 2:
-            if (mass && molar_mass)
-            {
-                parent_calculator->set_value(p,mass/molar_mass);
-                good_font_condition &= RowEnum::molar_mass | RowEnum::mass;
-                
-                // Set other 2 to empty
-                parent_calculator->set_value(3,0,1);
-                parent_calculator->set_value(4,0,1);
-                
-            }
-            else if (volume && molarity)
-            {
-                parent_calculator->set_value(p,volume*molarity);
-                good_font_condition &= RowEnum::molarity | RowEnum::volume;
-            }
-            
-            break;
-            
-            
-        // Calculate Volume
-        case 3:
-            if (molarity) 
-            {
-                if (mass && molar_mass)
-                {
-                    parent_calculator->set_value(p,(mass/molar_mass)/molarity);
-                    parent_calculator->set_value(2,mass/molar_mass);
-                    good_font_condition &= RowEnum::molarity | RowEnum::mass | RowEnum::molar_mass;
-                    bad_font_condition = 0;
-                }
-                else if (moles)
-                {
-                    parent_calculator->set_value(p,moles/molarity);
-                    good_font_condition &= RowEnum::molarity | RowEnum::moles;
-                }
-                               
-            }
-            else 
-            {
-                bad_font_condition &= RowEnum::molarity | RowEnum::mass | RowEnum::molar_mass;
-            }
-            break;
-            
-            
-        // Calculate molarity
-        case 4:
-            if (volume) 
-            {
-                if (mass && molar_mass)
-                {
-                    parent_calculator->set_value(p,(mass/molar_mass)/volume);
-                    parent_calculator->set_value(2,mass/molar_mass);
-                    good_font_condition &= RowEnum::volume | RowEnum::mass | RowEnum::molar_mass;
-                    bad_font_condition = 0;
-                }
-                else if (moles)
-                {
-                    parent_calculator->set_value(p,moles/volume);
-                    good_font_condition &= RowEnum::volume | RowEnum::mass;
-                }
-            }
-            else 
-            {
-                bad_font_condition &= RowEnum::volume | RowEnum::mass | RowEnum::molar_mass;
-            }
-            break;
-            
-        // Reset colours
-        default:
-            good_font_condition = 0;
-            bad_font_condition = 0;
+        double moles = 0;
+        const unsigned long long start = telemetry_clock();
+        double result = solve(p, relation.source, values, moles);
+        thread_path_counters().add(solver_path(p, relation.source), 1, telemetry_clock() - start);
+
+        // A zero divisor gives no result: the field stays empty and the inputs used are shown in red
+        if (!std::isfinite(result) || (relation.writes_moles && !std::isfinite(moles)))
+        {
+            parent_calculator->set_colour(bad_font_condition | relation.inputs, Colour::red, FontType::bold);
+            parent_calculator->set_colour(current_enum, Colour::blue, FontType::bold);
+            return;
+        }
+        parent_calculator->set_value(p, result, parent_calculator->sig_figs(relation.inputs));
+        if (relation.writes_moles)
+            parent_calculator->set_value(2, moles, parent_calculator->sig_figs(relation.moles_inputs));
+        for (int r = 0; r != ROWS; ++r)
+            if (relation.clears & (1ul << r))
+                parent_calculator->set_value(r, 0, 0, 1);
+        good_font_condition = relation.inputs;
     }
+    
     // Set colours
     parent_calculator->set_colour(good_font_condition,Colour::green,FontType::bold);
     parent_calculator->set_colour(bad_font_condition,Colour::red,FontType::bold);
     parent_calculator->set_colour(current_enum,Colour::blue,FontType::bold);
 }
+
+
+// Constants: number of values converted per block in command line mode
+#define CONVERT_BLOCK 65536
+
+// Command line mode: "--convert <row> <from unit> <to unit>" reads one value per line from standard input and writes the converted values to standard output, e.g. --convert Volume uL mL. Lines that are not numbers are written as empty lines so rows stay aligned.
+int convert_main(int argc, char** argv)
+{
+    const bool decimal = (argc == 6 && strcmp(argv[5], "--decimal") == 0);
+    if (argc != 5 && !decimal)
+    {
+        fprintf(stderr, "Usage: %s --convert <row> <from unit> <to unit> [--decimal]\n", argv[0]);
+        return(2);
+    }
+    
+    reload_units();
+    std::shared_ptr<const UnitTable> units = current_units();
+    
+    long p = find_row(argv[2]);
+    if (p == ROWS)
+    {
+        fprintf(stderr, "Unknown row: %s\n", argv[2]);
+        return(1);
+    }
+    int from = find_unit(*units, p, argv[3]), to = find_unit(*units, p, argv[4]);
+    if (from < 0 || to < 0)
+    {
+        fprintf(stderr, "Unknown unit for %s: %s\n", row_header[p], (from < 0) ? argv[3] : argv[4]);
+        return(1);
+    }
+    
+    // Decimal conversions take the factors as the decimals they were written as, and each value as typed
+    if (decimal)
+    {
+        const Decimal from_factor = decimal_from_double((*units)[p][from].factor, DECIMAL_DOUBLE_DIGITS - 2);
+        const Decimal to_factor = decimal_from_double((*units)[p][to].factor, DECIMAL_DOUBLE_DIGITS - 2);
+        char line[256], text[64];
+        while (fgets(line, sizeof line, stdin))
+        {
+            Decimal value;
+            line[strcspn(line, "\n")] = '\0';
+            if (parse_decimal(line, value) == input_parsed)
+                format_decimal(text, sizeof text, decimal_divide(decimal_multiply(value, from_factor), to_factor), 0);
+            else
+                text[0] = '\0';
+            printf("%s\n", text);
+        }
+        return(0);
+    }
+
+    std::vector<double> values(CONVERT_BLOCK);
+    std::vector<char> parsed(CONVERT_BLOCK);
+    char line[256];
+    bool more = true;
+    while (more)
+    {
+        size_t n = 0;
+        while (n != CONVERT_BLOCK && (more = (fgets(line, sizeof line, stdin) != nullptr)))
+        {
+            // Values are parsed as batch mode and the window parse them, so text after a number makes the line invalid
+            line[strcspn(line, "\n")] = '\0';
+            parsed[n] = (parse_value(line, values[n]) == input_parsed);
+            values[n] = parsed[n] ? values[n] : 0;
+            ++n;
+        }
+        convert_units(*units, p, from, to, values.data(), values.data(), n);
+        for (size_t i = 0; i != n; ++i)
+            parsed[i] ? printf("%.15g\n", values[i]) : printf("\n");
+    }
+    return(0);
+}
@@ -0,0 +1,47 @@
+#include <cstring>
+#include <cstdio>
+#include "mixing.h"
+
+
+// Constants: molar volume of water at 25 °C in cm3/mol
+#define WATER_MOLAR_VOLUME 18.069
+
+// Constants: Redlich-Kister terms of the excess molar volume of each mixture at 25 °C, fitted to published measurements to within about 0.015 cm3/mol: V^E = x(1 - x)(A0 + A1(2x - 1) + A2(2x - 1)^2 + A3(2x - 1)^3) cm3/mol, with x the mole fraction of cosolvent
+struct Mixture {
+    const char* name;
+    double molar_volume;        // Of the pure cosolvent, cm3/mol
+    double terms[4];
+};
+static const Mixture mixtures[] = {
+    {"water-ethanol", 58.68, {-4.0973, 1.2194, -1.8401, 0.9468}},
+    {"water-dmso", 71.30, {-3.8580, 1.5497, -1.1325, 0.4452}}
+};
+
+
+bool MixingGrid::load(const char* name)
+{
+    for (const Mixture& mixture: mixtures)
+    {
+        if (strcmp(name, mixture.name) != 0)
+            continue;
+
+        // Moles of each component in 1 cm3 of components; the excess volume of those moles is the contraction
+        for (int g = 0; g <= MIXING_GRID; ++g)
+        {
+            const double fraction = (double)g/MIXING_GRID;
+            const double water = (1 - fraction)/WATER_MOLAR_VOLUME, cosolvent = fraction/mixture.molar_volume;
+            const double x = cosolvent/(water + cosolvent), s = 2*x - 1;
+            const double excess = x*(1 - x)*(mixture.terms[0] + s*(mixture.terms[1] + s*(mixture.terms[2] + s*mixture.terms[3])));
+            ratio[g] = 1 + (water + cosolvent)*excess;
+        }
+        return(true);
+    }
+    return(false);
+}
+
+
+void list_mixtures()
+{
+    for (const Mixture& mixture: mixtures)
+        fprintf(stderr, "%s\n", mixture.name);
+}
@@ -0,0 +1,34 @@
+// Non-ideal mixing: the contraction of water and cosolvent mixtures, so volumes measured out before mixing give the right final volume.
+
+#ifndef MIXING_H
+#define MIXING_H
+
+#include <cstddef>
+
+// Constants: intervals of the interpolation grid over the cosolvent volume fraction
+#define MIXING_GRID 1024
+
+
+// The final volume of a mixture of water and one cosolvent per litre of its components measured out separately, tabulated over the volume fraction of cosolvent before mixing.
+class MixingGrid {
+public:
+    // Fills the grid for the mixture name ("water-ethanol" or "water-dmso") at 25 °C. Returns false if the mixture is not known.
+    bool load(const char* name);
+
+    // Returns the final volume per litre of components mixed with cosolvent volume fraction fraction (clamped to [0, 1]), by linear interpolation in the grid.
+    double volume_ratio(double fraction) const
+    {
+        const double position = (fraction < 0 ? 0 : fraction > 1 ? 1 : fraction)*MIXING_GRID;
+        const size_t i = (position < MIXING_GRID) ? (size_t)position : MIXING_GRID - 1;
+        return(ratio[i] + (position - i)*(ratio[i + 1] - ratio[i]));
+    }
+
+private:
+    double ratio[MIXING_GRID + 1];
+};
+
+// Prints the names of the known mixtures to stderr, one per line.
+void list_mixtures();
+
+
+#endif /* MIXING_H */
@@ -35,15 +35,40 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
-	${OBJECTDIR}/main.o
+	${OBJECTDIR}/batch.o \
+	${OBJECTDIR}/calculator.o \
+	${OBJECTDIR}/catalog.o \
+	${OBJECTDIR}/compressed.o \
+	${OBJECTDIR}/decay.o \
+	${OBJECTDIR}/decimal.o \
+	${OBJECTDIR}/deflate.o \
+	${OBJECTDIR}/dispense.o \
+	${OBJECTDIR}/formula.o \
+	${OBJECTDIR}/gzip.o \
+	${OBJECTDIR}/instrument.o \
+	${OBJECTDIR}/lineage.o \
+	${OBJECTDIR}/main.o \
+	${OBJECTDIR}/mixing.o \
+	${OBJECTDIR}/partition.o \
+	${OBJECTDIR}/pdf.o \
+	${OBJECTDIR}/plate.o \
+	${OBJECTDIR}/reaction.o \
+	${OBJECTDIR}/report.o \
+	${OBJECTDIR}/sorter.o \
+	${OBJECTDIR}/telemetry.o \
+	${OBJECTDIR}/totals.o \
+	${OBJECTDIR}/worksheet.o \
+	${OBJECTDIR}/xlsx.o \
+	${OBJECTDIR}/zip.o \
+	${OBJECTDIR}/zstd.o
 
 
 # C Compiler Flags
 CFLAGS=
 
 # CC Compiler Flags
-CCFLAGS=`fltk-config --cxxflags --use-images` 
-CXXFLAGS=`fltk-config --cxxflags --use-images` 
+CCFLAGS=`fltk-config --cxxflags --use-images` -DMOLARITY_INSTRUMENT
+CXXFLAGS=`fltk-config --cxxflags --use-images` -DMOLARITY_INSTRUMENT
 
 # Fortran Compiler Flags
 FFLAGS=
@@ -62,11 +87,136 @@ ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/molarity_calculator.exe: ${OBJECTFILE
 	${MKDIR} -p ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}
 	${LINK.cc} -o ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/molarity_calculator ${OBJECTFILES} ${LDLIBSOPTIONS} `fltk-config --ldflags --use-images`
 
+${OBJECTDIR}/batch.o: batch.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/batch.o batch.cpp
+
+${OBJECTDIR}/calculator.o: calculator.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/calculator.o calculator.cpp
+
+${OBJECTDIR}/catalog.o: catalog.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/catalog.o catalog.cpp
+
+${OBJECTDIR}/compressed.o: compressed.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/compressed.o compressed.cpp
+
+${OBJECTDIR}/decay.o: decay.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/decay.o decay.cpp
+
+${OBJECTDIR}/decimal.o: decimal.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/decimal.o decimal.cpp
+
+${OBJECTDIR}/deflate.o: deflate.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/deflate.o deflate.cpp
+
+${OBJECTDIR}/dispense.o: dispense.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/dispense.o dispense.cpp
+
+${OBJECTDIR}/formula.o: formula.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/formula.o formula.cpp
+
+${OBJECTDIR}/gzip.o: gzip.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/gzip.o gzip.cpp
+
+${OBJECTDIR}/instrument.o: instrument.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/instrument.o instrument.cpp
+
+${OBJECTDIR}/lineage.o: lineage.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/lineage.o lineage.cpp
+
 ${OBJECTDIR}/main.o: main.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/main.o main.cpp
 
+${OBJECTDIR}/mixing.o: mixing.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/mixing.o mixing.cpp
+
+${OBJECTDIR}/partition.o: partition.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/partition.o partition.cpp
+
+${OBJECTDIR}/pdf.o: pdf.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/pdf.o pdf.cpp
+
+${OBJECTDIR}/plate.o: plate.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/plate.o plate.cpp
+
+${OBJECTDIR}/reaction.o: reaction.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/reaction.o reaction.cpp
+
+${OBJECTDIR}/report.o: report.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/report.o report.cpp
+
+${OBJECTDIR}/sorter.o: sorter.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/sorter.o sorter.cpp
+
+${OBJECTDIR}/telemetry.o: telemetry.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/telemetry.o telemetry.cpp
+
+${OBJECTDIR}/totals.o: totals.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/totals.o totals.cpp
+
+${OBJECTDIR}/worksheet.o: worksheet.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/worksheet.o worksheet.cpp
+
+${OBJECTDIR}/xlsx.o: xlsx.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/xlsx.o xlsx.cpp
+
+${OBJECTDIR}/zip.o: zip.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/zip.o zip.cpp
+
+${OBJECTDIR}/zstd.o: zstd.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/zstd.o zstd.cpp
+
 # Subprojects
 .build-subprojects:
 
@@ -0,0 +1,45 @@
+// Running independent pieces of batch work on all cores.
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+
+// Returns the number of worker threads to use, at least 1.
+inline unsigned worker_count()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return(count ? count : 1);
+}
+
+
+// Calls work(i) for every i in [0, count), spread over the worker threads, and returns when all calls are done. Calls for different i must not depend on each other. The calling thread takes a share of the work, so no thread is started for a single piece.
+template <typename Work>
+void parallel_for(size_t count, Work work)
+{
+    const size_t threads = std::min<size_t>(worker_count(), count);
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i != count; ++i)
+            work(i);
+        return;
+    }
+
+    auto run = [&](size_t first) {
+        for (size_t i = first; i < count; i += threads)
+            work(i);
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t != threads; ++t)
+        workers.emplace_back(run, t);
+    run(0);
+    for (auto& worker: workers)
+        worker.join();
+}
+
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,149 @@
+#include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include "partition.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: lines formatted per parallel task
+#define PARTITION_CHUNK 4096
+
+
+PartitionWriter::PartitionWriter(const std::string& pattern, const std::string& header, size_t key):
+    pattern(pattern), header(header), key(key), round(0), failed(false)
+{
+}
+
+
+PartitionWriter::~PartitionWriter()
+{
+    for (uint32_t code: open)
+        fclose(files[code]);
+}
+
+
+std::string PartitionWriter::file_name(const std::string& value) const
+{
+    std::string name = value;
+    for (char& c: name)
+        c = (isalnum((unsigned char)c) || c == '-' || c == '.') ? c : '_';
+    const size_t slash = pattern.find_last_of("/\\"), dot = pattern.rfind('.');
+    const size_t end = (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? dot : pattern.size();
+    return(pattern.substr(0, end) + "_" + name + pattern.substr(end));
+}
+
+
+std::string PartitionWriter::unique_file_name(const std::string& value)
+{
+    for (int suffix = 1; ; ++suffix)
+    {
+        const std::string name = file_name((suffix == 1) ? value : value + "_" + std::to_string(suffix));
+        std::string folded = name;
+        for (char& c: folded)
+            c = (char)tolower((unsigned char)c);
+        if (used_names.insert(folded).second)
+            return(name);
+    }
+}
+
+
+void PartitionWriter::write_buffers(const std::vector<uint32_t>& partitions, const TextDictionary& dictionary)
+{
+    // Partitions are written PARTITION_OPEN_FILES at a time: their files are opened first, closing the least recently written others, then written in parallel
+    for (size_t first = 0; first < partitions.size(); first += PARTITION_OPEN_FILES)
+    {
+        const size_t last = std::min(first + PARTITION_OPEN_FILES, partitions.size());
+        ++round;
+        for (size_t p = first; p != last; ++p)
+            last_used[partitions[p]] = round;
+        for (size_t p = first; p != last; ++p)
+        {
+            const uint32_t code = partitions[p];
+            if (files[code])
+                continue;
+            if (open.size() == PARTITION_OPEN_FILES)
+            {
+                auto oldest = std::min_element(open.begin(), open.end(), [&](uint32_t a, uint32_t b) { return(last_used[a] < last_used[b]); });
+                failed |= (fclose(files[*oldest]) != 0);
+                files[*oldest] = nullptr;
+                open.erase(oldest);
+            }
+            // Values that make the same name, such as "P 1" and "P_1", are given different files, so none is overwritten
+            if (!started[code])
+                names[code] = unique_file_name(*dictionary.keys[code]);
+            files[code] = fopen(names[code].c_str(), started[code] ? "ab" : "wb");
+            failed |= !files[code];
+            if (files[code] && !started[code])
+                buffers[code].insert(0, header + "\n");
+            started[code] = 1;
+            if (files[code])
+                open.push_back(code);
+        }
+
+        std::vector<unsigned char> written(last - first, 1);
+        parallel_for(last - first, [&](size_t p) {
+            const uint32_t code = partitions[first + p];
+            if (files[code])
+                written[p] = (fwrite(buffers[code].data(), 1, buffers[code].size(), files[code]) == buffers[code].size());
+            std::string().swap(buffers[code]);
+        });
+        failed |= (std::find(written.begin(), written.end(), 0) != written.end());
+    }
+}
+
+
+void PartitionWriter::add(const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("write_partitions");
+    const BatchKey& batch_key = columns.keys[key];
+    const size_t partitions = batch_key.dictionary.size(), n = columns.size();
+    buffers.resize(partitions);
+    files.resize(partitions, nullptr);
+    started.resize(partitions, 0);
+    names.resize(partitions);
+    last_used.resize(partitions, 0);
+
+    // Each chunk formats its lines into texts of its own for the partitions it meets, which are then added to the buffers in order
+    std::vector<std::vector<std::pair<uint32_t, std::string>>> chunks((n + PARTITION_CHUNK - 1)/PARTITION_CHUNK);
+    parallel_for(chunks.size(), [&](size_t c) {
+        std::unordered_map<uint32_t, size_t> slots;
+        const size_t end = std::min((c + 1)*PARTITION_CHUNK, n);
+        for (size_t i = c*PARTITION_CHUNK; i != end; ++i)
+        {
+            auto inserted = slots.emplace(batch_key.codes[i], chunks[c].size());
+            if (inserted.second)
+                chunks[c].emplace_back(batch_key.codes[i], std::string());
+            format_batch_line(columns, i, chunks[c][inserted.first->second].second);
+        }
+    });
+    std::vector<uint32_t> full;
+    for (const auto& chunk: chunks)
+    {
+        for (const auto& part: chunk)
+        {
+            const bool was_full = buffers[part.first].size() >= PARTITION_BUFFER;
+            buffers[part.first] += part.second;
+            if (!was_full && buffers[part.first].size() >= PARTITION_BUFFER)
+                full.push_back(part.first);
+        }
+    }
+    write_buffers(full, batch_key.dictionary);
+}
+
+
+bool PartitionWriter::finish(const BatchColumns& columns)
+{
+    std::vector<uint32_t> partitions;
+    for (uint32_t code = 0; code != buffers.size(); ++code)
+        if (!buffers[code].empty())
+            partitions.push_back(code);
+    write_buffers(partitions, columns.keys[key].dictionary);
+    for (uint32_t code: open)
+    {
+        failed |= (fclose(files[code]) != 0);
+        files[code] = nullptr;
+    }
+    open.clear();
+    return(!failed);
+}
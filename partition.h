@@ -0,0 +1,56 @@
+// Partitioned batch output: one file of results for each value of a key, such as plate, project or day.
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "batch.h"
+
+// Constants: bytes of lines a partition holds before they are written to its file
+#define PARTITION_BUFFER (1 << 20)
+
+// Constants: most partition files open at once. Files written least recently are closed to open others, and reopened to append.
+#define PARTITION_OPEN_FILES 64
+
+
+// Writes the lines of a batch to one file per value of a key of the batch columns. Lines are formatted in parallel into a buffer per partition, and full buffers are written to their files in parallel, so no single thread writes every file.
+class PartitionWriter {
+    std::string pattern;                // File name; key values are inserted before the extension
+    std::string header;
+    size_t key;                         // Index of the key in BatchColumns::keys
+    std::vector<std::string> buffers;   // By key code, lines not yet written
+    std::vector<FILE*> files;           // By key code, nullptr if not open
+    std::vector<std::string> names;     // By key code, name of the file, empty until it is created
+    std::unordered_set<std::string> used_names;     // Names of the files created, in lower case as Windows compares them
+    std::vector<unsigned char> started; // By key code, whether the file has been created
+    std::vector<size_t> last_used;      // By key code, round of writes the file was last written in
+    std::vector<uint32_t> open;         // Codes of the open files
+    size_t round;
+    bool failed;
+
+    void write_buffers(const std::vector<uint32_t>& partitions, const TextDictionary& dictionary);
+
+public:
+    // Starts writing files named after pattern, each beginning with the line header, for key number key of the batch columns.
+    PartitionWriter(const std::string& pattern, const std::string& header, size_t key);
+    ~PartitionWriter();
+
+    // Returns the file name of the partition with key value value: pattern with "_<value>" inserted before the extension, characters other than letters, digits, "-" and "." becoming "_".
+    std::string file_name(const std::string& value) const;
+
+    // Returns file_name(value), or if a file of another value already has that name, ignoring case, the first of file_name(value + "_2"), file_name(value + "_3") and so on that no file has. The name is then taken.
+    std::string unique_file_name(const std::string& value);
+
+    // Adds the lines of a solved block to the buffers of their partitions, and writes the buffers that are full.
+    void add(const BatchColumns& columns);
+
+    // Writes the remaining lines and closes the files. Returns false if a file could not be written.
+    bool finish(const BatchColumns& columns);
+};
+
+
+#endif /* PARTITION_H */
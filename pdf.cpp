@@ -0,0 +1,142 @@
+#include <cstring>
+#include <ctime>
+#include "pdf.h"
+#include "deflate.h"
+
+
+// Constants: objects with fixed numbers. The page tree and catalog are written last but numbered first so pages can refer to them.
+#define PAGES_OBJECT 1
+#define CATALOG_OBJECT 2
+#define FIRST_FONT_OBJECT 3
+
+// Constants: names of the standard fonts in the order of PdfPage::Font
+static const char* font_names[] = {
+    "Helvetica",
+    "Helvetica-Bold",
+    "Courier"
+};
+
+
+// Escapes text for a PDF string literal
+static std::string pdf_string(const std::string& text)
+{
+    std::string escaped = "(";
+    for (char c: text)
+    {
+        if (c == '(' || c == ')' || c == '\\')
+            escaped += '\\';
+        escaped += (c >= ' ' && c <= '~') ? c : '?';
+    }
+    return(escaped + ")");
+}
+
+
+void PdfPage::text(double x, double y, Font font, double size, const std::string& text)
+{
+    char operators[96];
+    snprintf(operators, sizeof operators, "BT /F%d %.1f Tf %.2f %.2f Td ", (int)font + 1, size, x, y);
+    content += operators;
+    content += pdf_string(text);
+    content += " Tj ET\n";
+}
+
+
+void PdfPage::line(double x1, double y1, double x2, double y2)
+{
+    char operators[96];
+    snprintf(operators, sizeof operators, "%.2f %.2f m %.2f %.2f l S\n", x1, y1, x2, y2);
+    content += operators;
+}
+
+
+std::vector<unsigned char> PdfPage::compress() const
+{
+    std::vector<unsigned char> compressed;
+    zlib_compress((const unsigned char*)content.data(), content.size(), compressed);
+    return(compressed);
+}
+
+
+void PdfWriter::write(const char* data, size_t size)
+{
+    fwrite(data, 1, size, out);
+    offset += (long)size;
+}
+
+
+void PdfWriter::write(const std::string& data)
+{
+    write(data.data(), data.size());
+}
+
+
+int PdfWriter::begin_object(int number)
+{
+    if (!number)
+    {
+        object_offsets.push_back(0);
+        number = (int)object_offsets.size();
+    }
+    object_offsets[number - 1] = offset;
+    write(std::to_string(number) + " 0 obj\n");
+    return(number);
+}
+
+
+PdfWriter::PdfWriter(FILE* out) : out(out), offset(0), object_offsets(FIRST_FONT_OBJECT - 1, 0)
+{
+    write("%PDF-1.4\n%\xe2\xe3\xcf\xd3\n"); // The binary comment marks the file as binary for transfer programs
+
+    for (const char* name: font_names)
+    {
+        begin_object();
+        write(std::string("<< /Type /Font /Subtype /Type1 /BaseFont /") + name + " /Encoding /WinAnsiEncoding >>\nendobj\n");
+    }
+}
+
+
+void PdfWriter::add_page(const std::vector<unsigned char>& compressed_content)
+{
+    int content_object = begin_object();
+    write("<< /Length " + std::to_string(compressed_content.size()) + " /Filter /FlateDecode >>\nstream\n");
+    write((const char*)compressed_content.data(), compressed_content.size());
+    write("\nendstream\nendobj\n");
+
+    std::string fonts;
+    for (unsigned f = 0; f != sizeof font_names/sizeof *font_names; ++f)
+        fonts += " /F" + std::to_string(f + 1) + " " + std::to_string(FIRST_FONT_OBJECT + f) + " 0 R";
+    page_objects.push_back(begin_object());
+    write("<< /Type /Page /Parent " + std::to_string(PAGES_OBJECT) + " 0 R /MediaBox [0 0 " + std::to_string(PDF_PAGE_WIDTH) + " " + std::to_string(PDF_PAGE_HEIGHT) + "]"
+          " /Resources << /Font <<" + fonts + " >> >> /Contents " + std::to_string(content_object) + " 0 R >>\nendobj\n");
+}
+
+
+bool PdfWriter::finish(const char* title)
+{
+    begin_object(PAGES_OBJECT);
+    write("<< /Type /Pages /Count " + std::to_string(page_objects.size()) + " /Kids [");
+    for (int page: page_objects)
+        write(" " + std::to_string(page) + " 0 R");
+    write(" ] >>\nendobj\n");
+
+    begin_object(CATALOG_OBJECT);
+    write("<< /Type /Catalog /Pages " + std::to_string(PAGES_OBJECT) + " 0 R >>\nendobj\n");
+
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof date, "D:%Y%m%d%H%M%S", localtime(&now));
+    int info_object = begin_object();
+    write("<< /Title " + pdf_string(title) + " /Producer (Molarity Calculator) /CreationDate (" + date + ") >>\nendobj\n");
+
+    long xref_offset = offset;
+    write("xref\n0 " + std::to_string(object_offsets.size() + 1) + "\n0000000000 65535 f \n");
+    for (long object_offset: object_offsets)
+    {
+        char entry[24];
+        snprintf(entry, sizeof entry, "%010ld 00000 n \n", object_offset);
+        write(entry, 20);
+    }
+    write("trailer\n<< /Size " + std::to_string(object_offsets.size() + 1) + " /Root " + std::to_string(CATALOG_OBJECT) + " 0 R /Info " + std::to_string(info_object) + " 0 R >>\n"
+          "startxref\n" + std::to_string(xref_offset) + "\n%%EOF\n");
+    return(!ferror(out));
+}
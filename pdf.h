@@ -0,0 +1,63 @@
+// A minimal PDF writer that streams pages to a file as they are produced.
+
+#ifndef PDF_H
+#define PDF_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Constants: A4 page size in points
+#define PDF_PAGE_WIDTH 595
+#define PDF_PAGE_HEIGHT 842
+
+
+// Builds the content stream of one page. Text uses the standard PDF fonts, which every reader has, so no font is embedded and nothing needs subsetting. Only ASCII text is supported.
+class PdfPage {
+    std::string content;
+public:
+    // Constants: fonts available on every page
+    enum Font {
+        helvetica,
+        helvetica_bold,
+        courier
+    };
+
+    // Draws text with its baseline starting at (x, y), measured in points from the bottom left corner.
+    void text(double x, double y, Font font, double size, const std::string& text);
+
+    // Draws a line from (x1, y1) to (x2, y2).
+    void line(double x1, double y1, double x2, double y2);
+
+    // Returns the zlib compressed content stream, ready for PdfWriter::add_page. Safe to call from any thread.
+    std::vector<unsigned char> compress() const;
+};
+
+
+// Writes a PDF file. Each page is written as soon as it is added, so only offsets are kept in memory; the page tree and cross-reference table follow in finish.
+class PdfWriter {
+    FILE* out;
+    long offset;
+    std::vector<long> object_offsets;   // Indexed by object number - 1
+    std::vector<int> page_objects;
+
+    void write(const char* data, size_t size);
+    void write(const std::string& data);
+    int begin_object(int number = 0);
+
+public:
+    // Writes the file header and fonts to out, which must be open in binary mode.
+    explicit PdfWriter(FILE* out);
+
+    // Appends a page with a content stream from PdfPage::compress.
+    void add_page(const std::vector<unsigned char>& compressed_content);
+
+    // Returns the number of pages added so far.
+    int page_count() const { return((int)page_objects.size()); }
+
+    // Writes the page tree, document information and cross-reference table. Returns false if writing failed. The writer must not be used afterwards.
+    bool finish(const char* title);
+};
+
+
+#endif /* PDF_H */
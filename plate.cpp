@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include "plate.h"
+#include "deflate.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: margins around the wells in pixels, leaving room for labels and the colour scale
+#define MARGIN_LEFT 40
+#define MARGIN_TOP 50
+#define MARGIN_RIGHT 20
+#define MARGIN_BOTTOM 60
+
+// Constants: base unit of each calculator row, as batch values are stored
+static const char* base_units[ROWS] = {
+    "g", "g/mol", "mol", "L", "M"
+};
+
+// Constants: colour scale from the lowest to the highest value (viridis), and the colour of empty wells
+static const unsigned char scale_stops[5][3] = {
+    {68, 1, 84}, {59, 82, 139}, {33, 145, 140}, {94, 201, 98}, {253, 231, 37}
+};
+static const unsigned char empty_colour[3] = {200, 200, 200};
+
+
+bool plate_format(int wells, PlateFormat& format)
+{
+    switch (wells)
+    {
+        case 96:
+            format = PlateFormat{8, 12};
+            return(true);
+        case 384:
+            format = PlateFormat{16, 24};
+            return(true);
+        case 1536:
+            format = PlateFormat{32, 48};
+            return(true);
+        default:
+            return(false);
+    }
+}
+
+
+// Writes a PNG chunk: length, type, data and the CRC of type and data
+static void put_chunk(FILE* out, const char* type, const std::vector<unsigned char>& data)
+{
+    unsigned char header[8] = {
+        (unsigned char)(data.size() >> 24), (unsigned char)(data.size() >> 16), (unsigned char)(data.size() >> 8), (unsigned char)data.size()
+    };
+    memcpy(header + 4, type, 4);
+    unsigned long crc = crc32(crc32(0, header + 4, 4), data.data(), data.size());
+    unsigned char trailer[4] = {
+        (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc
+    };
+    fwrite(header, 1, 8, out);
+    fwrite(data.data(), 1, data.size(), out);
+    fwrite(trailer, 1, 4, out);
+}
+
+
+bool write_png(const char* path, int width, int height, const std::vector<unsigned char>& rgb)
+{
+    FILE* out = fopen(path, "wb");
+    if (!out)
+        return(false);
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, 8, out);
+
+    std::vector<unsigned char> header = {
+        (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+        (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+        8, 2, 0, 0, 0   // 8 bits per sample, RGB, deflate, standard filters, no interlace
+    };
+    put_chunk(out, "IHDR", header);
+
+    // Every scanline starts with its filter type, 0 (none)
+    std::vector<unsigned char> scanlines;
+    scanlines.reserve((size_t)height*(3*width + 1));
+    for (int y = 0; y != height; ++y)
+    {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgb.begin() + (size_t)y*3*width, rgb.begin() + (size_t)(y + 1)*3*width);
+    }
+    std::vector<unsigned char> compressed;
+    zlib_compress(scanlines.data(), scanlines.size(), compressed);
+    put_chunk(out, "IDAT", compressed);
+    put_chunk(out, "IEND", std::vector<unsigned char>());
+
+    bool written = !ferror(out);
+    return(fclose(out) == 0 && written);
+}
+
+
+// Colour of a value scaled to t in [0, 1]
+static void scale_colour(double t, unsigned char rgb[3])
+{
+    t = std::min(std::max(t, 0.0), 1.0)*4;
+    int stop = std::min((int)t, 3);
+    double f = t - stop;
+    for (int c = 0; c != 3; ++c)
+        rgb[c] = (unsigned char)std::lround(scale_stops[stop][c]*(1 - f) + scale_stops[stop + 1][c]*f);
+}
+
+
+// Row label of a well: A to Z, then AA to AF on 1536-well plates
+static std::string row_label(int r)
+{
+    return((r < 26) ? std::string(1, (char)('A' + r)) : std::string("A") + (char)('A' + r - 26));
+}
+
+
+// Colours of the wells of one plate, and the range they were scaled to
+struct PlateColours {
+    std::vector<unsigned char> rgb;     // Three bytes per well
+    double low, high;
+    bool any;
+};
+
+static PlateColours colour_plate(const double* values, size_t wells)
+{
+    PlateColours colours = {std::vector<unsigned char>(3*wells), 0, 0, false};
+    for (size_t w = 0; w != wells; ++w)
+    {
+        if (std::isnan(values[w]))
+            continue;
+        colours.low = colours.any ? std::min(colours.low, values[w]) : values[w];
+        colours.high = colours.any ? std::max(colours.high, values[w]) : values[w];
+        colours.any = true;
+    }
+    const double range = colours.high - colours.low;
+    for (size_t w = 0; w != wells; ++w)
+    {
+        if (std::isnan(values[w]))
+            memcpy(&colours.rgb[3*w], empty_colour, 3);
+        else
+            scale_colour(range > 0 ? (values[w] - colours.low)/range : 0.5, &colours.rgb[3*w]);
+    }
+    return(colours);
+}
+
+
+static bool write_plate_svg(const char* path, const double* values, const PlateFormat& format, int number, long value_row)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return(false);
+
+    const size_t wells = (size_t)format.rows*format.columns;
+    const PlateColours colours = colour_plate(values, wells);
+    const int cell = PLATE_IMAGE_WIDTH/format.columns;
+    const int width = MARGIN_LEFT + cell*format.columns + MARGIN_RIGHT;
+    const int height = MARGIN_TOP + cell*format.rows + MARGIN_BOTTOM;
+    const int label_size = std::max(6, std::min(12, cell*2/3));
+
+    fprintf(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" font-family=\"Helvetica, Arial, sans-serif\">\n", width, height);
+    fprintf(out, "<rect width=\"%d\" height=\"%d\" fill=\"white\"/>\n", width, height);
+    fprintf(out, "<text x=\"%d\" y=\"20\" font-size=\"14\" font-weight=\"bold\">Plate %d: %s (%s)</text>\n", MARGIN_LEFT, number, row_header[value_row], base_units[value_row]);
+
+    for (int c = 0; c != format.columns; ++c)
+        fprintf(out, "<text x=\"%d\" y=\"%d\" font-size=\"%d\" text-anchor=\"middle\">%d</text>\n", MARGIN_LEFT + c*cell + cell/2, MARGIN_TOP - 4, label_size, c + 1);
+    for (int r = 0; r != format.rows; ++r)
+        fprintf(out, "<text x=\"%d\" y=\"%d\" font-size=\"%d\" text-anchor=\"end\">%s</text>\n", MARGIN_LEFT - 4, MARGIN_TOP + r*cell + cell/2 + label_size/3, label_size, row_label(r).c_str());
+
+    for (size_t w = 0; w != wells; ++w)
+    {
+        const int r = (int)(w/format.columns), c = (int)(w%format.columns);
+        const unsigned char* rgb = &colours.rgb[3*w];
+        fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%02x%02x%02x\" stroke=\"white\"><title>%s%d: ",
+                MARGIN_LEFT + c*cell, MARGIN_TOP + r*cell, cell, cell, rgb[0], rgb[1], rgb[2], row_label(r).c_str(), c + 1);
+        std::isnan(values[w]) ? fprintf(out, "empty") : fprintf(out, "%.6g", values[w]);
+        fprintf(out, "</title></rect>\n");
+    }
+
+    // Colour scale with the range of this plate
+    const int bar_y = MARGIN_TOP + cell*format.rows + 20;
+    const int bar_width = cell*format.columns;
+    fprintf(out, "<defs><linearGradient id=\"scale\">");
+    for (int s = 0; s != 5; ++s)
+        fprintf(out, "<stop offset=\"%d%%\" stop-color=\"#%02x%02x%02x\"/>", s*25, scale_stops[s][0], scale_stops[s][1], scale_stops[s][2]);
+    fprintf(out, "</linearGradient></defs>\n");
+    fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"12\" fill=\"url(#scale)\"/>\n", MARGIN_LEFT, bar_y, bar_width);
+    if (colours.any)
+    {
+        fprintf(out, "<text x=\"%d\" y=\"%d\" font-size=\"11\">%.4g</text>\n", MARGIN_LEFT, bar_y + 26, colours.low);
+        fprintf(out, "<text x=\"%d\" y=\"%d\" font-size=\"11\" text-anchor=\"end\">%.4g</text>\n", MARGIN_LEFT + bar_width, bar_y + 26, colours.high);
+    }
+    fprintf(out, "</svg>\n");
+
+    bool written = !ferror(out);
+    return(fclose(out) == 0 && written);
+}
+
+
+// PNG plate maps have no text; each well is a square with a one pixel white border, and the colour scale runs along the bottom
+static bool write_plate_png(const char* path, const double* values, const PlateFormat& format)
+{
+    const size_t wells = (size_t)format.rows*format.columns;
+    const PlateColours colours = colour_plate(values, wells);
+    const int cell = PLATE_IMAGE_WIDTH/format.columns;
+    const int width = MARGIN_LEFT + cell*format.columns + MARGIN_RIGHT;
+    const int height = MARGIN_TOP + cell*format.rows + MARGIN_BOTTOM;
+    std::vector<unsigned char> rgb((size_t)3*width*height, 255);
+
+    auto fill = [&](int x0, int y0, int w, int h, const unsigned char* colour) {
+        for (int y = y0; y != y0 + h; ++y)
+            for (int x = x0; x != x0 + w; ++x)
+                memcpy(&rgb[3*((size_t)y*width + x)], colour, 3);
+    };
+    for (size_t w = 0; w != wells; ++w)
+    {
+        const int r = (int)(w/format.columns), c = (int)(w%format.columns);
+        fill(MARGIN_LEFT + c*cell + 1, MARGIN_TOP + r*cell + 1, cell - 2, cell - 2, &colours.rgb[3*w]);
+    }
+    const int bar_y = MARGIN_TOP + cell*format.rows + 20;
+    const int bar_width = cell*format.columns;
+    for (int x = 0; x != bar_width; ++x)
+    {
+        unsigned char colour[3];
+        scale_colour((double)x/(bar_width - 1), colour);
+        fill(MARGIN_LEFT + x, bar_y, 1, 12, colour);
+    }
+    return(write_png(path, width, height, rgb));
+}
+
+
+// Returns pattern with "_<number>" inserted before the extension
+static std::string plate_file_name(const std::string& pattern, int number)
+{
+    size_t dot = pattern.rfind('.');
+    return(pattern.substr(0, dot) + "_" + std::to_string(number) + pattern.substr(dot));
+}
+
+
+PlateMapWriter::PlateMapWriter(const std::string& pattern, const PlateFormat& format, long value_row)
+    : pattern(pattern), png(pattern.size() >= 4 && pattern.compare(pattern.size() - 4, 4, ".png") == 0),
+      format(format), value_row(value_row), plates_done(0), failed(false)
+{
+}
+
+
+void PlateMapWriter::write_plates(size_t count)
+{
+    INSTRUMENT_SCOPE("write_plates");
+    const size_t wells = (size_t)format.rows*format.columns;
+    std::vector<char> written(count);
+    parallel_for(count, [&](size_t p) {
+        const int number = plates_done + (int)p + 1;
+        const std::string path = plate_file_name(pattern, number);
+        const double* values = &pending[p*wells];
+        written[p] = png ? write_plate_png(path.c_str(), values, format)
+                         : write_plate_svg(path.c_str(), values, format, number, value_row);
+    });
+
+    for (char ok: written)
+        failed |= !ok;
+    plates_done += (int)count;
+    pending.erase(pending.begin(), pending.begin() + count*wells);
+}
+
+
+void PlateMapWriter::add(const BatchColumns& columns)
+{
+    const unsigned char value_bit = 1 << value_row;
+    const size_t n = columns.size();
+    for (size_t i = 0; i != n; ++i)
+        pending.push_back((columns.validity[i].valid & value_bit) ? columns.values[value_row][i] : NAN);
+    write_plates(pending.size()/((size_t)format.rows*format.columns));
+}
+
+
+bool PlateMapWriter::finish()
+{
+    if (!pending.empty())
+    {
+        pending.resize((size_t)format.rows*format.columns, NAN);
+        write_plates(1);
+    }
+    return(!failed);
+}
@@ -0,0 +1,51 @@
+// Plate maps: batch results laid out on microplates and drawn as SVG or PNG images, one file per plate.
+
+#ifndef PLATE_H
+#define PLATE_H
+
+#include <string>
+#include <vector>
+#include "batch.h"
+
+
+// Constants: image width of a plate map in pixels, before margins
+#define PLATE_IMAGE_WIDTH 576
+
+// Well layout of a plate
+struct PlateFormat {
+    int rows;
+    int columns;
+};
+
+// Finds the layout of a plate with the given number of wells (96, 384 or 1536). Returns false for other sizes.
+bool plate_format(int wells, PlateFormat& format);
+
+// Writes rgb, width*height pixels of three bytes each, to path as a PNG image. Returns false if writing failed.
+bool write_png(const char* path, int width, int height, const std::vector<unsigned char>& rgb);
+
+
+// Writes plate maps of batch results. Lines fill the wells of consecutive plates row by row (A1, A2, ... B1, ...). Each plate is coloured by one row of the calculator, scaled from its own lowest to highest value; wells without a value are grey. Full plates are drawn in parallel as each block arrives.
+class PlateMapWriter {
+    std::string pattern;        // File name; plate numbers are inserted before the extension
+    bool png;
+    PlateFormat format;
+    long value_row;
+    int plates_done;
+    std::vector<double> pending;   // Values of wells not yet on a written plate, NaN if empty
+    bool failed;
+
+    void write_plates(size_t count);
+
+public:
+    // Starts writing plates with the given number of wells to files named after pattern, which must end in ".svg" or ".png", coloured by value_row.
+    PlateMapWriter(const std::string& pattern, const PlateFormat& format, long value_row);
+
+    // Adds the lines of a solved block.
+    void add(const BatchColumns& columns);
+
+    // Writes the last, partly filled plate. Returns false if any file could not be written.
+    bool finish();
+};
+
+
+#endif /* PLATE_H */
@@ -0,0 +1,323 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include "reaction.h"
+#include "calculator.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: arrows separating reactants from products, tried in this order
+static const char* arrows[] = {"->", "=>", "\xe2\x86\x92", "="};
+
+
+std::string Reaction::equation() const
+{
+    std::string text;
+    for (size_t s = 0; s != species.size(); ++s)
+    {
+        if (s)
+            text += (species[s].reactant == species[s - 1].reactant) ? " + " : " -> ";
+        if (species[s].coefficient != 1)
+            text += std::to_string(species[s].coefficient) + " ";
+        text += species[s].formula;
+    }
+    return(text);
+}
+
+
+// Splits one side of an equation at each "+" that is not the sign of a charge
+static bool parse_side(const std::string& side, bool reactant, Reaction& reaction, std::string& error)
+{
+    size_t start = 0;
+    bool in_charge = false;
+    for (size_t i = 0; i <= side.size(); ++i)
+    {
+        const char c = (i < side.size()) ? side[i] : '+';
+        if (in_charge && (c == '+' || c == '-'))
+        {
+            in_charge = false;
+            continue;
+        }
+        in_charge = (c == '^') || (in_charge && isdigit((unsigned char)c));
+        if (c != '+')
+            continue;
+
+        Species species;
+        const size_t first = side.find_first_not_of(" \t", start);
+        const size_t last = side.find_last_not_of(" \t", i - 1);
+        species.formula = (first < i && last != std::string::npos && last >= first) ? side.substr(first, last - first + 1) : "";
+        species.formula.erase(0, species.formula.find_first_not_of("0123456789 "));
+        if (!parse_formula(species.formula, species.composition, error))
+            return(false);
+        species.molar_mass = formula_molar_mass(species.composition);
+        species.coefficient = 1;
+        species.reactant = reactant;
+        reaction.species.push_back(species);
+        start = i + 1;
+    }
+    return(true);
+}
+
+
+bool parse_reaction(const std::string& text, Reaction& reaction, std::string& error)
+{
+    reaction.species.clear();
+    for (const char* arrow: arrows)
+    {
+        const size_t at = text.find(arrow);
+        if (at == std::string::npos)
+            continue;
+        return(parse_side(text.substr(0, at), true, reaction, error) && parse_side(text.substr(at + strlen(arrow)), false, reaction, error));
+    }
+    error = "no arrow between reactants and products";
+    return(false);
+}
+
+
+// A fraction kept in lowest terms with a positive denominator
+struct Fraction {
+    long long numerator, denominator;
+
+    Fraction(long long n = 0, long long d = 1)
+    {
+        long long divisor = gcd(std::llabs(n), std::llabs(d));
+        divisor = divisor ? divisor : 1;
+        numerator = ((d < 0) ? -n : n)/divisor;
+        denominator = std::llabs(d)/divisor;
+    }
+    static long long gcd(long long a, long long b) { return(b ? gcd(b, a%b) : a); }
+
+    Fraction operator-(const Fraction& f) const { return(Fraction(numerator*f.denominator - f.numerator*denominator, denominator*f.denominator)); }
+    Fraction operator*(const Fraction& f) const { return(Fraction(numerator*f.numerator, denominator*f.denominator)); }
+    Fraction operator/(const Fraction& f) const { return(Fraction(numerator*f.denominator, denominator*f.numerator)); }
+};
+
+
+bool balance_reaction(Reaction& reaction, std::string& error)
+{
+    // One row per element (and charge), one column per species; products count negative
+    std::vector<std::string> elements;
+    for (const Species& species: reaction.species)
+        for (const auto& atoms: species.composition)
+            if (std::find(elements.begin(), elements.end(), atoms.first) == elements.end())
+                elements.push_back(atoms.first);
+    const size_t rows = elements.size(), columns = reaction.species.size();
+    std::vector<std::vector<Fraction>> matrix(rows, std::vector<Fraction>(columns));
+    for (size_t r = 0; r != rows; ++r)
+    {
+        for (size_t c = 0; c != columns; ++c)
+        {
+            const Species& species = reaction.species[c];
+            auto atoms = species.composition.find(elements[r]);
+            if (atoms != species.composition.end())
+                matrix[r][c] = Fraction(species.reactant ? atoms->second : -atoms->second);
+        }
+    }
+
+    // Reduced row echelon form
+    std::vector<size_t> pivot_columns;
+    for (size_t c = 0; c != columns && pivot_columns.size() != rows; ++c)
+    {
+        const size_t p = pivot_columns.size();
+        size_t r = p;
+        while (r != rows && matrix[r][c].numerator == 0)
+            ++r;
+        if (r == rows)
+            continue;
+        std::swap(matrix[p], matrix[r]);
+        const Fraction pivot = matrix[p][c];
+        for (Fraction& entry: matrix[p])
+            entry = entry/pivot;
+        for (size_t other = 0; other != rows; ++other)
+        {
+            const Fraction factor = matrix[other][c];
+            if (other == p || factor.numerator == 0)
+                continue;
+            for (size_t k = 0; k != columns; ++k)
+                matrix[other][k] = matrix[other][k] - factor*matrix[p][k];
+        }
+        pivot_columns.push_back(c);
+    }
+    if (pivot_columns.size() + 1 != columns)
+    {
+        error = (pivot_columns.size() == columns) ? "cannot be balanced" : "has more than one independent balance";
+        return(false);
+    }
+
+    // The one free column is set to 1 and the pivot columns follow from it; scaled to whole numbers in lowest terms
+    size_t free_column = 0;
+    while (free_column != pivot_columns.size() && pivot_columns[free_column] == free_column)
+        ++free_column;
+    std::vector<Fraction> solution(columns);
+    solution[free_column] = Fraction(1);
+    for (size_t p = 0; p != pivot_columns.size(); ++p)
+        solution[pivot_columns[p]] = Fraction(0) - matrix[p][free_column];
+    long long multiple = 1, divisor = 0;
+    for (const Fraction& x: solution)
+        multiple = multiple/Fraction::gcd(multiple, x.denominator)*x.denominator;
+    for (const Fraction& x: solution)
+        divisor = Fraction::gcd(divisor, std::llabs(x.numerator*(multiple/x.denominator)));
+    for (size_t c = 0; c != columns; ++c)
+    {
+        const long long coefficient = solution[c].numerator*(multiple/solution[c].denominator)/divisor;
+        if (coefficient <= 0)
+        {
+            error = "cannot be balanced with " + reaction.species[c].formula + " on that side";
+            return(false);
+        }
+        reaction.species[c].coefficient = (long)coefficient;
+    }
+    return(true);
+}
+
+
+// Calculates target from the rows of values marked in valid, with the relations of the calculator window
+static double calculate(long target, unsigned long valid, const double values[ROWS])
+{
+    double moles;
+    return(solve(target, find_relation(target, valid).source, values, moles));
+}
+
+
+bool plan_reaction(const Reaction& reaction, double molarity, double volume, const std::vector<double>& masses, ReactionAmounts& amounts, std::string& error)
+{
+    amounts.extent = INFINITY;
+    amounts.limiting = -1;
+    for (size_t s = 0; s != reaction.species.size() && reaction.species[s].reactant; ++s)
+    {
+        const Species& species = reaction.species[s];
+        double values[ROWS] = {s < masses.size() ? masses[s] : NAN, species.molar_mass, 0, volume, molarity};
+        double moles = NAN;
+        if (!std::isnan(values[0]))
+            moles = calculate(2, RowEnum::mass | RowEnum::molar_mass, values);
+        if (s == 0 && !std::isnan(molarity) && !std::isnan(volume))
+            moles = std::isnan(moles) ? calculate(2, RowEnum::volume | RowEnum::molarity, values) : std::min(moles, calculate(2, RowEnum::volume | RowEnum::molarity, values));
+        if (!std::isnan(moles) && moles/species.coefficient < amounts.extent)
+        {
+            amounts.extent = moles/species.coefficient;
+            amounts.limiting = (int)s;
+        }
+    }
+    if (amounts.limiting < 0)
+    {
+        error = "no amount given";
+        return(false);
+    }
+
+    const size_t count = reaction.species.size();
+    amounts.moles.resize(count);
+    amounts.masses.resize(count);
+    amounts.molarities.resize(count);
+    for (size_t s = 0; s != count; ++s)
+    {
+        double values[ROWS] = {0, reaction.species[s].molar_mass, reaction.species[s].coefficient*amounts.extent, volume, 0};
+        amounts.moles[s] = values[2];
+        amounts.masses[s] = calculate(0, RowEnum::molar_mass | RowEnum::moles, values);
+        amounts.molarities[s] = std::isnan(volume) ? NAN : calculate(4, RowEnum::moles | RowEnum::volume, values);
+    }
+    return(true);
+}
+
+
+// Formats value to figures significant figures, or in full if figures is 0; empty if it is not a number
+static std::string format_amount(double value, int figures)
+{
+    char text[64] = "";
+    if (std::isnan(value))
+        return("");
+    if (figures)
+        format_sig_figs(text, sizeof text, value, figures);
+    else
+        snprintf(text, sizeof text, "%.15g", value);
+    return(text);
+}
+
+
+// Plans the reaction on one input line and appends its output lines to out
+static void plan_line(size_t number, char* line, std::string& out)
+{
+    std::vector<char*> fields;
+    for (char* field = line;; )
+    {
+        size_t length = strcspn(field, ",\r\n");
+        char end = field[length];
+        field[length] = '\0';
+        fields.push_back(field);
+        if (end != ',')
+            break;
+        field += length + 1;
+    }
+
+    // Amounts are given to the fewest significant figures among those used
+    int figures = 0;
+    auto number_field = [&](size_t f) -> double {
+        double value = NAN;
+        if (f < fields.size() && parse_value(fields[f], value) == input_parsed)
+        {
+            const int field_figures = count_sig_figs(fields[f]);
+            figures = figures ? std::min(figures, field_figures) : field_figures;
+            return(value);
+        }
+        return(NAN);
+    };
+    const double molarity = number_field(1), volume = number_field(2);
+    std::vector<double> masses;
+    for (size_t f = 3; f < fields.size(); ++f)
+        masses.push_back(number_field(f));
+
+    Reaction reaction;
+    ReactionAmounts amounts;
+    std::string error;
+    const std::string prefix = std::to_string(number) + ",";
+    if (!parse_reaction(fields[0], reaction, error) || !balance_reaction(reaction, error) || !plan_reaction(reaction, molarity, volume, masses, amounts, error))
+    {
+        out += prefix + fields[0] + ",,,,,,,,," + error + "\n";
+        return;
+    }
+
+    const std::string equation = reaction.equation();
+    for (size_t s = 0; s != reaction.species.size(); ++s)
+    {
+        const Species& species = reaction.species[s];
+        char molar_mass[32];
+        snprintf(molar_mass, sizeof molar_mass, "%.10g", species.molar_mass);
+        out += prefix + equation + "," + species.formula + "," + (species.reactant ? "reactant," : "product,") + std::to_string(species.coefficient) + "," +
+               molar_mass + "," + format_amount(amounts.moles[s], figures) + "," + format_amount(amounts.masses[s], figures) + "," +
+               format_amount(amounts.molarities[s], figures) + "," + ((int)s == amounts.limiting ? "yes" : "") + ",\n";
+    }
+}
+
+
+int reaction_main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s --reaction < reactions.csv\n", argv[0]);
+        return(2);
+    }
+
+    char line[1024];
+    std::vector<std::string> lines;
+    if (fgets(line, sizeof line, stdin))
+    {
+        while (fgets(line, sizeof line, stdin))
+            lines.push_back(line);
+    }
+    printf("line,equation,species,role,coefficient,molar_mass,moles,mass,molarity,limiting,note\n");
+
+    std::vector<std::string> chunks((lines.size() + REACTION_CHUNK - 1)/REACTION_CHUNK);
+    {
+        INSTRUMENT_SCOPE("plan_reactions");
+        parallel_for(chunks.size(), [&](size_t chunk) {
+            const size_t end = std::min((chunk + 1)*REACTION_CHUNK, lines.size());
+            for (size_t l = chunk*REACTION_CHUNK; l != end; ++l)
+                plan_line(l + 1, &lines[l][0], chunks[chunk]);
+        });
+    }
+    for (const std::string& chunk: chunks)
+        fputs(chunk.c_str(), stdout);
+    return(0);
+}
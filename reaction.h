@@ -0,0 +1,52 @@
+// Reactions: balancing chemical equations and working out the amounts of each reagent and product.
+
+#ifndef REACTION_H
+#define REACTION_H
+
+#include <string>
+#include <vector>
+#include "formula.h"
+
+// Constants: reactions planned per parallel task
+#define REACTION_CHUNK 256
+
+
+// A reagent or product of a reaction
+struct Species {
+    std::string formula;
+    Composition composition;
+    double molar_mass;
+    long coefficient;           // Set by balance_reaction
+    bool reactant;
+};
+
+// A reaction, reactants first
+struct Reaction {
+    std::vector<Species> species;
+
+    // Returns the equation with its coefficients, such as "2 H2 + O2 -> 2 H2O".
+    std::string equation() const;
+};
+
+// Amounts in a reaction run to completion
+struct ReactionAmounts {
+    double extent;              // Moles of reaction: the moles of each species divided by its coefficient
+    int limiting;               // Index of the limiting reagent
+    std::vector<double> moles, masses, molarities;
+};
+
+
+// Parses an equation "reactants -> products" (also "=>", "=" or an arrow), with the species on each side separated by "+", into reaction. Coefficients in the equation are ignored. Returns false and sets error if a formula cannot be read.
+bool parse_reaction(const std::string& text, Reaction& reaction, std::string& error);
+
+// Finds the smallest whole-number coefficients that conserve every element and charge, by Gaussian elimination over fractions on the matrix of element counts. Returns false and sets error if the equation has no balance, or more than one independent balance.
+bool balance_reaction(Reaction& reaction, std::string& error);
+
+// Works out the amounts of a balanced reaction. The first reactant at molarity in volume (M and L, NaN if not given) and the masses available of the reactants (g, in order, NaN where not given) each limit how far it can go; the reagent that runs out first is limiting. Masses and molarities in volume follow from the calculator's relations. Returns false and sets error if no amount is given.
+bool plan_reaction(const Reaction& reaction, double molarity, double volume, const std::vector<double>& masses, ReactionAmounts& amounts, std::string& error);
+
+// Command line mode: "--reaction" reads lines of "equation,molarity,volume[,mass of reactant 1,...]" from standard input and writes one line per species of each reaction: its coefficient, molar mass, moles, mass and molarity in the volume, and whether it is the limiting reagent. The first line is a header. Reactions are balanced and planned in parallel.
+int reaction_main(int argc, char** argv);
+
+
+#endif /* REACTION_H */
@@ -0,0 +1,133 @@
+#include <cstring>
+#include <ctime>
+#include "report.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: page layout in points
+#define MARGIN 36
+#define TABLE_TOP 756
+#define LINE_STEP 11
+#define TABLE_FONT_SIZE 8
+
+// Constants: lines formatted per parallel task
+#define FORMAT_CHUNK 4096
+
+// Constants: table column headings, in the order of the calculator rows
+static const char* column_headings[ROWS] = {
+    "Mass (g)", "Molar mass g/mol", "Moles (mol)", "Volume (L)", "Molarity (M)"
+};
+
+
+// Draws the title, column headings and page number common to every page
+static void page_header(PdfPage& page, long target, int page_number, bool table)
+{
+    page.text(MARGIN, 806, PdfPage::helvetica_bold, 12, std::string("Molarity Calculator batch report: ") + row_header[target]);
+    page.text(PDF_PAGE_WIDTH - MARGIN - 40, 40, PdfPage::helvetica, 9, "Page " + std::to_string(page_number));
+    if (!table)
+        return;
+
+    char headings[160];
+    snprintf(headings, sizeof headings, "%8s %16s %16s %16s %16s %16s %5s", "Line",
+             column_headings[0], column_headings[1], column_headings[2], column_headings[3], column_headings[4], "Code");
+    page.text(MARGIN, TABLE_TOP + 14, PdfPage::courier, TABLE_FONT_SIZE, headings);
+    page.line(MARGIN, TABLE_TOP + 10, PDF_PAGE_WIDTH - MARGIN, TABLE_TOP + 10);
+}
+
+
+BatchReport::BatchReport(FILE* file, long target) : pdf(file), target(target), lines_done(0)
+{
+}
+
+
+void BatchReport::write_pages(size_t count)
+{
+    INSTRUMENT_SCOPE("report_pages");
+    const int first_page = pdf.page_count() + 1;
+    std::vector<std::vector<unsigned char>> pages(count);
+    parallel_for(count, [&](size_t p) {
+        PdfPage page;
+        page_header(page, target, first_page + (int)p, true);
+        const size_t first = p*REPORT_LINES_PER_PAGE;
+        const size_t end = std::min(first + REPORT_LINES_PER_PAGE, pending.size());
+        for (size_t line = first; line != end; ++line)
+            page.text(MARGIN, TABLE_TOP - (double)(line - first)*LINE_STEP, PdfPage::courier, TABLE_FONT_SIZE, pending[line]);
+        pages[p] = page.compress();
+    });
+
+    for (auto& page: pages)
+        pdf.add_page(page);
+    pending.erase(pending.begin(), pending.begin() + std::min(count*REPORT_LINES_PER_PAGE, pending.size()));
+}
+
+
+void BatchReport::add(const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("report_add");
+    const size_t n = columns.size();
+    const size_t first = pending.size();
+    pending.resize(first + n);
+    parallel_for((n + FORMAT_CHUNK - 1)/FORMAT_CHUNK, [&](size_t chunk) {
+        char values[ROWS][64], line[384];
+        const size_t end = std::min((chunk + 1)*FORMAT_CHUNK, n);
+        for (size_t i = chunk*FORMAT_CHUNK; i != end; ++i)
+        {
+            for (int r = 0; r != ROWS; ++r)
+                format_batch_value(values[r], sizeof values[r], columns, r, i);
+            snprintf(line, sizeof line, "%8zu %16s %16s %16s %16s %16s %5u", lines_done + i + 1,
+                     values[0], values[1], values[2], values[3], values[4], (unsigned)columns.diagnostics[i]);
+            pending[first + i] = line;
+        }
+    });
+    lines_done += n;
+    write_pages(pending.size()/REPORT_LINES_PER_PAGE);
+}
+
+
+bool BatchReport::finish(const unsigned char* seen_codes)
+{
+    write_pages((pending.size() + REPORT_LINES_PER_PAGE - 1)/REPORT_LINES_PER_PAGE);
+
+    // Closing pages: summary, meaning of the codes and signatures
+    PdfPage page;
+    page_header(page, target, pdf.page_count() + 1, false);
+    char text[160];
+    time_t now = time(nullptr);
+    strftime(text, sizeof text, "Generated %Y-%m-%d %H:%M", localtime(&now));
+    page.text(MARGIN, 780, PdfPage::helvetica, 10, text);
+    page.text(MARGIN, 764, PdfPage::helvetica, 10, "Lines: " + std::to_string(lines_done));
+    page.text(MARGIN, 740, PdfPage::helvetica_bold, 10, "Codes");
+
+    double y = 724;
+    for (unsigned code = 0; code != DIAGNOSTIC_CODES; ++code)
+    {
+        if (!seen_codes[code])
+            continue;
+        if (y < 160)
+        {
+            pdf.add_page(page.compress());
+            page = PdfPage();
+            page_header(page, target, pdf.page_count() + 1, false);
+            y = 780;
+        }
+        snprintf(text, sizeof text, "%5u  ", code);
+        page.text(MARGIN, y, PdfPage::courier, 9, text + describe_diagnostic(code, target));
+        y -= 13;
+    }
+
+    const char* signatures[] = {"Prepared by", "Reviewed by"};
+    y = 120;
+    for (const char* role: signatures)
+    {
+        page.text(MARGIN, y, PdfPage::helvetica, 10, role);
+        page.line(MARGIN + 80, y - 2, MARGIN + 300, y - 2);
+        page.text(MARGIN + 320, y, PdfPage::helvetica, 10, "Date");
+        page.line(MARGIN + 350, y - 2, PDF_PAGE_WIDTH - MARGIN, y - 2);
+        y -= 40;
+    }
+    pdf.add_page(page.compress());
+
+    std::string title = std::string("Batch report: ") + row_header[target];
+    return(pdf.finish(title.c_str()));
+}
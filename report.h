@@ -0,0 +1,37 @@
+// Printable PDF reports of batch results.
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "pdf.h"
+
+// Constants: table lines per report page
+#define REPORT_LINES_PER_PAGE 60
+
+
+// A report of one batch run, written while the batch is processed. Lines are formatted and pages compressed in parallel for each block, then written in order; lines that do not fill a page wait for the next block, so memory stays bounded by the block size. The last page lists what the diagnostic codes mean and has lines for signatures.
+class BatchReport {
+    PdfWriter pdf;
+    long target;
+    size_t lines_done;                  // Lines already formatted, for numbering
+    std::vector<std::string> pending;   // Formatted lines not yet on a page
+
+    void write_pages(size_t count);
+
+public:
+    // Starts a report on file, which must be open in binary mode, for a batch calculating target.
+    BatchReport(FILE* file, long target);
+
+    // Adds the lines of a solved block.
+    void add(const BatchColumns& columns);
+
+    // Writes the remaining lines and the closing page, given the codes seen by solve_batch. Returns false if writing failed.
+    bool finish(const unsigned char* seen_codes);
+};
+
+
+#endif /* REPORT_H */
@@ -0,0 +1,277 @@
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include "sorter.h"
+#include "parallel.h"
+#include "instrument.h"
+
+#ifdef __MINGW32__
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+
+// Constants: bytes of sorted text passed to write at a time
+#define SORT_WRITE_BYTES (1 << 20)
+
+
+int natural_compare(const char* a, size_t a_length, const char* b, size_t b_length)
+{
+    size_t i = 0, j = 0;
+    while (i != a_length && j != b_length)
+    {
+        if (isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j]))
+        {
+            // Without leading zeros, the number with more digits is larger, and numbers with as many digits compare as text
+            while (i != a_length && a[i] == '0')
+                ++i;
+            while (j != b_length && b[j] == '0')
+                ++j;
+            size_t a_end = i, b_end = j;
+            while (a_end != a_length && isdigit((unsigned char)a[a_end]))
+                ++a_end;
+            while (b_end != b_length && isdigit((unsigned char)b[b_end]))
+                ++b_end;
+            if (a_end - i != b_end - j)
+                return((a_end - i < b_end - j) ? -1 : 1);
+            const int order = memcmp(a + i, b + j, a_end - i);
+            if (order != 0)
+                return(order);
+            i = a_end;
+            j = b_end;
+        }
+        else if (a[i] != b[j])
+            return(((unsigned char)a[i] < (unsigned char)b[j]) ? -1 : 1);
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+    return((i != a_length) - (j != b_length));
+}
+
+
+// Opens a new run file for reading and writing, deleted when it is closed. tmpfile() on Windows creates its files in the root of the drive, where users usually cannot write, so there they are made in the directory named by TMP or TEMP.
+static FILE* open_run()
+{
+#ifdef __MINGW32__
+    char directory[MAX_PATH + 1], path[MAX_PATH + 1];
+    if (!GetTempPathA(sizeof directory, directory) || !GetTempFileNameA(directory, "mol", 0, path))
+        return(nullptr);
+    HANDLE handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        DeleteFileA(path);
+        return(nullptr);
+    }
+    const int descriptor = _open_osfhandle((intptr_t)handle, _O_RDWR | _O_BINARY);
+    FILE* run = (descriptor >= 0) ? _fdopen(descriptor, "w+b") : nullptr;
+    if (!run)
+    {
+        if (descriptor >= 0)
+            _close(descriptor);
+        else
+            CloseHandle(handle);
+    }
+    return(run);
+#else
+    return(tmpfile());
+#endif
+}
+
+
+// Writes a line with its key to a run. Returns false if writing failed.
+static bool write_record(FILE* run, const char* key, uint32_t key_length, const char* line, uint32_t line_length)
+{
+    const uint32_t lengths[2] = {key_length, line_length};
+    return(fwrite(lengths, sizeof lengths, 1, run) == 1 && fwrite(key, 1, key_length, run) == key_length &&
+           fwrite(line, 1, line_length, run) == line_length);
+}
+
+
+// Reads the lines of a run back in order
+struct RunReader {
+    FILE* run;
+    std::string key, line;
+
+    // Reads the next line into key and line. Returns false at the end of the run or if reading failed.
+    bool next()
+    {
+        uint32_t lengths[2];
+        if (fread(lengths, sizeof lengths, 1, run) != 1)
+            return(false);
+        key.resize(lengths[0]);
+        line.resize(lengths[1]);
+        return((lengths[0] == 0 || fread(&key[0], 1, lengths[0], run) == lengths[0]) &&
+               (lengths[1] == 0 || fread(&line[0], 1, lengths[1], run) == lengths[1]));
+    }
+};
+
+
+// Merges runs, calling emit(key, line) for each of their lines in order of key. Lines with equal keys come from earlier runs first. Returns false if a run could not be read.
+template <typename Emit>
+static bool merge_runs(const std::vector<FILE*>& runs, Emit emit)
+{
+    INSTRUMENT_SCOPE("merge_runs");
+    std::vector<RunReader> readers(runs.size());
+    std::vector<size_t> heap;
+    for (size_t r = 0; r != runs.size(); ++r)
+    {
+        readers[r].run = runs[r];
+        rewind(runs[r]);
+        if (readers[r].next())
+            heap.push_back(r);
+    }
+
+    // The heap holds the runs with lines left, the one with the first line on top
+    auto later = [&](size_t a, size_t b) {
+        const int order = natural_compare(readers[a].key.data(), readers[a].key.size(), readers[b].key.data(), readers[b].key.size());
+        return(order > 0 || (order == 0 && a > b));
+    };
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        RunReader& reader = readers[heap.back()];
+        emit(reader.key, reader.line);
+        if (reader.next())
+            std::push_heap(heap.begin(), heap.end(), later);
+        else
+            heap.pop_back();
+    }
+    bool readable = true;
+    for (FILE* run: runs)
+        readable &= (ferror(run) == 0);
+    return(readable);
+}
+
+
+BatchSorter::BatchSorter(size_t key, size_t memory):
+    key(key), budget(memory << 20), failed(false)
+{
+}
+
+
+BatchSorter::~BatchSorter()
+{
+    for (FILE* run: runs)
+        fclose(run);
+}
+
+
+void BatchSorter::sort_records()
+{
+    INSTRUMENT_SCOPE("sort_records");
+    auto before = [this](const Record& a, const Record& b) {
+        return(natural_compare(buffer.data() + a.start, a.key_length, buffer.data() + b.start, b.key_length) < 0);
+    };
+
+    // Each thread sorts a slice, then neighbouring slices are merged in rounds, pairs of them in parallel
+    const size_t slices = std::max<size_t>(1, std::min<size_t>(worker_count(), records.size()/1024));
+    std::vector<size_t> bounds(slices + 1);
+    for (size_t s = 0; s <= slices; ++s)
+        bounds[s] = records.size()*s/slices;
+    parallel_for(slices, [&](size_t s) {
+        std::stable_sort(records.begin() + bounds[s], records.begin() + bounds[s + 1], before);
+    });
+    for (size_t width = 1; width < slices; width *= 2)
+    {
+        parallel_for((slices + 2*width - 1)/(2*width), [&](size_t pair) {
+            const size_t first = pair*2*width, middle = std::min(first + width, slices), last = std::min(first + 2*width, slices);
+            std::inplace_merge(records.begin() + bounds[first], records.begin() + bounds[middle], records.begin() + bounds[last], before);
+        });
+    }
+}
+
+
+void BatchSorter::write_run()
+{
+    INSTRUMENT_SCOPE("write_run");
+    sort_records();
+    FILE* run = open_run();
+    failed |= !run;
+    for (size_t r = 0; run && !failed && r != records.size(); ++r)
+    {
+        const Record& record = records[r];
+        failed |= !write_record(run, buffer.data() + record.start, record.key_length, buffer.data() + record.start + record.key_length, record.line_length);
+    }
+    if (run)
+        runs.push_back(run);
+    buffer.clear();
+    records.clear();
+}
+
+
+void BatchSorter::add(const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("sort_batch");
+    std::string text;
+    std::vector<size_t> ends;
+    format_batch(columns, text, &ends);
+    const BatchKey& batch_key = columns.keys[key];
+    size_t start = 0;
+    for (size_t i = 0; i != columns.size(); ++i)
+    {
+        const size_t end = ends[i];
+        const std::string& key_text = *batch_key.dictionary.keys[batch_key.codes[i]];
+        if (!records.empty() && buffer.size() + (records.size() + 1)*SORT_LINE_OVERHEAD + key_text.size() + end - start > budget)
+            write_run();
+        records.push_back(Record{buffer.size(), (uint32_t)key_text.size(), (uint32_t)(end - start)});
+        buffer += key_text;
+        buffer.append(text, start, end - start);
+        start = end;
+    }
+}
+
+
+bool BatchSorter::finish(const std::function<void(const std::string&)>& write)
+{
+    std::string text;
+    auto emit = [&](const char* line, size_t length) {
+        text.append(line, length);
+        if (text.size() >= SORT_WRITE_BYTES)
+        {
+            write(text);
+            text.clear();
+        }
+    };
+
+    // Lines that all fit in memory are written straight from it
+    if (runs.empty() && !failed)
+    {
+        sort_records();
+        for (const Record& record: records)
+            emit(buffer.data() + record.start + record.key_length, record.line_length);
+        write(text);
+        return(true);
+    }
+    if (!records.empty())
+        write_run();
+
+    // Consecutive runs are merged into one, so lines with equal keys keep their order from pass to pass
+    while (runs.size() > SORT_MERGE_WAYS && !failed)
+    {
+        std::vector<FILE*> merged;
+        for (size_t first = 0; first < runs.size() && !failed; first += SORT_MERGE_WAYS)
+        {
+            const std::vector<FILE*> group(runs.begin() + first, runs.begin() + std::min(first + SORT_MERGE_WAYS, runs.size()));
+            FILE* run = open_run();
+            bool written = true;
+            const bool merged_run = run && merge_runs(group, [&](const std::string& key, const std::string& line) {
+                written = written && write_record(run, key.data(), (uint32_t)key.size(), line.data(), (uint32_t)line.size());
+            });
+            failed |= !merged_run || !written;
+            if (run)
+                merged.push_back(run);
+        }
+        for (FILE* run: runs)
+            fclose(run);
+        runs.swap(merged);
+    }
+    const bool merged = !failed && merge_runs(runs, [&](const std::string&, const std::string& line) { emit(line.data(), line.size()); });
+    write(text);
+    return(merged);
+}
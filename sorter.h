@@ -0,0 +1,58 @@
+// Sorted batch output: solved lines put in order of a key, such as source plate and well, by an external merge sort when they do not fit in memory.
+
+#ifndef SORTER_H
+#define SORTER_H
+
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "batch.h"
+
+// Constants: default memory for lines waiting to be sorted, in MiB
+#define SORT_MEMORY 256
+
+// Constants: bytes counted for each waiting line besides its text, towards the memory budget
+#define SORT_LINE_OVERHEAD 32
+
+// Constants: most runs merged at once; more runs are merged in passes of this many, so few files are open at a time
+#define SORT_MERGE_WAYS 64
+
+
+// Compares keys a and b in natural order: runs of digits compare as numbers, so well A2 comes before A10 and plate 9 before plate 10. Returns a negative number, 0 or a positive number, as strcmp does.
+int natural_compare(const char* a, size_t a_length, const char* b, size_t b_length);
+
+
+// Sorts formatted batch lines by a key of the batch columns. Lines are kept in memory up to a budget; then they are sorted, in parallel slices merged together, and written to a temporary file as a run. Finishing merges the runs. Lines with the same key stay in the order they were read.
+class BatchSorter {
+    // A waiting line: its key and text in buffer, the key first
+    struct Record {
+        size_t start;
+        uint32_t key_length, line_length;
+    };
+
+    size_t key;                 // Index of the key in BatchColumns::keys
+    size_t budget;              // Bytes
+    std::string buffer;
+    std::vector<Record> records;
+    std::vector<FILE*> runs;
+    bool failed;
+
+    void sort_records();
+    void write_run();
+
+public:
+    // Starts sorting by key number key of the batch columns, keeping up to memory MiB of lines in memory.
+    BatchSorter(size_t key, size_t memory);
+    ~BatchSorter();
+
+    // Adds the lines of a solved block, formatted as format_batch does.
+    void add(const BatchColumns& columns);
+
+    // Passes all the lines added, in order, to write as pieces of text. Returns false if a temporary file could not be written or read.
+    bool finish(const std::function<void(const std::string&)>& write);
+};
+
+
+#endif /* SORTER_H */
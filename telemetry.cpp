@@ -0,0 +1,119 @@
+#include <cstring>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include "telemetry.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+bool telemetry_timing = false;
+
+
+// Counters of all threads. Entries are never removed, so a thread's counters outlive it and still count in the totals.
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<PathCounters>> registry;
+
+
+PathCounters& thread_path_counters()
+{
+    thread_local PathCounters* counters = nullptr;
+    if (!counters)
+    {
+        std::unique_ptr<PathCounters> created(new PathCounters());
+        for (int path = 0; path != SOLVER_PATHS; ++path)
+        {
+            created->hits[path].store(0, std::memory_order_relaxed);
+            created->cycles[path].store(0, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        counters = created.get();
+        registry.push_back(std::move(created));
+    }
+    return(*counters);
+}
+
+
+PathTotals total_path_counters()
+{
+    PathTotals totals;
+    memset(&totals, 0, sizeof totals);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& counters: registry)
+    {
+        for (int path = 0; path != SOLVER_PATHS; ++path)
+        {
+            totals.hits[path] += counters->hits[path].load(std::memory_order_relaxed);
+            totals.cycles[path] += counters->cycles[path].load(std::memory_order_relaxed);
+        }
+    }
+    return(totals);
+}
+
+
+unsigned long long telemetry_clock()
+{
+    if (!telemetry_timing)
+        return(0);
+#if defined(__x86_64__) || defined(__i386__)
+    return(__rdtsc());
+#else
+    return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+// Constants: names of the moles sources in telemetry output
+static const char* source_names[no_source + 1] = {
+    "mass_over_molar_mass",
+    "volume_times_molarity",
+    "moles",
+    "unsolved"
+};
+
+
+void write_telemetry_json(FILE* out, const PathTotals& totals)
+{
+    fprintf(out, "{\n  \"timing\": %s,\n  \"paths\": [", telemetry_timing ? "true" : "false");
+    for (int path = 0; path != SOLVER_PATHS; ++path)
+    {
+        fprintf(out, "%s\n    {\"target\": \"%s\", \"source\": \"%s\", \"hits\": %llu, \"cycles\": %llu}",
+                path ? "," : "", row_header[path/(no_source + 1)], source_names[path%(no_source + 1)],
+                totals.hits[path], totals.cycles[path]);
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+
+void write_telemetry_metrics(FILE* out, const PathTotals& totals)
+{
+    fprintf(out, "# HELP molarity_solver_hits_total Calculations per solver path.\n"
+                 "# TYPE molarity_solver_hits_total counter\n");
+    for (int path = 0; path != SOLVER_PATHS; ++path)
+        fprintf(out, "molarity_solver_hits_total{target=\"%s\",source=\"%s\"} %llu\n",
+                row_header[path/(no_source + 1)], source_names[path%(no_source + 1)], totals.hits[path]);
+    if (!telemetry_timing)
+        return;
+    fprintf(out, "# HELP molarity_solver_cycles_total Time spent per solver path, in CPU cycles.\n"
+                 "# TYPE molarity_solver_cycles_total counter\n");
+    for (int path = 0; path != SOLVER_PATHS; ++path)
+        fprintf(out, "molarity_solver_cycles_total{target=\"%s\",source=\"%s\"} %llu\n",
+                row_header[path/(no_source + 1)], source_names[path%(no_source + 1)], totals.cycles[path]);
+}
+
+
+bool write_telemetry(const char* path)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+        return(false);
+    size_t length = strlen(path);
+    if (length >= 5 && strcmp(path + length - 5, ".json") == 0)
+        write_telemetry_json(out, total_path_counters());
+    else
+        write_telemetry_metrics(out, total_path_counters());
+    return(fclose(out) == 0);
+}
@@ -0,0 +1,60 @@
+// Telemetry: how often each solver path is taken, and optionally how long it takes.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstdio>
+#include <atomic>
+#include "calculator.h"
+
+// Constants: number of solver paths, one per target row and moles source. The no_source path of a row counts calculations that could not be done.
+#define SOLVER_PATHS (ROWS*(no_source + 1))
+
+
+// Returns the path of calculating target with a relation taking moles from source.
+inline int solver_path(long target, MolesSource source)
+{
+    return((int)target*(no_source + 1) + source);
+}
+
+
+// Counters of one thread. Only the owning thread writes them, so plain relaxed loads and stores are enough and no counter ever costs a locked instruction; other threads may read them at any time to aggregate.
+struct PathCounters {
+    std::atomic<unsigned long long> hits[SOLVER_PATHS];
+    std::atomic<unsigned long long> cycles[SOLVER_PATHS];
+
+    void add(int path, unsigned long long count, unsigned long long elapsed)
+    {
+        hits[path].store(hits[path].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        cycles[path].store(cycles[path].load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+    }
+};
+
+// Totals of all threads, as returned by total_path_counters
+struct PathTotals {
+    unsigned long long hits[SOLVER_PATHS];
+    unsigned long long cycles[SOLVER_PATHS];
+};
+
+
+// Whether solver paths are timed. Off by default; counting is always on.
+extern bool telemetry_timing;
+
+// Returns the counters of the calling thread, creating them on first use.
+PathCounters& thread_path_counters();
+
+// Adds up the counters of every thread that has counted so far.
+PathTotals total_path_counters();
+
+// Returns a timestamp in CPU cycles where available, otherwise in nanoseconds. Returns 0 when timing is off.
+unsigned long long telemetry_clock();
+
+// Writes totals to out as a JSON object, or as text metrics in the Prometheus exposition format.
+void write_telemetry_json(FILE* out, const PathTotals& totals);
+void write_telemetry_metrics(FILE* out, const PathTotals& totals);
+
+// Writes the current totals to path, as JSON if the name ends in ".json" and as metrics otherwise. Returns false if the file cannot be written.
+bool write_telemetry(const char* path);
+
+
+#endif /* TELEMETRY_H */
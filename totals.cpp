@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <cmath>
+#include <unordered_map>
+#include "totals.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Adds value to sum, keeping the rounding error of the addition in compensation
+static void accumulate(double& sum, double& compensation, double value)
+{
+    const double next = sum + value;
+    compensation += (std::fabs(sum) >= std::fabs(value)) ? (sum - next) + value : (value - next) + sum;
+    sum = next;
+}
+
+
+void Total::add(double value)
+{
+    accumulate(sum, compensation, value);
+    min = (count == 0 || value < min) ? value : min;
+    max = (count == 0 || value > max) ? value : max;
+    ++count;
+}
+
+
+void Total::merge(const Total& other)
+{
+    if (other.count == 0)
+        return;
+    accumulate(sum, compensation, other.sum);
+    compensation += other.compensation;
+    min = (count == 0 || other.min < min) ? other.min : min;
+    max = (count == 0 || other.max > max) ? other.max : max;
+    count += other.count;
+}
+
+
+BatchTotals::BatchTotals(const std::string& path, const std::string& key_names, size_t key):
+    path(path), key_names(key_names), key(key)
+{
+}
+
+
+void BatchTotals::add(const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("batch_totals");
+    const size_t n = columns.size();
+    const uint32_t* codes = columns.keys[key].codes.data();
+
+    // Each chunk totals into a small table of the keys it meets, indexed through a hash map from key code
+    struct ChunkTotals {
+        std::unordered_map<uint32_t, uint32_t> slots;
+        std::vector<uint32_t> codes;
+        std::vector<uint64_t> lines;
+        std::vector<Total> totals;
+    };
+    std::vector<ChunkTotals> chunks((n + TOTALS_CHUNK - 1)/TOTALS_CHUNK);
+    parallel_for(chunks.size(), [&](size_t c) {
+        ChunkTotals& chunk = chunks[c];
+        const size_t end = std::min((c + 1)*TOTALS_CHUNK, n);
+        for (size_t i = c*TOTALS_CHUNK; i != end; ++i)
+        {
+            auto inserted = chunk.slots.emplace(codes[i], (uint32_t)chunk.codes.size());
+            if (inserted.second)
+            {
+                chunk.codes.push_back(codes[i]);
+                chunk.lines.push_back(0);
+                chunk.totals.resize(chunk.totals.size() + TOTAL_ROWS);
+            }
+            const uint32_t slot = inserted.first->second;
+            ++chunk.lines[slot];
+            for (int t = 0; t != TOTAL_ROWS; ++t)
+                if (columns.validity[i].valid & (1 << total_rows[t]))
+                    chunk.totals[slot*TOTAL_ROWS + t].add(columns.values[total_rows[t]][i]);
+        }
+    });
+
+    // Chunks are merged in order, so the totals do not depend on how the chunks were shared out
+    lines.resize(columns.keys[key].dictionary.size());
+    totals.resize(lines.size()*TOTAL_ROWS);
+    for (const ChunkTotals& chunk: chunks)
+    {
+        for (size_t slot = 0; slot != chunk.codes.size(); ++slot)
+        {
+            lines[chunk.codes[slot]] += chunk.lines[slot];
+            for (int t = 0; t != TOTAL_ROWS; ++t)
+                totals[chunk.codes[slot]*TOTAL_ROWS + t].merge(chunk.totals[slot*TOTAL_ROWS + t]);
+        }
+    }
+}
+
+
+bool BatchTotals::finish(const BatchColumns& columns)
+{
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out)
+        return(false);
+    fprintf(out, "%s,lines", key_names.c_str());
+    for (int t = 0; t != TOTAL_ROWS; ++t)
+    {
+        const char* name = row_header[total_rows[t]];
+        fprintf(out, ",%s count,%s sum,%s min,%s max", name, name, name, name);
+    }
+    fprintf(out, "\n");
+
+    const TextDictionary& dictionary = columns.keys[key].dictionary;
+    for (size_t code = 0; code != lines.size(); ++code)
+    {
+        fprintf(out, "%s,%llu", dictionary.keys[code]->c_str(), (unsigned long long)lines[code]);
+        for (int t = 0; t != TOTAL_ROWS; ++t)
+        {
+            const Total& total = totals[code*TOTAL_ROWS + t];
+            if (total.count)
+                fprintf(out, ",%llu,%.15g,%.15g,%.15g", (unsigned long long)total.count, total.total(), total.min, total.max);
+            else
+                fprintf(out, ",0,0,,");
+        }
+        fprintf(out, "\n");
+    }
+    return(fclose(out) == 0);
+}
@@ -0,0 +1,51 @@
+// Batch totals: the mass, moles and volume of batch lines summed for each value of a key, such as compound, project or week, for procurement and planning.
+
+#ifndef TOTALS_H
+#define TOTALS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "batch.h"
+
+// Constants: lines totalled per parallel task. Fixed rather than divided by the number of threads, so totals come out the same on any machine.
+#define TOTALS_CHUNK 16384
+
+// Constants: number of rows totalled, and the rows (mass, moles and volume)
+#define TOTAL_ROWS 3
+const static int total_rows[TOTAL_ROWS] = {0, 2, 3};
+
+
+// A running total of values, with the count, minimum and maximum. Sums are compensated (Neumaier), so adding millions of values loses no more than a rounding or two, in any order.
+struct Total {
+    uint64_t count = 0;
+    double sum = 0, compensation = 0;   // The total is sum + compensation
+    double min = 0, max = 0;
+
+    void add(double value);
+    void merge(const Total& other);
+    double total() const { return(sum + compensation); }
+};
+
+
+// Totals of batch results for each value of a key of the batch lines, added block by block as they are solved.
+class BatchTotals {
+    std::string path;
+    std::string key_names;      // Header of the key columns
+    size_t key;                 // Index of the key in BatchColumns::keys
+    std::vector<uint64_t> lines;    // By key code
+    std::vector<Total> totals;      // By key code and total row
+
+public:
+    // Starts totals written to path when finished, for key number key of the batch columns, whose fields are named by key_names.
+    BatchTotals(const std::string& path, const std::string& key_names, size_t key);
+
+    // Adds the lines of a solved block. Chunks of lines are totalled in parallel into tables of their own, which are then merged in order.
+    void add(const BatchColumns& columns);
+
+    // Writes a line for each key value, in the order they were first read, with the number of lines and the count, sum, minimum and maximum of each total row in base units. Returns false if the file cannot be written.
+    bool finish(const BatchColumns& columns);
+};
+
+
+#endif /* TOTALS_H */
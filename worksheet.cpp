@@ -0,0 +1,406 @@
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include "worksheet.h"
+#include "gzip.h"
+#include "zstd.h"
+#include "compressed.h"
+#include "instrument.h"
+
+#ifdef __MINGW32__
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Constants: first bytes of a worksheet file, which end in the version
+static const char worksheet_magic[8] = {'M', 'O', 'L', 'S', 'H', 'E', 'E', 'T'};
+
+// Constants: byte offsets of the columns in a block, and the size of a block rounded up to a page
+static const size_t values_offset = 0;
+static const size_t sig_figs_offset = ROWS*WORKSHEET_BLOCK*sizeof(double);
+static const size_t valid_offset = sig_figs_offset + ROWS*WORKSHEET_BLOCK;
+static const size_t invalid_offset = valid_offset + WORKSHEET_BLOCK;
+static const size_t diagnostics_offset = invalid_offset + WORKSHEET_BLOCK;
+static const size_t block_bytes = (diagnostics_offset + WORKSHEET_BLOCK*sizeof(Diagnostic) + WORKSHEET_PAGE - 1)/WORKSHEET_PAGE*WORKSHEET_PAGE;
+
+
+// Returns the offset in a worksheet file of the element of line of the column at column_offset, with elements of size bytes
+static size_t element_offset(size_t line, size_t column_offset, size_t size)
+{
+    return(WORKSHEET_PAGE + (line/WORKSHEET_BLOCK)*block_bytes + column_offset + (line % WORKSHEET_BLOCK)*size);
+}
+
+
+// Makes sure what was written to file has reached the disk
+static void sync_file(FILE* file)
+{
+    fflush(file);
+#ifdef __MINGW32__
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+
+Worksheet::Worksheet():
+    data(nullptr), size(0), file(nullptr), mapping(nullptr), descriptor(-1), journal(nullptr), failed(false)
+{
+}
+
+
+Worksheet::~Worksheet()
+{
+    close();
+}
+
+
+bool Worksheet::open(const char* path, bool writable)
+{
+    close();
+    journal_path = std::string(path) + "-journal";
+    FILE* interrupted = fopen(journal_path.c_str(), "rb");
+    writable |= (interrupted != nullptr);
+
+#ifdef __MINGW32__
+    file = CreateFileA(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &file_size) && file_size.QuadPart >= WORKSHEET_PAGE)
+    {
+        size = (size_t)file_size.QuadPart;
+        mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+        data = mapping ? (unsigned char*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0) : nullptr;
+    }
+    if (file == INVALID_HANDLE_VALUE)
+        file = nullptr;
+#else
+    descriptor = ::open(path, writable ? O_RDWR : O_RDONLY);
+    struct stat status;
+    if (descriptor >= 0 && fstat(descriptor, &status) == 0 && status.st_size >= WORKSHEET_PAGE)
+    {
+        size = (size_t)status.st_size;
+        void* address = mmap(nullptr, size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, descriptor, 0);
+        data = (address != MAP_FAILED) ? (unsigned char*)address : nullptr;
+    }
+#endif
+
+    // Every block the header counts must be in the file
+    const WorksheetHeader* mapped = (const WorksheetHeader*)data;
+    bool readable = data && memcmp(mapped->magic, worksheet_magic, sizeof mapped->magic) == 0 &&
+                    mapped->block_lines == WORKSHEET_BLOCK && mapped->target >= 0 && mapped->target < ROWS &&
+                    mapped->lines <= (size - WORKSHEET_PAGE)/block_bytes*WORKSHEET_BLOCK;
+
+    // Pages an interrupted edit saved are put back, then the journal is done with. A page only partly saved had not been changed yet.
+    if (interrupted)
+    {
+        uint64_t offset;
+        std::vector<unsigned char> page(WORKSHEET_PAGE);
+        while (readable && fread(&offset, sizeof offset, 1, interrupted) == 1 && fread(page.data(), 1, WORKSHEET_PAGE, interrupted) == WORKSHEET_PAGE)
+            if (offset <= size - WORKSHEET_PAGE)
+                memcpy(data + offset, page.data(), WORKSHEET_PAGE);
+        fclose(interrupted);
+        readable = readable && flush() && remove(journal_path.c_str()) == 0;
+    }
+    if (!readable)
+        close();
+    return(readable);
+}
+
+
+void Worksheet::close()
+{
+    if (journal)
+        fclose(journal);
+    journal = nullptr;
+    journaled.clear();
+#ifdef __MINGW32__
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+#else
+    if (data)
+        munmap(data, size);
+    if (descriptor >= 0)
+        ::close(descriptor);
+#endif
+    data = nullptr;
+    mapping = file = nullptr;
+    descriptor = -1;
+    size = 0;
+    failed = false;
+}
+
+
+bool Worksheet::flush()
+{
+#ifdef __MINGW32__
+    return(FlushViewOfFile(data, 0) && FlushFileBuffers(file));
+#else
+    return(msync(data, size, MS_SYNC) == 0);
+#endif
+}
+
+
+void Worksheet::read(size_t first, size_t count, BatchColumns& columns) const
+{
+    INSTRUMENT_SCOPE("read_worksheet");
+    count = (first < header().lines) ? std::min<size_t>(count, header().lines - first) : 0;
+    columns.resize(count);
+    columns.clear_trailing();
+    columns.reagent_codes.assign(count, NO_REAGENT);
+    for (size_t i = 0; i != count; ++i)
+    {
+        const size_t line = first + i;
+        for (int r = 0; r != ROWS; ++r)
+        {
+            memcpy(&columns.values[r][i], data + element_offset(line, values_offset + r*WORKSHEET_BLOCK*sizeof(double), sizeof(double)), sizeof(double));
+            columns.sig_figs[r][i] = data[element_offset(line, sig_figs_offset + r*WORKSHEET_BLOCK, 1)];
+        }
+        columns.validity[i].valid = data[element_offset(line, valid_offset, 1)];
+        columns.validity[i].invalid = data[element_offset(line, invalid_offset, 1)];
+        memcpy(&columns.diagnostics[i], data + element_offset(line, diagnostics_offset, sizeof(Diagnostic)), sizeof(Diagnostic));
+    }
+}
+
+
+bool Worksheet::save_page(size_t offset)
+{
+    offset -= offset % WORKSHEET_PAGE;
+    if (std::find(journaled.begin(), journaled.end(), offset) != journaled.end())
+        return(true);
+    if (!journal)
+        journal = fopen(journal_path.c_str(), "wb");
+    const uint64_t saved = offset;
+    if (!journal || fwrite(&saved, sizeof saved, 1, journal) != 1 || fwrite(data + offset, 1, WORKSHEET_PAGE, journal) != WORKSHEET_PAGE)
+        return(false);
+    sync_file(journal);
+    journaled.push_back(offset);
+    return(true);
+}
+
+
+void Worksheet::write(size_t line, const BatchColumns& columns, size_t i)
+{
+    // Each element is only changed once its page is safe in the journal
+    auto put = [&](size_t offset, const void* element, size_t element_size) {
+        const bool saved = save_page(offset);
+        failed |= !saved;
+        if (saved)
+            memcpy(data + offset, element, element_size);
+    };
+    for (int r = 0; r != ROWS; ++r)
+    {
+        put(element_offset(line, values_offset + r*WORKSHEET_BLOCK*sizeof(double), sizeof(double)), &columns.values[r][i], sizeof(double));
+        put(element_offset(line, sig_figs_offset + r*WORKSHEET_BLOCK, 1), &columns.sig_figs[r][i], 1);
+    }
+    put(element_offset(line, valid_offset, 1), &columns.validity[i].valid, 1);
+    put(element_offset(line, invalid_offset, 1), &columns.validity[i].invalid, 1);
+    put(element_offset(line, diagnostics_offset, sizeof(Diagnostic)), &columns.diagnostics[i], sizeof(Diagnostic));
+}
+
+
+bool Worksheet::commit()
+{
+    if (!journal)
+        return(!failed);
+    const bool written = !failed && flush();
+    fclose(journal);
+    journal = nullptr;
+    journaled.clear();
+    return(written && remove(journal_path.c_str()) == 0);
+}
+
+
+bool create_worksheet(const char* path, long target, const std::function<size_t(BatchColumns&)>& read_block)
+{
+    FILE* out = fopen(path, "wb");
+    if (!out)
+        return(false);
+    std::vector<unsigned char> page(WORKSHEET_PAGE, 0), block(block_bytes);
+    WorksheetHeader header;
+    memcpy(header.magic, worksheet_magic, sizeof header.magic);
+    header.lines = 0;
+    header.block_lines = WORKSHEET_BLOCK;
+    header.target = target;
+    bool written = fwrite(page.data(), 1, WORKSHEET_PAGE, out) == WORKSHEET_PAGE;
+
+    // Blocks are written whole, the last one padded, so every line has the same place in its block
+    BatchColumns columns;
+    size_t n;
+    while (written && (n = read_block(columns)) != 0)
+    {
+        solve_batch(columns, target);
+        std::fill(block.begin(), block.end(), 0);
+        for (int r = 0; r != ROWS; ++r)
+        {
+            memcpy(&block[values_offset + r*WORKSHEET_BLOCK*sizeof(double)], columns.values[r].data(), n*sizeof(double));
+            memcpy(&block[sig_figs_offset + r*WORKSHEET_BLOCK], columns.sig_figs[r].data(), n);
+        }
+        for (size_t i = 0; i != n; ++i)
+        {
+            block[valid_offset + i] = columns.validity[i].valid;
+            block[invalid_offset + i] = columns.validity[i].invalid;
+        }
+        memcpy(&block[diagnostics_offset], columns.diagnostics.data(), n*sizeof(Diagnostic));
+        written = fwrite(block.data(), 1, block_bytes, out) == block_bytes;
+        header.lines += n;
+    }
+    memcpy(page.data(), &header, sizeof header);
+    written = written && fseek(out, 0, SEEK_SET) == 0 && fwrite(page.data(), 1, WORKSHEET_PAGE, out) == WORKSHEET_PAGE;
+    return((fclose(out) == 0) && written);
+}
+
+
+int worksheet_main(int argc, char** argv)
+{
+    const bool create = (argc >= 5 && strcmp(argv[2], "create") == 0);
+    const bool show = (argc == 6 && strcmp(argv[3], "--show") == 0);
+    const bool compress = (argc == 4 && strcmp(argv[3], "--compress") == 0);
+    bool edit = (argc >= 7 && (argc - 3) % 4 == 0);
+    for (int a = 3; edit && a < argc; a += 4)
+        edit = (strcmp(argv[a], "--set") == 0);
+    const char* input_path = nullptr;
+    bool usage = !create && !show && !compress && !edit;
+    for (int a = 5; create && a < argc && !usage; ++a)
+    {
+        if (strcmp(argv[a], "--input") == 0 && a + 1 < argc)
+            input_path = argv[++a];
+        else
+            usage = true;
+    }
+    if (usage)
+    {
+        fprintf(stderr, "Usage: %s --worksheet create <sheet> <row> [--input <file>]\n"
+                        "       %s --worksheet <sheet> --show <first line> <count>\n"
+                        "       %s --worksheet <sheet> --set <line> <row> <value> [--set <line> <row> <value>...]\n"
+                        "       %s --worksheet <sheet> --compress\n", argv[0], argv[0], argv[0], argv[0]);
+        return(2);
+    }
+
+    if (create)
+    {
+        const long target = find_row(argv[4]);
+        if (target == ROWS)
+        {
+            fprintf(stderr, "Unknown row: %s\n", argv[4]);
+            return(1);
+        }
+        FILE* in = input_path ? fopen(input_path, "rb") : stdin;
+        if (!in)
+        {
+            fprintf(stderr, "Cannot read %s\n", input_path);
+            return(1);
+        }
+        std::unique_ptr<CompressedReader> compressed_in;
+        if (is_gzip(in))
+            compressed_in.reset(new GzipReader(in));
+        else if (is_zstd(in))
+            compressed_in.reset(new ZstdReader(in));
+
+        // The header line of the input is skipped; worksheets are shown with the calculator's row names
+        char line[1024];
+        const bool started = compressed_in ? compressed_in->gets(line, sizeof line) != nullptr : fgets(line, sizeof line, in) != nullptr;
+        const bool written = create_worksheet(argv[3], target, [&](BatchColumns& columns) {
+            return(!started ? 0 : compressed_in ? read_batch(*compressed_in, columns, BATCH_BLOCK) : read_batch(in, columns, BATCH_BLOCK));
+        });
+        if ((compressed_in && compressed_in->failed()) || ferror(in) != 0)
+        {
+            fprintf(stderr, "Cannot read %s\n", input_path ? input_path : "standard input");
+            return(1);
+        }
+        if (!written)
+        {
+            fprintf(stderr, "Cannot write %s\n", argv[3]);
+            return(1);
+        }
+        return(0);
+    }
+
+    Worksheet sheet;
+    if (!sheet.open(argv[2], edit))
+    {
+        fprintf(stderr, "Cannot read worksheet %s\n", argv[2]);
+        return(1);
+    }
+    const long target = (long)sheet.header().target;
+    if (show)
+    {
+        BatchColumns columns;
+        sheet.read(strtoull(argv[4], nullptr, 10), strtoull(argv[5], nullptr, 10), columns);
+        std::string text;
+        for (int r = 0; r != ROWS; ++r)
+            text += std::string(row_header[r]) + ",";
+        text += "diagnostic\n";
+        format_batch(columns, text);
+        fwrite(text.data(), 1, text.size(), stdout);
+        return(0);
+    }
+
+    // The whole worksheet is compressed in memory, and the bytes each column takes are printed beside what the worksheet file takes per line
+    if (compress)
+    {
+        CompressedColumns compressed;
+        BatchColumns columns;
+        for (size_t first = 0; first < sheet.header().lines; first += WORKSHEET_BLOCK)
+        {
+            sheet.read(first, WORKSHEET_BLOCK, columns);
+            compressed.append(columns);
+        }
+        const double lines = (double)std::max<size_t>(compressed.size(), 1);
+        const size_t line_bytes = ROWS*(sizeof(double) + 1) + 2 + sizeof(Diagnostic);
+        size_t total = 0;
+        printf("column,bytes,bytes per line\n");
+        for (int c = 0; c <= ROWS; ++c)
+        {
+            printf("%s,%zu,%.2f\n", (c == ROWS) ? "figures and validity" : row_header[c], compressed.bytes(c), compressed.bytes(c)/lines);
+            total += compressed.bytes(c);
+        }
+        printf("compressed,%zu,%.2f\n", total, total/lines);
+        printf("worksheet,%zu,%zu\n", compressed.size()*line_bytes, line_bytes);
+        return(0);
+    }
+
+    // Each edited line is solved again as the batch solved it
+    for (int a = 3; a < argc; a += 4)
+    {
+        char* end = nullptr;
+        const unsigned long long line = strtoull(argv[a + 1], &end, 10);
+        const long row = find_row(argv[a + 2]);
+        if (*end != '\0' || line >= sheet.header().lines)
+        {
+            fprintf(stderr, "No line %s in %s\n", argv[a + 1], argv[2]);
+            return(1);
+        }
+        if (row == ROWS || row == target)
+        {
+            fprintf(stderr, (row == ROWS) ? "Unknown row: %s\n" : "%s is calculated; set the rows it is calculated from\n", argv[a + 2]);
+            return(1);
+        }
+        BatchColumns columns;
+        sheet.read(line, 1, columns);
+        Validity& validity = columns.validity[0];
+        validity.valid &= ~(1 << row);
+        validity.invalid &= ~(1 << row);
+        parse_batch_field(columns, row, 0, argv[a + 3], validity);
+        decode_reagents(columns);
+        solve_batch(columns, target);
+        sheet.write(line, columns, 0);
+    }
+    if (!sheet.commit())
+    {
+        fprintf(stderr, "Cannot write %s\n", argv[2]);
+        return(1);
+    }
+    return(0);
+}
@@ -0,0 +1,71 @@
+// Worksheet files: solved batch lines stored column by column in a file that is memory-mapped, so lines anywhere in tens of millions are read or edited without loading the rest.
+
+#ifndef WORKSHEET_H
+#define WORKSHEET_H
+
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "batch.h"
+
+// Constants: lines per block of a worksheet file. Each block holds its lines column by column: the values of each row, their significant figures, the validity and the diagnostic codes.
+#define WORKSHEET_BLOCK BATCH_BLOCK
+
+// Constants: size of the pages the journal saves before an edit changes them; the header and every block start on a page
+#define WORKSHEET_PAGE 4096
+
+
+// First page of a worksheet file
+struct WorksheetHeader {
+    char magic[8];
+    uint64_t lines;
+    uint64_t block_lines;
+    int64_t target;             // Row the lines are solved for
+};
+
+
+// An open worksheet file. Edits save the pages they change to a journal next to the file first, and commit removes the journal once the file is written, so an edit that is interrupted is undone when the worksheet is next opened.
+class Worksheet {
+    std::string journal_path;
+    unsigned char* data;
+    size_t size;
+    void* file;                 // Handles of the file and its mapping, on Windows
+    void* mapping;
+    int descriptor;             // Elsewhere
+    FILE* journal;
+    std::vector<size_t> journaled;  // Offsets of the pages saved in the journal
+    bool failed;
+
+    bool save_page(size_t offset);
+    bool flush();
+
+public:
+    Worksheet();
+    ~Worksheet();
+
+    // Maps the worksheet at path, for editing if writable, and undoes an interrupted edit. Returns false if the file cannot be mapped or is not a worksheet.
+    bool open(const char* path, bool writable);
+    void close();
+
+    const WorksheetHeader& header() const { return(*(const WorksheetHeader*)data); }
+
+    // Copies count lines from line first into columns. Only the pages holding them are read from the file.
+    void read(size_t first, size_t count, BatchColumns& columns) const;
+
+    // Writes line i of columns over line line of the worksheet, saving the pages it changes to the journal first.
+    void write(size_t line, const BatchColumns& columns, size_t i);
+
+    // Writes the edits to the file and removes the journal. Returns false if an edit or the journal could not be written.
+    bool commit();
+};
+
+// Writes a new worksheet at path with the lines read from in by read_block, solved for target. Returns false if the file cannot be written.
+bool create_worksheet(const char* path, long target, const std::function<size_t(BatchColumns&)>& read_block);
+
+// Command line mode: "--worksheet create <sheet> <row> [--input <file>]" solves the lines of a batch input file or standard input for row and stores them in a worksheet file; "--worksheet <sheet> --show <first line> <count>" prints lines of a worksheet, counted from 0, as batch output; "--worksheet <sheet> --set <line> <row> <value>..." changes fields of lines and solves them again; "--worksheet <sheet> --compress" prints the memory each column takes when the worksheet is held as CompressedColumns.
+int worksheet_main(int argc, char** argv);
+
+
+#endif /* WORKSHEET_H */
@@ -0,0 +1,555 @@
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "xlsx.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: lines turned into XML per parallel task
+#define XML_CHUNK 4096
+
+// Constants: highest column of a worksheet, XFD
+#define MAX_COLUMNS 16384
+
+// Constants: name of the worksheet written, and the parts of a workbook around it
+#define SHEET_ENTRY "xl/worksheets/sheet1.xml"
+static const char* const workbook_parts[][2] = {
+    {"[Content_Types].xml",
+     "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+     "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+     "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+     "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+     "<Override PartName=\"/xl/workbook.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>"
+     "<Override PartName=\"/" SHEET_ENTRY "\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>"
+     "</Types>"},
+    {"_rels/.rels",
+     "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+     "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+     "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"xl/workbook.xml\"/>"
+     "</Relationships>"},
+    {"xl/workbook.xml",
+     "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+     "<workbook xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\">"
+     "<sheets><sheet name=\"Results\" sheetId=\"1\" r:id=\"rId1\"/></sheets>"
+     "</workbook>"},
+    {"xl/_rels/workbook.xml.rels",
+     "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+     "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+     "<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet\" Target=\"worksheets/sheet1.xml\"/>"
+     "</Relationships>"}
+};
+static const char* sheet_start =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\"><sheetData>";
+static const char* sheet_end = "</sheetData></worksheet>";
+
+
+int XmlReader::get()
+{
+    if (position == end)
+    {
+        end = source.read(buffer, sizeof buffer);
+        position = 0;
+        if (!end)
+            return(-1);
+    }
+    return(buffer[position++]);
+}
+
+
+int XmlReader::peek()
+{
+    int c = get();
+    if (c >= 0)
+        --position;
+    return(c);
+}
+
+
+void XmlReader::read_name(std::string& name)
+{
+    name.clear();
+    int c;
+    while ((c = peek()) >= 0 && !strchr(" \t\r\n/>=", c))
+    {
+        get();
+        if (c == ':')
+            name.clear();
+        else
+            name += (char)c;
+    }
+}
+
+
+// Reads up to and including terminator, keeping what came before in text if given
+void XmlReader::read_until(const char* terminator, std::string* text)
+{
+    const size_t length = strlen(terminator);
+    char last[4] = {0};     // Terminators are at most three characters
+    int c;
+    while ((c = get()) >= 0)
+    {
+        memmove(last, last + 1, 2);
+        last[2] = (char)c;
+        if (text)
+            *text += (char)c;
+        if (memcmp(last + 3 - length, terminator, length) == 0)
+        {
+            if (text)
+                text->resize(text->size() - length);
+            return;
+        }
+    }
+}
+
+
+// Replaces entity and character references in text with the characters they stand for, in UTF-8
+void XmlReader::decode(std::string& text)
+{
+    size_t from = text.find('&');
+    if (from == std::string::npos)
+        return;
+
+    static const char* const entities[][2] = {{"amp;", "&"}, {"lt;", "<"}, {"gt;", ">"}, {"quot;", "\""}, {"apos;", "'"}};
+    std::string decoded = text.substr(0, from);
+    while (from < text.size())
+    {
+        if (text[from] != '&')
+        {
+            decoded += text[from++];
+            continue;
+        }
+        const size_t semicolon = text.find(';', from);
+        if (semicolon == std::string::npos)
+            break;
+        bool known = false;
+        for (const auto& entity: entities)
+        {
+            if (text.compare(from + 1, strlen(entity[0]), entity[0]) == 0)
+            {
+                decoded += entity[1];
+                known = true;
+            }
+        }
+        if (!known && text[from + 1] == '#')
+        {
+            unsigned long code = (text[from + 2] == 'x') ? strtoul(text.c_str() + from + 3, nullptr, 16) : strtoul(text.c_str() + from + 2, nullptr, 10);
+            if (code < 0x80)
+                decoded += (char)code;
+            else if (code < 0x800)
+                decoded += {(char)(0xc0 | code >> 6), (char)(0x80 | (code & 0x3f))};
+            else if (code < 0x10000)
+                decoded += {(char)(0xe0 | code >> 12), (char)(0x80 | ((code >> 6) & 0x3f)), (char)(0x80 | (code & 0x3f))};
+            else
+                decoded += {(char)(0xf0 | code >> 18), (char)(0x80 | ((code >> 12) & 0x3f)), (char)(0x80 | ((code >> 6) & 0x3f)), (char)(0x80 | (code & 0x3f))};
+        }
+        from = semicolon + 1;
+    }
+    text = decoded;
+}
+
+
+XmlReader::Event XmlReader::next()
+{
+    if (pending_end)
+    {
+        pending_end = false;
+        return(end_element);
+    }
+
+    for (;;)
+    {
+        int c = get();
+        if (c < 0)
+            return(end_of_document);
+        if (c != '<')
+        {
+            content.assign(1, (char)c);
+            while ((c = peek()) >= 0 && c != '<')
+                content += (char)get();
+            decode(content);
+            return(text);
+        }
+
+        c = peek();
+        if (c == '?')
+        {
+            read_until("?>", nullptr);
+            continue;
+        }
+        if (c == '!')
+        {
+            // Comment, CDATA section or declaration
+            get();
+            std::string opening;
+            while (opening.size() < 7 && opening != "--" && opening != "[CDATA[" && (c = get()) >= 0 && c != '>')
+                opening += (char)c;
+            if (opening == "--")
+                read_until("-->", nullptr);
+            else if (opening == "[CDATA[")
+            {
+                content.clear();
+                read_until("]]>", &content);
+                return(text);
+            }
+            else if (c != '>')
+                read_until(">", nullptr);
+            continue;
+        }
+        if (c == '/')
+        {
+            get();
+            read_name(name);
+            read_until(">", nullptr);
+            return(end_element);
+        }
+
+        read_name(name);
+        attribute_count = 0;
+        for (;;)
+        {
+            while ((c = peek()) >= 0 && strchr(" \t\r\n", c))
+                get();
+            if (c < 0)
+                return(end_of_document);
+            if (c == '/' || c == '>')
+            {
+                read_until(">", nullptr);
+                pending_end = (c == '/');
+                return(start_element);
+            }
+
+            if (attributes.size() == attribute_count)
+                attributes.emplace_back();
+            std::pair<std::string, std::string>& attribute = attributes[attribute_count++];
+            read_name(attribute.first);
+            while ((c = get()) >= 0 && c != '"' && c != '\'')
+                ;
+            attribute.second.clear();
+            for (int quote = c; (c = get()) >= 0 && c != quote;)
+                attribute.second += (char)c;
+            decode(attribute.second);
+        }
+    }
+}
+
+
+const std::string* XmlReader::attribute(const char* name) const
+{
+    for (size_t a = 0; a != attribute_count; ++a)
+        if (attributes[a].first == name)
+            return(&attributes[a].second);
+    return(nullptr);
+}
+
+
+// Finds the first element of an archive entry with the given name, and the attribute match equal to value if match is given. Returns the value of its attribute wanted, or an empty string.
+static std::string find_attribute(ZipReader& zip, const char* entry_name, const char* element, const char* match, const std::string& value, const char* wanted)
+{
+    const ZipEntry* entry = zip.find(entry_name);
+    std::unique_ptr<ZipEntryReader> entry_reader = entry ? zip.read(*entry) : nullptr;
+    if (!entry_reader)
+        return("");
+    XmlReader xml(*entry_reader);
+    for (XmlReader::Event event; (event = xml.next()) != XmlReader::end_of_document;)
+    {
+        if (event != XmlReader::start_element || xml.name != element)
+            continue;
+        const std::string* matched = match ? xml.attribute(match) : nullptr;
+        const std::string* found = xml.attribute(wanted);
+        if ((!match || (matched && *matched == value)) && found)
+            return(*found);
+    }
+    return("");
+}
+
+
+bool XlsxReader::open(const char* path)
+{
+    if (!zip.open(path))
+        return(false);
+
+    // The first sheet listed in the workbook, found through the workbook's relationships
+    std::string id = find_attribute(zip, "xl/workbook.xml", "sheet", nullptr, "", "id");
+    std::string target = find_attribute(zip, "xl/_rels/workbook.xml.rels", "Relationship", "Id", id, "Target");
+    if (target.empty())
+        return(false);
+    target = (target[0] == '/') ? target.substr(1) : "xl/" + target;
+
+    const ZipEntry* entry = zip.find(target);
+    if (!read_shared_strings() || !entry || !(sheet_entry = zip.read(*entry)))
+        return(false);
+    sheet.reset(new XmlReader(*sheet_entry));
+    return(true);
+}
+
+
+// Strings of text cells are stored once in a table; phonetic guides in them are left out
+bool XlsxReader::read_shared_strings()
+{
+    const ZipEntry* entry = zip.find("xl/sharedStrings.xml");
+    if (!entry)
+        return(true);
+    std::unique_ptr<ZipEntryReader> entry_reader = zip.read(*entry);
+    if (!entry_reader)
+        return(false);
+
+    XmlReader xml(*entry_reader);
+    std::string text;
+    bool in_text = false, in_phonetic = false;
+    for (XmlReader::Event event; (event = xml.next()) != XmlReader::end_of_document;)
+    {
+        if (event == XmlReader::start_element)
+        {
+            in_text |= (xml.name == "t");
+            in_phonetic |= (xml.name == "rPh");
+            if (xml.name == "si")
+                text.clear();
+        }
+        else if (event == XmlReader::end_element)
+        {
+            in_text &= (xml.name != "t");
+            in_phonetic &= (xml.name != "rPh");
+            if (xml.name == "si")
+                shared_strings.push_back(text);
+        }
+        else if (in_text && !in_phonetic)
+            text += xml.content;
+    }
+    return(!entry_reader->failed());
+}
+
+
+// Reads the cells of the next row into cells, indexed by column, as the text a CSV file would hold. Returns false at the end of the sheet.
+bool XlsxReader::next_row(std::vector<std::string>& cells)
+{
+    for (std::string& cell: cells)
+        cell.clear();
+    int column = -1;
+    std::string type, value;
+    bool in_value = false;
+    for (;;)
+    {
+        switch (sheet->next())
+        {
+            case XmlReader::start_element:
+                if (sheet->name == "c")
+                {
+                    const std::string* reference = sheet->attribute("r");
+                    const std::string* cell_type = sheet->attribute("t");
+                    ++column;
+                    if (reference)
+                    {
+                        column = -1;
+                        for (size_t c = 0; c != reference->size() && (*reference)[c] >= 'A' && (*reference)[c] <= 'Z'; ++c)
+                            column = (column + 1)*26 + (*reference)[c] - 'A';
+                    }
+                    type = cell_type ? *cell_type : "n";
+                    value.clear();
+                }
+                in_value |= (sheet->name == "v" || sheet->name == "t");
+                break;
+
+            case XmlReader::text:
+                if (in_value)
+                    value += sheet->content;
+                break;
+
+            case XmlReader::end_element:
+                in_value &= (sheet->name != "v" && sheet->name != "t");
+                if (sheet->name == "row")
+                    return(true);
+                if (sheet->name == "sheetData")
+                    return(false);
+                if (sheet->name != "c" || column < 0 || column >= MAX_COLUMNS)
+                    break;
+                if ((size_t)column >= cells.size())
+                    cells.resize(column + 1);
+                if (type == "s")
+                {
+                    const size_t index = strtoul(value.c_str(), nullptr, 10);
+                    error |= (index >= shared_strings.size());
+                    cells[column] = (index < shared_strings.size()) ? shared_strings[index] : "";
+                }
+                else if (type == "b")
+                    cells[column] = (value == "1") ? "TRUE" : "FALSE";
+                else if (type == "n" && count_sig_figs(value.c_str()) > 15)
+                {
+                    char number[32];
+                    snprintf(number, sizeof number, "%.15g", strtod(value.c_str(), nullptr));
+                    cells[column] = number;
+                }
+                else
+                    cells[column] = value;
+                break;
+
+            case XmlReader::end_of_document:
+                return(false);
+        }
+    }
+}
+
+
+bool XlsxReader::header(std::string& line)
+{
+    std::vector<std::string> cells;
+    if (!next_row(cells))
+        return(false);
+    line.clear();
+    for (size_t c = 0; c != cells.size(); ++c)
+    {
+        if (c)
+            line += ',';
+        append_csv_field(line, cells[c].data(), cells[c].size());
+    }
+    return(true);
+}
+
+
+size_t XlsxReader::read(BatchColumns& columns, size_t max_lines)
+{
+    INSTRUMENT_SCOPE("read_xlsx");
+    columns.resize(max_lines);
+    columns.clear_trailing();
+    std::vector<std::string> cells(columns.field_count());
+    std::vector<const char*> fields(cells.size());
+    size_t n = 0;
+    while (n != max_lines && next_row(cells))
+    {
+        Validity validity = {0, 0};
+        for (size_t f = 0; f != fields.size(); ++f)
+            fields[f] = cells[f].c_str();
+        for (int r = 0; r != ROWS; ++r)
+            parse_batch_field(columns, r, n, fields[r], validity);
+        encode_batch_keys(columns, n, fields.data());
+
+        // Cells after the calculator rows, up to the last one filled, are kept one by one; the empty cells after them are written back from the header's count
+        size_t last = cells.size();
+        while (last > ROWS && cells[last - 1].empty())
+            --last;
+        for (size_t c = ROWS; c < last; ++c)
+        {
+            columns.trailing += cells[c];
+            columns.trailing_fields.push_back(columns.trailing.size());
+        }
+        columns.trailing_ends[n] = columns.trailing_fields.size();
+        columns.validity[n++] = validity;
+    }
+    columns.resize(n);
+    decode_reagents(columns);
+    INSTRUMENT_COUNT("batch_lines", n);
+    return(n);
+}
+
+
+// Escapes text for XML content or attribute values
+static std::string xml_escape(const std::string& text)
+{
+    std::string escaped;
+    for (char c: text)
+    {
+        switch (c)
+        {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += c;
+        }
+    }
+    return(escaped);
+}
+
+
+// Returns the letters of a column: A to Z, then AA and so on
+static std::string column_name(int column)
+{
+    std::string name;
+    for (++column; column; column = (column - 1)/26)
+        name.insert(name.begin(), (char)('A' + (column - 1)%26));
+    return(name);
+}
+
+
+bool XlsxWriter::open(const char* path, const std::string& header)
+{
+    out = fopen(path, "wb");
+    if (!out)
+        return(false);
+    zip.reset(new ZipWriter(out));
+    for (const auto& part: workbook_parts)
+    {
+        zip->begin_entry(part[0]);
+        zip->write(part[1]);
+        zip->end_entry();
+    }
+
+    // The header is written as inline strings, so no shared string table is needed
+    std::string xml = std::string(sheet_start) + "<row r=\"1\">";
+    const std::vector<std::string> names = split_csv_line(header);
+    for (int column = 0; column != (int)names.size() && column != MAX_COLUMNS; ++column)
+        xml += "<c r=\"" + column_name(column) + "1\" t=\"inlineStr\"><is><t>" + xml_escape(names[column]) + "</t></is></c>";
+    xml += "</row>";
+    zip->begin_entry(SHEET_ENTRY);
+    zip->write(xml);
+    rows_done = 1;
+    return(true);
+}
+
+
+void XlsxWriter::write(const BatchColumns& columns)
+{
+    INSTRUMENT_SCOPE("write_xlsx");
+    const size_t n = columns.size();
+    std::vector<std::string> chunks((n + XML_CHUNK - 1)/XML_CHUNK);
+    parallel_for(chunks.size(), [&](size_t chunk) {
+        char value[64], cell[128];
+        const size_t end = std::min((chunk + 1)*XML_CHUNK, n);
+        std::string& xml = chunks[chunk];
+        for (size_t i = chunk*XML_CHUNK; i != end; ++i)
+        {
+            const size_t row = rows_done + i + 1;
+            xml += "<row r=\"" + std::to_string(row) + "\">";
+            for (int r = 0; r != ROWS; ++r)
+            {
+                format_batch_value(value, sizeof value, columns, r, i);
+                if (!value[0])
+                    continue;
+                snprintf(cell, sizeof cell, "<c r=\"%c%zu\"><v>%s</v></c>", 'A' + r, row, value);
+                xml += cell;
+            }
+
+            // Fields after the calculator rows are numbers if they read as one and text otherwise, as they were read
+            int column = ROWS;
+            std::string field;
+            for (size_t f = 0; f != columns.trailing_columns && column != MAX_COLUMNS - 1; ++f, ++column)
+            {
+                field.clear();
+                columns.append_trailing(i, f, field);
+                double number;
+                if (parse_value(field.c_str(), number) == input_parsed)
+                    xml += "<c r=\"" + column_name(column) + std::to_string(row) + "\"><v>" + field + "</v></c>";
+                else if (!field.empty())
+                    xml += "<c r=\"" + column_name(column) + std::to_string(row) + "\" t=\"inlineStr\"><is><t>" + xml_escape(field) + "</t></is></c>";
+            }
+            snprintf(cell, sizeof cell, "<c r=\"%s%zu\"><v>%u</v></c></row>", column_name(column).c_str(), row, (unsigned)columns.diagnostics[i]);
+            xml += cell;
+        }
+    });
+
+    std::string xml;
+    for (const std::string& chunk: chunks)
+        xml += chunk;
+    zip->write(xml);
+    rows_done += n;
+}
+
+
+bool XlsxWriter::finish()
+{
+    zip->write(sheet_end);
+    zip->end_entry();
+    bool written = zip->finish();
+    return(fclose(out) == 0 && written);
+}
@@ -0,0 +1,95 @@
+// Excel workbooks (.xlsx) as batch input and output: the first worksheet is read and results are written as a streamed zip archive.
+
+#ifndef XLSX_H
+#define XLSX_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "zip.h"
+
+// Constants: bytes of XML read from an archive entry at a time
+#define XML_BUFFER 65536
+
+
+// Pull parser for the XML of workbook parts. Each call to next reads up to the next tag or text; element and attribute names are given without their namespace prefix. Comments, processing instructions and declarations are skipped.
+class XmlReader {
+    ZipEntryReader& source;
+    unsigned char buffer[XML_BUFFER];
+    size_t position, end;
+    bool pending_end;                   // An empty element tag was read and its end is still to be reported
+    size_t attribute_count;
+
+    int get();
+    int peek();
+    void read_name(std::string& name);
+    void read_until(const char* terminator, std::string* text);
+    void decode(std::string& text);
+
+public:
+    enum Event {start_element, end_element, text, end_of_document};
+
+    std::string name;                   // Of the element started or ended
+    std::string content;                // Text, with character references decoded
+    std::vector<std::pair<std::string, std::string>> attributes;    // Of a started element; only the first attribute_count are current
+
+    XmlReader(ZipEntryReader& source) : source(source), position(0), end(0), pending_end(false), attribute_count(0) {}
+
+    Event next();
+
+    // Returns the value of an attribute of the element just started, or nullptr.
+    const std::string* attribute(const char* name) const;
+};
+
+
+// Reads batch lines from the first worksheet of a workbook, streaming its XML so memory stays bounded by the block size; only the shared string table is held whole. Columns A to E hold the rows of the calculator as in a CSV file, and the first row is the header. Number cells are taken to 15 significant figures, as Excel shows them.
+class XlsxReader {
+    ZipReader zip;
+    std::vector<std::string> shared_strings;
+    std::unique_ptr<ZipEntryReader> sheet_entry;
+    std::unique_ptr<XmlReader> sheet;
+    bool error;
+
+    bool read_shared_strings();
+    bool next_row(std::vector<std::string>& cells);
+
+public:
+    XlsxReader() : error(false) {}
+
+    // Opens the workbook at path and finds its first worksheet. Returns false if it cannot be read.
+    bool open(const char* path);
+
+    // Reads the first row as comma separated text.
+    bool header(std::string& line);
+
+    // Reads up to max_lines rows into columns, as read_batch does.
+    size_t read(BatchColumns& columns, size_t max_lines);
+
+    // Returns true if the workbook is damaged.
+    bool failed() const { return(error || (sheet_entry && sheet_entry->failed())); }
+};
+
+
+// Writes batch lines to a new workbook with one worksheet. Each block is turned into XML and compressed in parallel as it is written.
+class XlsxWriter {
+    FILE* out;
+    std::unique_ptr<ZipWriter> zip;
+    size_t rows_done;
+
+public:
+    XlsxWriter() : out(nullptr), rows_done(0) {}
+
+    // Creates the workbook at path and writes header, comma separated text, as its first row. Returns false if the file cannot be created.
+    bool open(const char* path, const std::string& header);
+
+    // Writes the lines of a solved block with their diagnostic codes, as write_batch does.
+    void write(const BatchColumns& columns);
+
+    // Ends the worksheet and the workbook. Returns false if writing failed.
+    bool finish();
+};
+
+
+#endif /* XLSX_H */
@@ -0,0 +1,236 @@
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include "zip.h"
+
+
+// Constants: signatures of the records of an archive
+#define LOCAL_HEADER 0x04034b50ul
+#define DATA_DESCRIPTOR 0x08074b50ul
+#define CENTRAL_HEADER 0x02014b50ul
+#define END_OF_DIRECTORY 0x06054b50ul
+
+// Constants: sizes of the fixed parts of the records, and the longest archive comment after the end of directory record
+#define LOCAL_HEADER_SIZE 30
+#define CENTRAL_HEADER_SIZE 46
+#define END_OF_DIRECTORY_SIZE 22
+#define MAX_COMMENT 65535
+
+// Constants: general purpose flag telling that sizes and CRC follow the data, and the version of the format needed to read what is written (2.0, deflate)
+#define FLAG_DATA_DESCRIPTOR 0x0008
+#define VERSION_NEEDED 20
+
+
+static unsigned long long little_endian(const unsigned char* bytes, int count)
+{
+    unsigned long long value = 0;
+    for (int b = count - 1; b >= 0; --b)
+        value = (value << 8) | bytes[b];
+    return(value);
+}
+
+
+static void put_little_endian(std::vector<unsigned char>& out, unsigned long long value, int count)
+{
+    for (int b = 0; b != count; ++b)
+        out.push_back((unsigned char)(value >> 8*b));
+}
+
+
+ZipEntryReader::ZipEntryReader(FILE* in, const ZipEntry& entry)
+    : in(in), entry(entry), left(entry.size), crc(0), error(false)
+{
+    if (entry.method == ZIP_DEFLATED)
+        inflater.reset(new Inflater(in, entry.compressed_size));
+}
+
+
+size_t ZipEntryReader::read(unsigned char* out, size_t size)
+{
+    if (size > left)
+        size = (size_t)left;
+    size_t n = inflater ? inflater->read(out, size) : fread(out, 1, size, in);
+    crc = crc32(crc, out, n);
+    left -= n;
+    if (n != size || (!left && crc != entry.crc))
+        error = true;
+    return(n);
+}
+
+
+ZipReader::~ZipReader()
+{
+    if (in)
+        fclose(in);
+}
+
+
+bool ZipReader::open(const char* path)
+{
+    in = fopen(path, "rb");
+    if (!in || fseek(in, 0, SEEK_END) != 0)
+        return(false);
+
+    // The end of directory record is at the end, before a comment of unknown length
+    const long file_size = ftell(in);
+    const long tail_size = std::min<long>(file_size, END_OF_DIRECTORY_SIZE + MAX_COMMENT);
+    std::vector<unsigned char> tail(tail_size);
+    if (tail_size < END_OF_DIRECTORY_SIZE || fseek(in, file_size - tail_size, SEEK_SET) != 0 || fread(tail.data(), 1, tail_size, in) != (size_t)tail_size)
+        return(false);
+    long end = tail_size - END_OF_DIRECTORY_SIZE;
+    while (end >= 0 && little_endian(&tail[end], 4) != END_OF_DIRECTORY)
+        --end;
+    if (end < 0)
+        return(false);
+    const size_t count = (size_t)little_endian(&tail[end + 10], 2);
+    const size_t directory_size = (size_t)little_endian(&tail[end + 12], 4);
+    const long directory_offset = (long)little_endian(&tail[end + 16], 4);
+
+    std::vector<unsigned char> directory(directory_size);
+    if (fseek(in, directory_offset, SEEK_SET) != 0 || fread(directory.data(), 1, directory_size, in) != directory_size)
+        return(false);
+    size_t position = 0;
+    for (size_t e = 0; e != count; ++e)
+    {
+        const unsigned char* header = &directory[position];
+        if (position + CENTRAL_HEADER_SIZE > directory_size || little_endian(header, 4) != CENTRAL_HEADER)
+            return(false);
+        const size_t name_length = (size_t)little_endian(header + 28, 2);
+        const size_t extra_length = (size_t)little_endian(header + 30, 2);
+        const size_t comment_length = (size_t)little_endian(header + 32, 2);
+        if (position + CENTRAL_HEADER_SIZE + name_length > directory_size)
+            return(false);
+
+        ZipEntry entry;
+        entry.name.assign((const char*)header + CENTRAL_HEADER_SIZE, name_length);
+        entry.method = (int)little_endian(header + 10, 2);
+        entry.crc = (unsigned long)little_endian(header + 16, 4);
+        entry.compressed_size = little_endian(header + 20, 4);
+        entry.size = little_endian(header + 24, 4);
+        entry.header_offset = little_endian(header + 42, 4);
+        entries.push_back(entry);
+        position += CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+    }
+    return(true);
+}
+
+
+const ZipEntry* ZipReader::find(const std::string& name) const
+{
+    for (const ZipEntry& entry: entries)
+        if (entry.name == name)
+            return(&entry);
+    return(nullptr);
+}
+
+
+std::unique_ptr<ZipEntryReader> ZipReader::read(const ZipEntry& entry)
+{
+    // The local header repeats the name and may have a different extra field, so only its lengths are used
+    unsigned char header[LOCAL_HEADER_SIZE];
+    if ((entry.method != ZIP_STORED && entry.method != ZIP_DEFLATED) || fseek(in, (long)entry.header_offset, SEEK_SET) != 0 ||
+        fread(header, 1, LOCAL_HEADER_SIZE, in) != LOCAL_HEADER_SIZE || little_endian(header, 4) != LOCAL_HEADER ||
+        fseek(in, (long)(little_endian(header + 26, 2) + little_endian(header + 28, 2)), SEEK_CUR) != 0)
+        return(nullptr);
+    return(std::unique_ptr<ZipEntryReader>(new ZipEntryReader(in, entry)));
+}
+
+
+void ZipWriter::put(const std::vector<unsigned char>& bytes)
+{
+    fwrite(bytes.data(), 1, bytes.size(), out);
+    offset += bytes.size();
+}
+
+
+// Returns the current local time as MS-DOS time in the low and date in the high 16 bits
+static unsigned long dos_time()
+{
+    time_t now = time(nullptr);
+    const tm* local = localtime(&now);
+    return((unsigned long)(local->tm_hour << 11 | local->tm_min << 5 | local->tm_sec/2) |
+           (unsigned long)((local->tm_year - 80) << 9 | (local->tm_mon + 1) << 5 | local->tm_mday) << 16);
+}
+
+
+void ZipWriter::begin_entry(const std::string& name)
+{
+    ZipEntry entry = {name, ZIP_DEFLATED, 0, 0, 0, offset};
+    entries.push_back(entry);
+
+    // Sizes and CRC are not known yet; they follow the data in the descriptor
+    buffer.clear();
+    put_little_endian(buffer, LOCAL_HEADER, 4);
+    put_little_endian(buffer, VERSION_NEEDED, 2);
+    put_little_endian(buffer, FLAG_DATA_DESCRIPTOR, 2);
+    put_little_endian(buffer, ZIP_DEFLATED, 2);
+    put_little_endian(buffer, dos_time(), 4);
+    put_little_endian(buffer, 0, 12);
+    put_little_endian(buffer, name.size(), 2);
+    put_little_endian(buffer, 0, 2);
+    buffer.insert(buffer.end(), name.begin(), name.end());
+    put(buffer);
+}
+
+
+void ZipWriter::write(const unsigned char* data, size_t size)
+{
+    ZipEntry& entry = entries.back();
+    buffer.clear();
+    deflate_parallel(data, size, false, buffer);
+    put(buffer);
+    entry.crc = crc32(entry.crc, data, size);
+    entry.size += size;
+    entry.compressed_size += buffer.size();
+}
+
+
+void ZipWriter::end_entry()
+{
+    ZipEntry& entry = entries.back();
+    buffer.clear();
+    deflate_parallel(nullptr, 0, true, buffer);
+    entry.compressed_size += buffer.size();
+    put_little_endian(buffer, DATA_DESCRIPTOR, 4);
+    put_little_endian(buffer, entry.crc, 4);
+    put_little_endian(buffer, entry.compressed_size, 4);
+    put_little_endian(buffer, entry.size, 4);
+    put(buffer);
+}
+
+
+bool ZipWriter::finish()
+{
+    // Sizes and offsets of 4GB or more would need the Zip64 extensions
+    bool fits = true;
+    const unsigned long long directory_offset = offset;
+    const unsigned long time = dos_time();
+    buffer.clear();
+    for (const ZipEntry& entry: entries)
+    {
+        fits &= (entry.size < 0xfffffffful && entry.compressed_size < 0xfffffffful && entry.header_offset < 0xfffffffful);
+        put_little_endian(buffer, CENTRAL_HEADER, 4);
+        put_little_endian(buffer, VERSION_NEEDED, 2);   // Made by
+        put_little_endian(buffer, VERSION_NEEDED, 2);
+        put_little_endian(buffer, FLAG_DATA_DESCRIPTOR, 2);
+        put_little_endian(buffer, entry.method, 2);
+        put_little_endian(buffer, time, 4);
+        put_little_endian(buffer, entry.crc, 4);
+        put_little_endian(buffer, entry.compressed_size, 4);
+        put_little_endian(buffer, entry.size, 4);
+        put_little_endian(buffer, entry.name.size(), 2);
+        put_little_endian(buffer, 0, 12);              // Extra and comment lengths, disk, attributes
+        put_little_endian(buffer, entry.header_offset, 4);
+        buffer.insert(buffer.end(), entry.name.begin(), entry.name.end());
+    }
+    const unsigned long long directory_size = buffer.size();
+    put_little_endian(buffer, END_OF_DIRECTORY, 4);
+    put_little_endian(buffer, 0, 4);                   // Disks
+    put_little_endian(buffer, entries.size(), 2);
+    put_little_endian(buffer, entries.size(), 2);
+    put_little_endian(buffer, directory_size, 4);
+    put_little_endian(buffer, directory_offset, 4);
+    put_little_endian(buffer, 0, 2);                   // Comment length
+    put(buffer);
+    return(fits && !ferror(out));
+}
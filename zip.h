@@ -0,0 +1,96 @@
+// Zip archives, the container of .xlsx workbooks: reading entries from an archive on disk and writing a new archive as a stream.
+
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "deflate.h"
+
+// Constants: compression methods
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+
+// An entry listed in the central directory of an archive
+struct ZipEntry {
+    std::string name;
+    int method;
+    unsigned long crc;
+    unsigned long long compressed_size;
+    unsigned long long size;
+    unsigned long long header_offset;
+};
+
+
+// Reads the uncompressed contents of one entry, checking its CRC at the end.
+class ZipEntryReader {
+    FILE* in;
+    const ZipEntry& entry;
+    std::unique_ptr<Inflater> inflater;     // For deflated entries
+    unsigned long long left;                // Bytes not yet read
+    unsigned long crc;
+    bool error;
+
+public:
+    ZipEntryReader(FILE* in, const ZipEntry& entry);
+
+    // Reads up to size bytes into out. Returns the number of bytes read, which is less than size only at the end of the entry or on an error.
+    size_t read(unsigned char* out, size_t size);
+
+    // Returns true if the entry is damaged or could not be read.
+    bool failed() const { return(error); }
+};
+
+
+// An archive open for reading. Only one entry may be read at a time.
+class ZipReader {
+    FILE* in;
+    std::vector<ZipEntry> entries;
+
+public:
+    ZipReader() : in(nullptr) {}
+    ~ZipReader();
+
+    // Opens the archive at path and reads its central directory. Returns false if it cannot be read or is not a zip archive.
+    bool open(const char* path);
+
+    // Returns the entry with the given name, or nullptr.
+    const ZipEntry* find(const std::string& name) const;
+
+    // Starts reading an entry. Returns nullptr if its header is damaged or its compression method is not supported.
+    std::unique_ptr<ZipEntryReader> read(const ZipEntry& entry);
+};
+
+
+// Writes an archive entry by entry. Entries are deflated as they are written and followed by a data descriptor, so nothing is held back or rewritten.
+class ZipWriter {
+    FILE* out;
+    unsigned long long offset;
+    std::vector<ZipEntry> entries;
+    std::vector<unsigned char> buffer;
+
+    void put(const std::vector<unsigned char>& bytes);
+
+public:
+    // Starts an archive on out, which must be open in binary mode.
+    ZipWriter(FILE* out) : out(out), offset(0) {}
+
+    // Starts a new entry.
+    void begin_entry(const std::string& name);
+
+    // Compresses and writes size bytes of the current entry.
+    void write(const unsigned char* data, size_t size);
+    void write(const std::string& text) { write((const unsigned char*)text.data(), text.size()); }
+
+    // Ends the current entry.
+    void end_entry();
+
+    // Writes the central directory. Returns false if writing failed.
+    bool finish();
+};
+
+
+#endif /* ZIP_H */
@@ -0,0 +1,1329 @@
+#include <cstring>
+#include <algorithm>
+#include <queue>
+#include "zstd.h"
+#include "parallel.h"
+#include "instrument.h"
+
+
+// Constants: magic numbers of a frame and of a skippable frame (whose low four bits may be anything), and the most content of a block
+#define ZSTD_MAGIC 0xFD2FB528ul
+#define SKIPPABLE_MAGIC 0x184D2A50ul
+#define MAX_BLOCK 131072
+
+// Constants: block types, and the types of a literals section
+enum {raw_block, rle_block, compressed_block};
+enum {raw_literals, rle_literals, huffman_literals, treeless_literals};
+
+// Constants: longest Huffman code of literals, and most accurate FSE tables of literal lengths, offsets, match lengths and Huffman weights
+#define HUFFMAN_MAX_BITS 11
+#define FSE_MAX_ACCURACY 9
+static const int max_accuracy[3] = {9, 8, 9};
+static const int max_symbol[3] = {35, 31, 52};
+#define WEIGHT_MAX_ACCURACY 6
+
+// Constants: shortest match and size of the match hash table of the compressor
+#define MIN_MATCH 4
+#define HASH_BITS 16
+
+// Constants: base values and extra bits of the literal length codes 0-35 and the match length codes 0-52
+static const unsigned literal_base[36] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536
+};
+static const unsigned char literal_extra[36] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16
+};
+static const unsigned match_base[53] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051, 4099, 8195, 16387, 32771, 65539
+};
+static const unsigned char match_extra[53] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16
+};
+
+// Constants: predefined distributions of literal lengths, offsets and match lengths, with their accuracies
+static const short literal_distribution[36] = {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1, -1, -1, -1, -1
+};
+static const short offset_distribution[29] = {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+static const short match_distribution[53] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1
+};
+static const short* const predefined_distribution[3] = {literal_distribution, offset_distribution, match_distribution};
+static const int predefined_symbols[3] = {36, 29, 53};
+static const int predefined_accuracy[3] = {6, 5, 6};
+
+
+static unsigned long read_le(const unsigned char* bytes, int count)
+{
+    unsigned long value = 0;
+    for (int b = 0; b != count; ++b)
+        value |= (unsigned long)bytes[b] << 8*b;
+    return(value);
+}
+
+
+static void put_le(unsigned long long value, int count, std::vector<unsigned char>& out)
+{
+    for (int b = 0; b != count; ++b)
+        out.push_back((unsigned char)(value >> 8*b));
+}
+
+
+static int highest_bit(unsigned long long value)
+{
+    int bit = -1;
+    while (value)
+    {
+        value >>= 1;
+        ++bit;
+    }
+    return(bit);
+}
+
+
+// The XXH64 hash, whose low 32 bits are the content checksum of a frame. Data may be added in pieces of any size.
+class Xxh64 {
+    unsigned long long lanes[4];
+    unsigned char buffer[32];
+    size_t buffered;
+    unsigned long long total;
+
+    static unsigned long long rotate(unsigned long long value, int bits) { return((value << bits) | (value >> (64 - bits))); }
+    static unsigned long long round(unsigned long long lane, unsigned long long input) { return(rotate(lane + input*PRIME2, 31)*PRIME1); }
+    static unsigned long long read64(const unsigned char* bytes) { return(read_le(bytes, 4) | (unsigned long long)read_le(bytes + 4, 4) << 32); }
+
+public:
+    static const unsigned long long PRIME1 = 11400714785074694791ull, PRIME2 = 14029467366897019727ull, PRIME3 = 1609587929392839161ull,
+                                    PRIME4 = 9650029242287828579ull, PRIME5 = 2870177450012600261ull;
+
+    Xxh64() : lanes{PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1}, buffered(0), total(0) {}
+
+    void add(const unsigned char* data, size_t size)
+    {
+        total += size;
+        if (buffered + size < 32)
+        {
+            memcpy(buffer + buffered, data, size);
+            buffered += size;
+            return;
+        }
+        if (buffered)
+        {
+            const size_t n = 32 - buffered;
+            memcpy(buffer + buffered, data, n);
+            for (int l = 0; l != 4; ++l)
+                lanes[l] = round(lanes[l], read64(buffer + 8*l));
+            data += n;
+            size -= n;
+            buffered = 0;
+        }
+        for (; size >= 32; data += 32, size -= 32)
+            for (int l = 0; l != 4; ++l)
+                lanes[l] = round(lanes[l], read64(data + 8*l));
+        memcpy(buffer, data, size);
+        buffered = size;
+    }
+
+    unsigned long long digest() const
+    {
+        unsigned long long hash = PRIME5;
+        if (total >= 32)
+        {
+            hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+            for (int l = 0; l != 4; ++l)
+                hash = (hash ^ round(0, lanes[l]))*PRIME1 + PRIME4;
+        }
+        hash += total;
+        size_t p = 0;
+        for (; p + 8 <= buffered; p += 8)
+            hash = rotate(hash ^ round(0, read64(buffer + p)), 27)*PRIME1 + PRIME4;
+        if (p + 4 <= buffered)
+        {
+            hash = rotate(hash ^ read_le(buffer + p, 4)*PRIME1, 23)*PRIME2 + PRIME3;
+            p += 4;
+        }
+        for (; p != buffered; ++p)
+            hash = rotate(hash ^ buffer[p]*PRIME5, 11)*PRIME1;
+        hash = (hash ^ (hash >> 33))*PRIME2;
+        hash = (hash ^ (hash >> 29))*PRIME3;
+        return(hash ^ (hash >> 32));
+    }
+};
+
+
+// Reads a bitstream from its end back to its start, the order in which Zstandard entropy coded data is read. The last byte holds a 1 bit above the data. Bits before the start read as zeros; callers check that streams end where they must.
+struct BackwardBits {
+    const unsigned char* data;
+    long long position;     // Bits before the next to be read
+
+    bool start(const unsigned char* bytes, size_t size)
+    {
+        if (!size || !bytes[size - 1])
+            return(false);
+        data = bytes;
+        position = 8*(long long)(size - 1) + highest_bit(bytes[size - 1]);
+        return(true);
+    }
+
+    // Reads count bits, at most 57
+    unsigned long long read(int count)
+    {
+        position -= count;
+        long long first = position;
+        int zeros = 0;
+        if (first < 0)
+        {
+            if (first + count <= 0)
+                return(0);
+            zeros = (int)-first;
+            count -= zeros;
+            first = 0;
+        }
+        if (!count)
+            return(0);
+        const unsigned char* bytes = data + (first >> 3);
+        const int shift = first & 7;
+        unsigned long long value = 0;
+        for (int b = 0; 8*b < shift + count; ++b)
+            value |= (unsigned long long)bytes[b] << 8*b;
+        return(((value >> shift) & ((1ull << count) - 1)) << zeros);
+    }
+};
+
+
+// Writes a bitstream to be read by BackwardBits, putting the values read last first
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    unsigned long long buffer;
+    int count;
+
+    BitWriter(std::vector<unsigned char>& out) : out(out), buffer(0), count(0) {}
+
+    void put(unsigned long long value, int bits)
+    {
+        buffer |= value << count;
+        count += bits;
+        while (count >= 8)
+        {
+            out.push_back((unsigned char)buffer);
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Writes the 1 bit that marks the end of the stream, and the last byte
+    void close()
+    {
+        put(1, 1);
+        if (count)
+            out.push_back((unsigned char)buffer);
+        buffer = 0;
+        count = 0;
+    }
+};
+
+
+// An FSE decoding table: in state s, the symbol is entries[s].symbol and the next state is entries[s].base plus the next entries[s].bits bits
+struct FseTable {
+    struct Entry {
+        unsigned char symbol, bits;
+        unsigned short base;
+    };
+    int accuracy;
+    Entry entries[1 << FSE_MAX_ACCURACY];
+
+    // Spreads the symbols over the table as RFC 8878 section 4.1.1 does; a count of -1 is a symbol of probability below 1
+    void build(const short* counts, int symbols, int table_accuracy)
+    {
+        accuracy = table_accuracy;
+        const int size = 1 << accuracy;
+        int high = size - 1;
+        unsigned short next[256];
+        for (int s = 0; s != symbols; ++s)
+        {
+            if (counts[s] == -1)
+            {
+                entries[high--].symbol = (unsigned char)s;
+                next[s] = 1;
+            }
+            else
+                next[s] = counts[s];
+        }
+        const int step = (size >> 1) + (size >> 3) + 3;
+        int position = 0;
+        for (int s = 0; s != symbols; ++s)
+        {
+            for (int i = 0; i < counts[s]; ++i)
+            {
+                entries[position].symbol = (unsigned char)s;
+                do
+                    position = (position + step) & (size - 1);
+                while (position > high);
+            }
+        }
+        for (int i = 0; i != size; ++i)
+        {
+            const int state = next[entries[i].symbol]++;
+            const int bits = accuracy - highest_bit(state);
+            entries[i].bits = (unsigned char)bits;
+            entries[i].base = (unsigned short)((state << bits) - size);
+        }
+    }
+
+    // A table of one symbol, as given by the RLE mode of a sequences section
+    void single(unsigned char symbol)
+    {
+        accuracy = 0;
+        entries[0] = Entry{symbol, 0, 0};
+    }
+
+    // Reads the counts of a table from data (RFC 8878 section 4.1.1) and builds it. Returns the bytes read, or 0 if the description is damaged.
+    size_t read(const unsigned char* data, size_t size, int most_accurate, int last_symbol)
+    {
+        long long bit = 0;
+        auto peek = [&](int count) {
+            unsigned long value = 0;
+            for (int b = 0; b < count; ++b)
+            {
+                const long long at = bit + b;
+                if ((size_t)(at >> 3) < size)
+                    value |= (unsigned long)((data[at >> 3] >> (at & 7)) & 1) << b;
+            }
+            return(value);
+        };
+
+        if (!size)
+            return(0);
+        const int table_accuracy = (int)peek(4) + 5;
+        bit += 4;
+        if (table_accuracy > most_accurate)
+            return(0);
+        short counts[256];
+        int remaining = (1 << table_accuracy) + 1, threshold = 1 << table_accuracy, bits = table_accuracy + 1, s = 0;
+        while (remaining > 1 && s <= last_symbol)
+        {
+            const int most = 2*threshold - 1 - remaining;
+            int count = (int)peek(bits);
+            if ((count & (threshold - 1)) < most)
+            {
+                count &= threshold - 1;
+                bit += bits - 1;
+            }
+            else
+            {
+                if (count >= threshold)
+                    count -= most;
+                bit += bits;
+            }
+            --count;
+            remaining -= count < 0 ? -count : count;
+            counts[s++] = (short)count;
+            while (remaining < threshold)
+            {
+                --bits;
+                threshold >>= 1;
+            }
+            if (count == 0)
+            {
+                // Runs of symbols of probability 0 follow, three per 2 bit flag of 3
+                int flag;
+                do
+                {
+                    flag = (int)peek(2);
+                    bit += 2;
+                    for (int z = 0; z != flag; ++z)
+                        if (s <= last_symbol)
+                            counts[s++] = 0;
+                } while (flag == 3);
+            }
+        }
+        if (remaining != 1 || (bit + 7)/8 > (long long)size)
+            return(0);
+        build(counts, s, table_accuracy);
+        return((size_t)(bit + 7)/8);
+    }
+};
+
+
+// A Huffman decoding table of literals, looked up with the next max_bits bits of a stream
+struct HuffmanTable {
+    int max_bits;
+    unsigned char symbols[1 << HUFFMAN_MAX_BITS], lengths[1 << HUFFMAN_MAX_BITS];
+
+    // Reads the weights of the literals (RFC 8878 section 4.2.1) and builds the table. Returns the bytes read, or 0 if the description is damaged.
+    size_t read(const unsigned char* data, size_t size)
+    {
+        if (!size)
+            return(0);
+        unsigned char weights[256];
+        int count = 0;
+        size_t used;
+        if (data[0] >= 128)
+        {
+            count = data[0] - 127;
+            used = 1 + (count + 1)/2;
+            if (used > size)
+                return(0);
+            for (int i = 0; i != count; ++i)
+                weights[i] = (i % 2) ? data[1 + i/2] & 15 : data[1 + i/2] >> 4;
+        }
+        else
+        {
+            // Weights compressed with FSE as two interleaved states
+            used = 1 + data[0];
+            if (used > size)
+                return(0);
+            FseTable table;
+            const size_t header = table.read(data + 1, data[0], WEIGHT_MAX_ACCURACY, 255);
+            BackwardBits bits;
+            if (!header || !bits.start(data + 1 + header, data[0] - header))
+                return(0);
+            unsigned states[2];
+            states[0] = (unsigned)bits.read(table.accuracy);
+            states[1] = (unsigned)bits.read(table.accuracy);
+            for (int s = 0; ; s ^= 1)
+            {
+                if (count > 253)
+                    return(0);
+                const FseTable::Entry& entry = table.entries[states[s]];
+                weights[count++] = entry.symbol;
+                states[s] = entry.base + (unsigned)bits.read(entry.bits);
+                if (bits.position < 0)
+                {
+                    weights[count++] = table.entries[states[s ^ 1]].symbol;
+                    break;
+                }
+            }
+        }
+
+        // The weight of the last symbol is what completes the code
+        unsigned long total = 0;
+        for (int i = 0; i != count; ++i)
+        {
+            if (weights[i] > HUFFMAN_MAX_BITS)
+                return(0);
+            total += weights[i] ? 1ul << (weights[i] - 1) : 0;
+        }
+        if (!total)
+            return(0);
+        max_bits = highest_bit(total) + 1;
+        const unsigned long rest = (1ul << max_bits) - total;
+        if (max_bits > HUFFMAN_MAX_BITS || (rest & (rest - 1)) != 0)
+            return(0);
+        weights[count++] = (unsigned char)(highest_bit(rest) + 1);
+
+        // Longer codes come first in the table, and symbols in order within a length
+        unsigned start[HUFFMAN_MAX_BITS + 2] = {0};
+        for (int i = 0; i != count; ++i)
+            if (weights[i])
+                start[max_bits + 1 - weights[i]] += 1u << (weights[i] - 1);
+        unsigned position = 0;
+        for (int length = max_bits; length >= 1; --length)
+        {
+            const unsigned n = start[length];
+            start[length] = position;
+            position += n;
+        }
+        for (int i = 0; i != count; ++i)
+        {
+            if (!weights[i])
+                continue;
+            const int length = max_bits + 1 - weights[i];
+            const unsigned n = 1u << (max_bits - length);
+            memset(symbols + start[length], i, n);
+            memset(lengths + start[length], length, n);
+            start[length] += n;
+        }
+        return(used);
+    }
+
+    // Decodes count literals from a stream that must hold exactly them
+    bool decode(const unsigned char* data, size_t size, unsigned char* out, size_t count) const
+    {
+        BackwardBits bits;
+        if (!bits.start(data, size))
+            return(false);
+        const unsigned mask = (1u << max_bits) - 1;
+        unsigned state = (unsigned)bits.read(max_bits);
+        for (size_t i = 0; i != count; ++i)
+        {
+            out[i] = symbols[state];
+            const int length = lengths[state];
+            state = ((state << length) | (unsigned)bits.read(length)) & mask;
+        }
+        return(bits.position == -max_bits);
+    }
+};
+
+
+// What a frame header gives: the window matches may reach back over, the size of the content if stored, and whether a checksum follows the blocks
+struct FrameHeader {
+    unsigned long long window, content_size;
+    bool has_size, checksum;
+};
+
+
+// Returns the bytes of a frame header that follow its descriptor byte
+static size_t header_size(unsigned char descriptor)
+{
+    static const int dictionary_bytes[4] = {0, 1, 2, 4};
+    static const int size_bytes[4] = {0, 2, 4, 8};
+    const bool single_segment = descriptor & 0x20;
+    return(!single_segment + dictionary_bytes[descriptor & 3] + ((descriptor >> 6) ? size_bytes[descriptor >> 6] : single_segment));
+}
+
+
+// Reads a frame header starting at its descriptor byte. Returns false if it is damaged, needs a dictionary or has too large a window.
+static bool parse_header(const unsigned char* header, FrameHeader& frame)
+{
+    static const int dictionary_bytes[4] = {0, 1, 2, 4};
+    static const int size_bytes[4] = {1, 2, 4, 8};
+    const unsigned char descriptor = *header++;
+    const bool single_segment = descriptor & 0x20;
+    if (descriptor & 0x08)
+        return(false);
+    if (!single_segment)
+    {
+        const unsigned long long base = 1ull << (10 + (*header >> 3));
+        frame.window = base + base/8*(*header & 7);
+        ++header;
+    }
+    if (read_le(header, dictionary_bytes[descriptor & 3]) != 0)
+        return(false);
+    header += dictionary_bytes[descriptor & 3];
+
+    frame.has_size = single_segment || (descriptor >> 6);
+    frame.content_size = 0;
+    if (frame.has_size)
+    {
+        const int n = size_bytes[descriptor >> 6];
+        for (int b = 0; b != n; ++b)
+            frame.content_size |= (unsigned long long)header[b] << 8*b;
+        frame.content_size += (n == 2) ? 256 : 0;
+    }
+    if (single_segment)
+        frame.window = frame.content_size;
+    frame.checksum = descriptor & 0x04;
+    return(frame.window <= ZSTD_WINDOW_MAX);
+}
+
+
+// Decodes the blocks of one frame, appending their content to output, which holds enough earlier content for matches to copy from. The tables and repeated offsets carried from block to block are kept here.
+class FrameDecoder {
+    FseTable tables[3];             // Literal lengths, offsets and match lengths
+    bool have_tables[3];
+    HuffmanTable huffman;
+    bool have_huffman;
+    size_t repeats[3];
+    std::vector<unsigned char> literals;
+
+    bool decode_literals(const unsigned char*& data, const unsigned char* end);
+    bool decode_sequences(const unsigned char* data, const unsigned char* end);
+
+public:
+    std::vector<unsigned char> output;
+
+    FrameDecoder() : have_tables{false, false, false}, have_huffman(false), repeats{1, 4, 8} {}
+
+    // Decodes a block of the given type, whose size is its content for an RLE block and its bytes otherwise. Returns false if it is damaged.
+    bool decode(int type, const unsigned char* data, size_t size);
+};
+
+
+bool FrameDecoder::decode_literals(const unsigned char*& data, const unsigned char* end)
+{
+    if (data == end)
+        return(false);
+    const int type = data[0] & 3, format = (data[0] >> 2) & 3;
+    if (type == raw_literals || type == rle_literals)
+    {
+        const int header = (format == 1) ? 2 : (format == 3) ? 3 : 1;
+        if (end - data < header)
+            return(false);
+        const size_t regenerated = (format & 1) ? read_le(data, header) >> 4 : data[0] >> 3;
+        data += header;
+        if (type == raw_literals)
+        {
+            if ((size_t)(end - data) < regenerated)
+                return(false);
+            literals.assign(data, data + regenerated);
+            data += regenerated;
+        }
+        else
+        {
+            if (data == end)
+                return(false);
+            literals.assign(regenerated, *data++);
+        }
+        return(regenerated <= MAX_BLOCK);
+    }
+
+    static const int header_bytes[4] = {3, 3, 4, 5};
+    static const int size_bits[4] = {10, 10, 14, 18};
+    const int header = header_bytes[format], bits = size_bits[format];
+    if (end - data < header)
+        return(false);
+    unsigned long long sizes = 0;
+    for (int b = 0; b != header; ++b)
+        sizes |= (unsigned long long)data[b] << 8*b;
+    const size_t regenerated = (sizes >> 4) & ((1ul << bits) - 1);
+    const size_t compressed = (sizes >> (4 + bits)) & ((1ul << bits) - 1);
+    data += header;
+    if ((size_t)(end - data) < compressed || regenerated > MAX_BLOCK)
+        return(false);
+    const unsigned char* stream = data;
+    const unsigned char* stream_end = data + compressed;
+    data = stream_end;
+
+    if (type == huffman_literals)
+    {
+        const size_t used = huffman.read(stream, compressed);
+        if (!used)
+            return(false);
+        stream += used;
+        have_huffman = true;
+    }
+    else if (!have_huffman)
+        return(false);
+
+    literals.resize(regenerated);
+    if (format == 0)
+        return(huffman.decode(stream, stream_end - stream, literals.data(), regenerated));
+
+    // Four streams, the first three of equal length, after a table of their sizes
+    const size_t part = (regenerated + 3)/4;
+    if (stream_end - stream < 6 || 3*part > regenerated)
+        return(false);
+    size_t stream_sizes[4];
+    for (int s = 0; s != 3; ++s)
+        stream_sizes[s] = read_le(stream + 2*s, 2);
+    stream += 6;
+    if (stream_sizes[0] + stream_sizes[1] + stream_sizes[2] > (size_t)(stream_end - stream))
+        return(false);
+    stream_sizes[3] = (stream_end - stream) - stream_sizes[0] - stream_sizes[1] - stream_sizes[2];
+    for (int s = 0; s != 4; ++s)
+    {
+        if (!huffman.decode(stream, stream_sizes[s], literals.data() + s*part, (s == 3) ? regenerated - 3*part : part))
+            return(false);
+        stream += stream_sizes[s];
+    }
+    return(true);
+}
+
+
+bool FrameDecoder::decode_sequences(const unsigned char* data, const unsigned char* end)
+{
+    const size_t first = output.size();
+    if (data == end)
+        return(false);
+    size_t count = data[0];
+    if (count >= 255)
+    {
+        if (end - data < 3)
+            return(false);
+        count = read_le(data + 1, 2) + 0x7F00;
+        data += 3;
+    }
+    else if (count >= 128)
+    {
+        if (end - data < 2)
+            return(false);
+        count = ((count - 128) << 8) + data[1];
+        data += 2;
+    }
+    else
+        ++data;
+    if (!count)
+    {
+        output.insert(output.end(), literals.begin(), literals.end());
+        return(data == end);
+    }
+
+    // The tables are given in the order literal lengths, offsets, match lengths
+    if (data == end || (*data & 3) != 0)
+        return(false);
+    const int modes = *data++;
+    for (int t = 0; t != 3; ++t)
+    {
+        switch ((modes >> (6 - 2*t)) & 3)
+        {
+            case 0:
+                tables[t].build(predefined_distribution[t], predefined_symbols[t], predefined_accuracy[t]);
+                break;
+            case 1:
+                if (data == end || *data > max_symbol[t])
+                    return(false);
+                tables[t].single(*data++);
+                break;
+            case 2:
+            {
+                const size_t used = tables[t].read(data, end - data, max_accuracy[t], max_symbol[t]);
+                if (!used)
+                    return(false);
+                data += used;
+                break;
+            }
+            default:
+                if (!have_tables[t])
+                    return(false);
+        }
+        have_tables[t] = true;
+    }
+
+    BackwardBits bits;
+    if (!bits.start(data, end - data))
+        return(false);
+    const FseTable& literal_table = tables[0];
+    const FseTable& offset_table = tables[1];
+    const FseTable& match_table = tables[2];
+    unsigned literal_state = (unsigned)bits.read(literal_table.accuracy);
+    unsigned offset_state = (unsigned)bits.read(offset_table.accuracy);
+    unsigned match_state = (unsigned)bits.read(match_table.accuracy);
+    size_t taken = 0;
+    for (size_t i = 0; i != count; ++i)
+    {
+        const FseTable::Entry& literal_entry = literal_table.entries[literal_state];
+        const FseTable::Entry& offset_entry = offset_table.entries[offset_state];
+        const FseTable::Entry& match_entry = match_table.entries[match_state];
+        const size_t offset_value = (1ull << offset_entry.symbol) + bits.read(offset_entry.symbol);
+        const size_t match = match_base[match_entry.symbol] + bits.read(match_extra[match_entry.symbol]);
+        const size_t length = literal_base[literal_entry.symbol] + bits.read(literal_extra[literal_entry.symbol]);
+        if (i + 1 != count)
+        {
+            literal_state = literal_entry.base + (unsigned)bits.read(literal_entry.bits);
+            match_state = match_entry.base + (unsigned)bits.read(match_entry.bits);
+            offset_state = offset_entry.base + (unsigned)bits.read(offset_entry.bits);
+        }
+
+        // Offset values 1-3 repeat one of the last three offsets, shifted by one when there are no literals
+        size_t offset;
+        if (offset_value > 3)
+        {
+            offset = offset_value - 3;
+            repeats[2] = repeats[1];
+            repeats[1] = repeats[0];
+            repeats[0] = offset;
+        }
+        else
+        {
+            const size_t index = offset_value - 1 + (length == 0);
+            if (index == 0)
+                offset = repeats[0];
+            else
+            {
+                offset = (index < 3) ? repeats[index] : repeats[0] - 1;
+                if (index > 1)
+                    repeats[2] = repeats[1];
+                repeats[1] = repeats[0];
+                repeats[0] = offset;
+            }
+        }
+
+        if (length > literals.size() - taken)
+            return(false);
+        output.insert(output.end(), literals.begin() + taken, literals.begin() + taken + length);
+        taken += length;
+        const size_t at = output.size();
+        if (offset == 0 || offset > at || at + match - first > MAX_BLOCK)
+            return(false);
+        output.resize(at + match);
+        unsigned char* to = output.data() + at;
+        const unsigned char* from = to - offset;
+        if (offset >= match)
+            memcpy(to, from, match);
+        else
+            for (size_t k = 0; k != match; ++k)
+                to[k] = from[k];
+    }
+    output.insert(output.end(), literals.begin() + taken, literals.end());
+    return(bits.position == 0 && output.size() - first <= MAX_BLOCK);
+}
+
+
+bool FrameDecoder::decode(int type, const unsigned char* data, size_t size)
+{
+    if (type == raw_block)
+        output.insert(output.end(), data, data + size);
+    else if (type == rle_block)
+        output.insert(output.end(), size, data[0]);
+    else
+    {
+        const unsigned char* end = data + size;
+        return(decode_literals(data, end) && decode_sequences(data, end));
+    }
+    return(true);
+}
+
+
+// Decodes a frame held whole, from its descriptor byte to its checksum, into content. Returns false if it is damaged.
+static bool decode_frame(const std::vector<unsigned char>& frame, std::vector<unsigned char>& content)
+{
+    FrameHeader header;
+    if (!parse_header(frame.data(), header))
+        return(false);
+    FrameDecoder decoder;
+    decoder.output.reserve(header.content_size);
+    size_t position = 1 + header_size(frame[0]);
+    bool last = false;
+    while (!last)
+    {
+        const unsigned long block = read_le(frame.data() + position, 3);
+        last = block & 1;
+        const int type = (block >> 1) & 3;
+        const size_t size = block >> 3;
+        position += 3;
+        if (!decoder.decode(type, frame.data() + position, size))
+            return(false);
+        position += (type == rle_block) ? 1 : size;
+    }
+    if (decoder.output.size() != header.content_size)
+        return(false);
+    if (header.checksum)
+    {
+        Xxh64 hash;
+        hash.add(decoder.output.data(), decoder.output.size());
+        if ((hash.digest() & 0xfffffffful) != read_le(frame.data() + position, 4))
+            return(false);
+    }
+    content.swap(decoder.output);
+    return(true);
+}
+
+
+bool is_zstd(FILE* in)
+{
+    int c = getc(in);
+    if (c != EOF)
+        ungetc(c, in);
+    return(c == (ZSTD_MAGIC & 0xff));
+}
+
+
+ZstdReader::ZstdReader(FILE* in) : in(in)
+{
+    start();
+}
+
+
+ZstdReader::~ZstdReader()
+{
+    finish();
+}
+
+
+// Decompresses the frames read whole in parallel, queues their content in order and empties frames. Returns false if a frame is damaged or the reader is stopping.
+bool ZstdReader::decompress_group(std::vector<std::vector<unsigned char>>& frames)
+{
+    std::vector<std::vector<unsigned char>> contents(frames.size());
+    std::vector<char> decoded(frames.size());
+    parallel_for(frames.size(), [&](size_t f) {
+        decoded[f] = decode_frame(frames[f], contents[f]);
+    });
+    frames.clear();
+
+    std::vector<char> buffer;
+    for (size_t f = 0; f != contents.size(); ++f)
+    {
+        if (!decoded[f])
+            return(false);
+        buffer.insert(buffer.end(), contents[f].begin(), contents[f].end());
+        if (buffer.size() >= GZIP_BUFFER || f + 1 == contents.size())
+        {
+            if (!queue(std::move(buffer)))
+                return(false);
+            buffer.clear();
+        }
+    }
+    return(true);
+}
+
+
+// Runs on the worker thread: reads frame after frame, passing small frames to decompress_group and decompressing the others a block at a time, keeping their window of earlier content
+bool ZstdReader::decompress()
+{
+    std::vector<std::vector<unsigned char>> group;
+    size_t group_size = 0;
+    unsigned char magic[4];
+    size_t n;
+    while ((n = fread(magic, 1, 4, in)) == 4)
+    {
+        const unsigned long number = read_le(magic, 4);
+        if ((number & ~0xful) == SKIPPABLE_MAGIC)
+        {
+            unsigned char size[4];
+            if (fread(size, 1, 4, in) != 4)
+                return(false);
+            for (unsigned long skip = read_le(size, 4); skip; --skip)
+                if (getc(in) == EOF)
+                    return(false);
+            continue;
+        }
+
+        std::vector<unsigned char> frame(1);
+        FrameHeader header;
+        if (number != ZSTD_MAGIC || fread(frame.data(), 1, 1, in) != 1)
+            return(false);
+        frame.resize(1 + header_size(frame[0]));
+        if (fread(frame.data() + 1, 1, frame.size() - 1, in) != frame.size() - 1 || !parse_header(frame.data(), header))
+            return(false);
+
+        if (header.has_size && header.content_size <= ZSTD_FRAME)
+        {
+            // The blocks are read whole and decompressed with the rest of the group
+            bool last = false;
+            while (!last)
+            {
+                const size_t at = frame.size();
+                frame.resize(at + 3);
+                if (fread(frame.data() + at, 1, 3, in) != 3)
+                    return(false);
+                const unsigned long block = read_le(frame.data() + at, 3);
+                const size_t size = (((block >> 1) & 3) == rle_block) ? 1 : block >> 3;
+                last = block & 1;
+                if (((block >> 1) & 3) > compressed_block || (block >> 3) > MAX_BLOCK)
+                    return(false);
+                frame.resize(at + 3 + size);
+                if (fread(frame.data() + at + 3, 1, size, in) != size)
+                    return(false);
+            }
+            const size_t at = frame.size();
+            frame.resize(at + (header.checksum ? 4 : 0));
+            if (fread(frame.data() + at, 1, frame.size() - at, in) != frame.size() - at)
+                return(false);
+            group.push_back(std::move(frame));
+            group_size += header.content_size;
+            if (group_size >= ZSTD_GROUP)
+            {
+                if (!decompress_group(group))
+                    return(false);
+                group_size = 0;
+            }
+            continue;
+        }
+        if (!decompress_group(group))
+            return(false);
+        group_size = 0;
+
+        // Content is passed on once GZIP_BUFFER bytes are ready, and the window kept for matches is trimmed once it has grown by its own size
+        const size_t window = (size_t)header.window;
+        FrameDecoder decoder;
+        Xxh64 hash;
+        std::vector<unsigned char> block(MAX_BLOCK);
+        unsigned long long total = 0;
+        size_t passed = 0;
+        bool last = false;
+        while (!last)
+        {
+            unsigned char block_header[3];
+            if (fread(block_header, 1, 3, in) != 3)
+                return(false);
+            const unsigned long value = read_le(block_header, 3);
+            const int type = (value >> 1) & 3;
+            const size_t size = value >> 3;
+            last = value & 1;
+            if (type > compressed_block || size > MAX_BLOCK || size > std::max<size_t>(window, 1))
+                return(false);
+            const size_t bytes = (type == rle_block) ? 1 : size;
+            if (fread(block.data(), 1, bytes, in) != bytes || !decoder.decode(type, block.data(), size))
+                return(false);
+
+            std::vector<unsigned char>& output = decoder.output;
+            if (!last && output.size() - passed < GZIP_BUFFER)
+                continue;
+            hash.add(output.data() + passed, output.size() - passed);
+            total += output.size() - passed;
+            for (; passed != output.size(); passed = std::min(output.size(), passed + GZIP_BUFFER))
+                if (!queue(std::vector<char>(output.begin() + passed, output.begin() + std::min(output.size(), passed + GZIP_BUFFER))))
+                    return(false);
+            if (output.size() > 2*window + GZIP_BUFFER)
+            {
+                output.erase(output.begin(), output.end() - window);
+                passed = output.size();
+            }
+        }
+        if (header.has_size && total != header.content_size)
+            return(false);
+        if (header.checksum)
+        {
+            unsigned char checksum[4];
+            if (fread(checksum, 1, 4, in) != 4 || (hash.digest() & 0xfffffffful) != read_le(checksum, 4))
+                return(false);
+        }
+    }
+    return(n == 0 && !ferror(in) && decompress_group(group));
+}
+
+
+// Compressed form of one block: its sequences, and the literals they copy
+struct Sequence {
+    unsigned literals, offset, match;
+};
+
+
+// An FSE encoding table of a predefined distribution, built from the decoding table: to go on to state y after a symbol s, the encoder takes the state x = states[s][y] whose range of next states holds y, and writes y - base of x
+struct FseEncoder {
+    FseTable table;
+    std::vector<unsigned short> states;
+
+    FseEncoder(int t)
+    {
+        table.build(predefined_distribution[t], predefined_symbols[t], predefined_accuracy[t]);
+        const int accuracy = table.accuracy;
+        states.resize(predefined_symbols[t] << accuracy);
+        for (int x = 0; x != 1 << accuracy; ++x)
+        {
+            const FseTable::Entry& entry = table.entries[x];
+            for (int y = entry.base; y != entry.base + (1 << entry.bits); ++y)
+                states[(entry.symbol << accuracy) | y] = (unsigned short)x;
+        }
+    }
+
+    unsigned state(unsigned symbol, unsigned next) const { return(states[(symbol << table.accuracy) | next]); }
+};
+
+static const FseEncoder& predefined_encoder(int t)
+{
+    static const FseEncoder encoders[3] = {FseEncoder(0), FseEncoder(1), FseEncoder(2)};
+    return(encoders[t]);
+}
+
+
+// Writes the header of a raw or RLE literals section of size bytes
+static void put_literals_header(int type, size_t size, std::vector<unsigned char>& out)
+{
+    if (size < 32)
+        out.push_back((unsigned char)(type | size << 3));
+    else if (size < 4096)
+        put_le(type | 1 << 2 | size << 4, 2, out);
+    else
+        put_le(type | 3 << 2 | size << 4, 3, out);
+}
+
+
+// Finds code lengths of at most HUFFMAN_MAX_BITS for the byte counts, halving the counts until the longest fits. Returns the longest length.
+static int huffman_lengths(const unsigned* counts, int symbols, unsigned char* lengths)
+{
+    std::vector<unsigned> scaled(counts, counts + symbols);
+    for (;;)
+    {
+        typedef std::pair<unsigned long long, int> Node;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+        std::vector<int> parent(2*symbols, -1);
+        for (int s = 0; s != symbols; ++s)
+            if (scaled[s])
+                heap.push(Node(scaled[s], s));
+        int next = symbols;
+        while (heap.size() > 1)
+        {
+            const Node a = heap.top();
+            heap.pop();
+            const Node b = heap.top();
+            heap.pop();
+            parent[a.second] = parent[b.second] = next;
+            heap.push(Node(a.first + b.first, next++));
+        }
+        int longest = 0;
+        for (int s = 0; s != symbols; ++s)
+        {
+            int length = 0;
+            for (int node = s; scaled[s] && parent[node] >= 0; node = parent[node])
+                ++length;
+            lengths[s] = (unsigned char)length;
+            longest = std::max(longest, length);
+        }
+        if (longest <= HUFFMAN_MAX_BITS)
+            return(longest);
+        for (unsigned& count: scaled)
+            count = count ? (count + 1)/2 : 0;
+    }
+}
+
+
+// Writes the literals section of a block: Huffman coded when that is smaller, and otherwise raw, or RLE when they are all one byte
+static void put_literals(const std::vector<unsigned char>& literals, std::vector<unsigned char>& out)
+{
+    const size_t n = literals.size();
+    unsigned counts[256] = {0};
+    for (unsigned char c: literals)
+        ++counts[c];
+    int last = 255;
+    while (last > 0 && !counts[last])
+        --last;
+    if (n && counts[last] == n)
+    {
+        put_literals_header(rle_literals, n, out);
+        out.push_back((unsigned char)last);
+        return;
+    }
+
+    // Weights are stored directly, 4 bits each, which allows 128 symbols before the last
+    if (n >= 64 && last <= 128)
+    {
+        unsigned char lengths[256];
+        const int max_bits = huffman_lengths(counts, last + 1, lengths);
+
+        // Canonical codes as the decoder's table assigns them: longer codes first, symbols in order within a length
+        unsigned start[HUFFMAN_MAX_BITS + 2] = {0};
+        for (int s = 0; s <= last; ++s)
+            if (lengths[s])
+                start[lengths[s]] += 1u << (max_bits - lengths[s]);
+        unsigned position = 0;
+        for (int length = max_bits; length >= 1; --length)
+        {
+            const unsigned count = start[length];
+            start[length] = position;
+            position += count;
+        }
+        unsigned short codes[256];
+        for (int s = 0; s <= last; ++s)
+        {
+            if (!lengths[s])
+                continue;
+            codes[s] = (unsigned short)(start[lengths[s]] >> (max_bits - lengths[s]));
+            start[lengths[s]] += 1u << (max_bits - lengths[s]);
+        }
+
+        std::vector<unsigned char> section;
+        section.push_back((unsigned char)(127 + last));
+        for (int s = 0; s < last; s += 2)
+        {
+            const int high = lengths[s] ? max_bits + 1 - lengths[s] : 0;
+            const int low = (s + 1 < last && lengths[s + 1]) ? max_bits + 1 - lengths[s + 1] : 0;
+            section.push_back((unsigned char)(high << 4 | low));
+        }
+
+        // Literals are written last first, so that the decoder reads them in order. Large sections are split into four streams decoded independently.
+        auto put_stream = [&](size_t from, size_t to) {
+            BitWriter bits(section);
+            for (size_t i = to; i-- > from;)
+                bits.put(codes[literals[i]], lengths[literals[i]]);
+            bits.close();
+        };
+        const bool four = n > 1023;
+        if (four)
+        {
+            const size_t part = (n + 3)/4;
+            const size_t table = section.size();
+            section.resize(table + 6);
+            for (int s = 0; s != 4; ++s)
+            {
+                const size_t begin = section.size();
+                put_stream(s*part, std::min(n, (s + 1)*part));
+                if (s != 3)
+                {
+                    section[table + 2*s] = (unsigned char)(section.size() - begin);
+                    section[table + 2*s + 1] = (unsigned char)((section.size() - begin) >> 8);
+                }
+            }
+        }
+        else
+            put_stream(0, n);
+
+        const size_t compressed = section.size();
+        const int format = !four ? 0 : (n < 16384) ? 2 : 3;
+        const int bits = (format == 0) ? 10 : (format == 2) ? 14 : 18;
+        if (compressed < n && compressed < (1ul << bits))
+        {
+            put_le(huffman_literals | format << 2 | (unsigned long long)n << 4 | (unsigned long long)compressed << (4 + bits), (format == 0) ? 3 : format + 2, out);
+            out.insert(out.end(), section.begin(), section.end());
+            return;
+        }
+    }
+    put_literals_header(raw_literals, n, out);
+    out.insert(out.end(), literals.begin(), literals.end());
+}
+
+
+// Writes the sequences section of a block with the predefined codes, so that no tables are needed
+static void put_sequences(const std::vector<Sequence>& sequences, std::vector<unsigned char>& out)
+{
+    const size_t n = sequences.size();
+    if (n < 128)
+        out.push_back((unsigned char)n);
+    else if (n < 0x7F00)
+        put_le(((n >> 8) + 128) | (n & 0xff) << 8, 2, out);
+    else
+        put_le(255 | (n - 0x7F00) << 8, 3, out);
+    if (!n)
+        return;
+    out.push_back(0);
+
+    const FseEncoder& literal_coder = predefined_encoder(0);
+    const FseEncoder& offset_coder = predefined_encoder(1);
+    const FseEncoder& match_coder = predefined_encoder(2);
+    BitWriter bits(out);
+    unsigned literal_state = 0, offset_state = 0, match_state = 0;
+    auto update = [&bits](const FseEncoder& coder, unsigned symbol, unsigned& state) {
+        const unsigned previous = coder.state(symbol, state);
+        const FseTable::Entry& entry = coder.table.entries[previous];
+        bits.put(state - entry.base, entry.bits);
+        state = previous;
+    };
+
+    // The decoder reads each sequence's extra bits (offset, match, literals) and then updates its states (literals, match, offset), so they are written in reverse from the last sequence back
+    for (size_t i = n; i-- > 0;)
+    {
+        const Sequence& sequence = sequences[i];
+        const unsigned literal_code = (unsigned)(std::upper_bound(literal_base, literal_base + 36, sequence.literals) - literal_base - 1);
+        const unsigned match_code = (unsigned)(std::upper_bound(match_base, match_base + 53, sequence.match) - match_base - 1);
+        const unsigned offset_value = sequence.offset + 3;
+        const unsigned offset_code = highest_bit(offset_value);
+        if (i + 1 == n)
+        {
+            literal_state = literal_coder.state(literal_code, 0);
+            match_state = match_coder.state(match_code, 0);
+            offset_state = offset_coder.state(offset_code, 0);
+        }
+        else
+        {
+            update(offset_coder, offset_code, offset_state);
+            update(match_coder, match_code, match_state);
+            update(literal_coder, literal_code, literal_state);
+        }
+        bits.put(sequence.literals - literal_base[literal_code], literal_extra[literal_code]);
+        bits.put(sequence.match - match_base[match_code], match_extra[match_code]);
+        bits.put(offset_value - (1u << offset_code), offset_code);
+    }
+    bits.put(match_state, match_coder.table.accuracy);
+    bits.put(offset_state, offset_coder.table.accuracy);
+    bits.put(literal_state, literal_coder.table.accuracy);
+    bits.close();
+}
+
+
+// Appends a frame holding size bytes of data to out. Matches are found greedily through hash chains reaching back over the whole frame, the content size and checksum are stored, and each block is stored raw or as RLE when compressing does not make it smaller.
+static void compress_frame(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+{
+    put_le(ZSTD_MAGIC, 4, out);
+    const int size_flag = (size < 256) ? 0 : (size < 65536 + 256) ? 1 : 2;
+    out.push_back((unsigned char)(size_flag << 6 | 0x20 | 0x04));
+    put_le(size - (size_flag == 1 ? 256 : 0), (size_flag == 0) ? 1 : 2*size_flag, out);
+
+    std::vector<int> head(1 << HASH_BITS, -1), chain(size);
+    auto hash = [data](size_t i) { return((unsigned)(read_le(data + i, 4)*2654435761ul & 0xfffffffful) >> (32 - HASH_BITS)); };
+    auto insert = [&](size_t i) {
+        if (i + MIN_MATCH > size)
+            return;
+        const unsigned h = hash(i);
+        chain[i] = head[h];
+        head[h] = (int)i;
+    };
+
+    std::vector<Sequence> sequences;
+    std::vector<unsigned char> literals, block;
+    size_t start = 0;
+    do
+    {
+        const size_t end = std::min(size, start + MAX_BLOCK);
+        const bool last = end == size;
+        sequences.clear();
+        literals.clear();
+        block.clear();
+
+        size_t anchor = start, i = start;
+        while (i + MIN_MATCH <= end)
+        {
+            size_t best = 0, best_offset = 0;
+            int candidate = head[hash(i)];
+            for (int tries = 0; tries != DEFLATE_CHAIN && candidate >= 0; ++tries, candidate = chain[candidate])
+            {
+                const unsigned char* a = data + candidate;
+                const unsigned char* b = data + i;
+                if (a[best] != b[best])
+                    continue;
+                size_t length = 0;
+                while (i + length != end && a[length] == b[length])
+                    ++length;
+                if (length > best)
+                {
+                    best = length;
+                    best_offset = i - candidate;
+                    if (i + length == end)
+                        break;
+                }
+            }
+            insert(i);
+            if (best < MIN_MATCH)
+            {
+                ++i;
+                continue;
+            }
+            literals.insert(literals.end(), data + anchor, data + i);
+            sequences.push_back(Sequence{(unsigned)(i - anchor), (unsigned)best_offset, (unsigned)best});
+            for (size_t k = i + 1; k != i + best; ++k)
+                insert(k);
+            i += best;
+            anchor = i;
+        }
+        literals.insert(literals.end(), data + anchor, data + end);
+        put_literals(literals, block);
+        put_sequences(sequences, block);
+
+        const size_t raw = end - start;
+        const bool same = raw > 1 && std::count(data + start, data + end, data[start]) == (long)raw;
+        const int type = same ? rle_block : (block.size() < raw) ? compressed_block : raw_block;
+        put_le(last | type << 1 | ((type == compressed_block) ? block.size() : raw) << 3, 3, out);
+        if (type == compressed_block)
+            out.insert(out.end(), block.begin(), block.end());
+        else
+            out.insert(out.end(), data + start, data + (type == rle_block ? start + 1 : end));
+        start = end;
+    } while (start != size);
+
+    Xxh64 checksum;
+    checksum.add(data, size);
+    put_le(checksum.digest(), 4, out);
+}
+
+
+void zstd_compress_parallel(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+{
+    const size_t count = std::max<size_t>((size + ZSTD_FRAME - 1)/ZSTD_FRAME, 1);
+    std::vector<std::vector<unsigned char>> frames(count);
+    parallel_for(count, [&](size_t f) {
+        const size_t first = f*ZSTD_FRAME;
+        compress_frame(data + first, std::min<size_t>(ZSTD_FRAME, size - first), frames[f]);
+    });
+    for (auto& frame: frames)
+        out.insert(out.end(), frame.begin(), frame.end());
+}
+
+
+ZstdWriter::ZstdWriter(FILE* out) : out(out), written(false)
+{
+}
+
+
+void ZstdWriter::compress()
+{
+    INSTRUMENT_SCOPE("zstd_compress");
+    compressed.clear();
+    zstd_compress_parallel((const unsigned char*)pending.data(), pending.size(), compressed);
+    fwrite(compressed.data(), 1, compressed.size(), out);
+    pending.clear();
+    written = true;
+}
+
+
+void ZstdWriter::write(const std::string& text)
+{
+    pending += text;
+    if (pending.size() >= ZSTD_BLOCK)
+        compress();
+}
+
+
+bool ZstdWriter::finish()
+{
+    // A file with no text still holds an empty frame
+    if (!pending.empty() || !written)
+        compress();
+    return(!ferror(out));
+}
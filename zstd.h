@@ -0,0 +1,61 @@
+// Zstandard files (RFC 8878) as batch input and output: decompression runs ahead of parsing on its own thread, and compression writes independent frames that are compressed in parallel.
+
+#ifndef ZSTD_H
+#define ZSTD_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "gzip.h"
+
+// Constants: bytes of content in each frame written, and bytes of text collected before they are compressed in parallel
+#define ZSTD_FRAME 1048576
+#define ZSTD_BLOCK 16777216
+
+// Constants: largest window read, as for the reference decoder, and the bytes of content of small frames read together and decompressed in parallel
+#define ZSTD_WINDOW_MAX 134217728
+#define ZSTD_GROUP 16777216
+
+
+// Returns true if the first byte of in, which is left unread, starts the magic number of a Zstandard frame. Batch files start with their header, so they are never taken for one.
+bool is_zstd(FILE* in);
+
+
+// Reads the text of a Zstandard file of one or more frames. Frames that give their size and hold at most ZSTD_FRAME bytes, as ZstdWriter writes, are read a group at a time and decompressed in parallel; other frames, as the zstd tool writes, are decompressed block by block. Skippable frames are passed over, and content checksums are checked.
+class ZstdReader: public CompressedReader {
+    FILE* in;
+
+    bool decompress() override;
+    bool decompress_group(std::vector<std::vector<unsigned char>>& frames);
+
+public:
+    // Starts decompressing in, which must be open in binary mode.
+    ZstdReader(FILE* in);
+    ~ZstdReader();
+};
+
+
+// Writes text to a Zstandard file. Text is collected into blocks of ZSTD_BLOCK bytes, which are cut into frames of ZSTD_FRAME bytes compressed in parallel.
+class ZstdWriter {
+    FILE* out;
+    std::string pending;
+    std::vector<unsigned char> compressed;
+    bool written;
+
+    void compress();
+
+public:
+    // Writes to out, which must be open in binary mode.
+    ZstdWriter(FILE* out);
+
+    void write(const std::string& text);
+
+    // Compresses what is left. Returns false if writing failed.
+    bool finish();
+};
+
+// Appends size bytes of data to out as Zstandard frames of up to ZSTD_FRAME bytes of content each, compressed in parallel. Each frame is a complete file, so the output of any number of calls can be concatenated. No data gives one empty frame.
+void zstd_compress_parallel(const unsigned char* data, size_t size, std::vector<unsigned char>& out);
+
+
+#endif /* ZSTD_H */